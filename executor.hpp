@@ -0,0 +1,396 @@
+/*
+Copyright (c) 2013 Janick Bernet
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#ifndef _EXECUTOR_HPP_
+#define _EXECUTOR_HPP_
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "functional.hpp"
+
+namespace functional
+{
+    class Executor;
+
+    template<typename T>
+    class task;
+
+    //! the executor used when none is given explicitly, sized to the hardware concurrency
+    Executor& defaultExecutor();
+
+    //! async :: (() -> a) -> task a
+    template<typename Fun>
+    auto async(Fun fun) -> task<decltype(fun())>;
+
+    //! async :: Executor -> (() -> a) -> task a
+    template<typename Fun>
+    auto async(Executor& executor, Fun fun) -> task<decltype(fun())>;
+};
+
+namespace functional_impl
+{
+    namespace helpers
+    {
+        // shared state of a task, fulfilled exactly once by the job running on the executor,
+        // either with a value or with the exception the job threw
+        template<typename T>
+        struct TaskState
+        {
+            std::mutex mutex;
+            std::condition_variable done;
+            bool ready = { false };
+            std::unique_ptr<T> value;
+            std::exception_ptr error;
+            std::vector<std::function<void()>> continuations;
+
+            template<typename Fun>
+            void run(Fun& fun)
+            {
+                std::unique_ptr<T> result;
+                try
+                {
+                    result.reset(new T(fun()));
+                }
+                catch (...)
+                {
+                    fulfil(nullptr, std::current_exception());
+                    return;
+                }
+                fulfil(std::move(result), nullptr);
+            }
+
+            void fulfil(std::unique_ptr<T> result, std::exception_ptr exception)
+            {
+                std::vector<std::function<void()>> pending;
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    value = std::move(result);
+                    error = std::move(exception);
+                    ready = true;
+                    pending.swap(continuations);
+                }
+                done.notify_all();
+                for (auto& continuation : pending)
+                {
+                    continuation();
+                }
+            }
+        };
+
+        // void tasks only signal completion
+        template<>
+        struct TaskState<void>
+        {
+            std::mutex mutex;
+            std::condition_variable done;
+            bool ready = { false };
+            std::exception_ptr error;
+            std::vector<std::function<void()>> continuations;
+
+            template<typename Fun>
+            void run(Fun& fun)
+            {
+                try
+                {
+                    fun();
+                }
+                catch (...)
+                {
+                    fulfil(std::current_exception());
+                    return;
+                }
+                fulfil(nullptr);
+            }
+
+            void fulfil(std::exception_ptr exception)
+            {
+                std::vector<std::function<void()>> pending;
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    error = std::move(exception);
+                    ready = true;
+                    pending.swap(continuations);
+                }
+                done.notify_all();
+                for (auto& continuation : pending)
+                {
+                    continuation();
+                }
+            }
+        };
+
+        // what task<T>::get() hands out: a reference to the shared value, or nothing for void tasks
+        template<typename T>
+        struct TaskResult
+        {
+            typedef const T& type;
+        };
+
+        template<>
+        struct TaskResult<void>
+        {
+            typedef void type;
+        };
+
+        // calls a continuation with the value of a finished task (or without argument for void tasks)
+        template<typename Fun, typename T>
+        auto continueWith(Fun& fun, TaskState<T>& state) -> decltype(fun(*state.value))
+        {
+            return fun(*state.value);
+        }
+
+        template<typename Fun>
+        auto continueWith(Fun& fun, TaskState<void>&) -> decltype(fun())
+        {
+            return fun();
+        }
+    }
+};
+
+// a fixed size pool of worker threads executing jobs in submission order;
+// jobs must not block on other jobs of the same executor, callers wait from outside
+class functional::Executor
+{
+public:
+    explicit Executor(std::size_t threads = std::thread::hardware_concurrency())
+        : m_id(nextId())
+        , m_stop(false)
+    {
+        if (threads == 0)
+        {
+            threads = 1;
+        }
+        m_workers.reserve(threads);
+        for (std::size_t i = 0; i < threads; ++i)
+        {
+            m_workers.emplace_back([this, i] { work(i); });
+        }
+    }
+
+    Executor(const Executor&) = delete;
+    Executor& operator= (const Executor&) = delete;
+
+    // finishes all queued jobs before joining the workers
+    ~Executor()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stop = true;
+        }
+        m_wake.notify_all();
+        for (auto& worker : m_workers)
+        {
+            worker.join();
+        }
+    }
+
+    // submitted jobs must not throw: like one escaping a std::thread, an exception escaping a job terminates
+    // the program. Tasks and the parallel combinators catch the exceptions of their jobs and hand them on
+    void submit(std::function<void()> job)
+    {
+        FUNCTIONAL_TRACE_INSTANT("submit");
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_jobs.push_back(std::move(job));
+        }
+        m_wake.notify_one();
+    }
+
+    std::size_t concurrency() const
+    {
+        return m_workers.size();
+    }
+
+private:
+    static std::size_t nextId()
+    {
+        static std::atomic<std::size_t> executors(0);
+        return executors++;
+    }
+
+    void work(std::size_t worker)
+    {
+#if defined(FUNCTIONAL_INSTRUMENTATION)
+        // busy time per worker, the remainder of the wall time is spent waiting for jobs
+        auto& busy = functional_impl::instrumentation::Registry::instance().add("worker", "executor " + std::to_string(m_id) + " worker " + std::to_string(worker));
+#else
+        (void)worker;
+#endif
+        for (;;)
+        {
+            std::function<void()> job;
+            {
+                FUNCTIONAL_TRACE_SCOPE("idle");
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_wake.wait(lock, [this] { return m_stop || !m_jobs.empty(); });
+                if (m_jobs.empty())
+                {
+                    return;
+                }
+                job = std::move(m_jobs.front());
+                m_jobs.pop_front();
+            }
+            FUNCTIONAL_TRACE_SCOPE("job");
+#if defined(FUNCTIONAL_INSTRUMENTATION)
+            auto start = std::chrono::steady_clock::now();
+            job();
+            busy.calls.fetch_add(1, std::memory_order_relaxed);
+            busy.nanoseconds.fetch_add(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count(), std::memory_order_relaxed);
+#else
+            job();
+#endif
+        }
+    }
+
+    const std::size_t m_id;
+    std::vector<std::thread> m_workers;
+    std::deque<std::function<void()>> m_jobs;
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+    bool m_stop;
+};
+
+// handle to a value computed on an executor; copies share the same result.
+// get() blocks until the value is there, then() chains work onto the executor without blocking
+template<typename T>
+class functional::task
+{
+public:
+    typedef T value_type;
+
+    task(Executor& executor, std::shared_ptr<functional_impl::helpers::TaskState<T>> state)
+        : m_executor(&executor)
+        , m_state(std::move(state))
+    {
+    }
+
+    bool ready() const
+    {
+        std::lock_guard<std::mutex> lock(m_state->mutex);
+        return m_state->ready;
+    }
+
+    void wait() const
+    {
+        std::unique_lock<std::mutex> lock(m_state->mutex);
+        m_state->done.wait(lock, [this] { return m_state->ready; });
+    }
+
+    // rethrows the exception of a failed task, like std::future
+    typename functional_impl::helpers::TaskResult<T>::type get() const
+    {
+        wait();
+        if (m_state->error)
+        {
+            std::rethrow_exception(m_state->error);
+        }
+        Identity identity;
+        return functional_impl::helpers::continueWith(identity, *m_state);
+    }
+
+    // a failed task passes its exception on to the continuation's task without calling it
+    //! then :: task a -> (a -> b) -> task b
+    template<typename Fun>
+    auto then(Fun fun) const -> task<decltype(functional_impl::helpers::continueWith(fun, std::declval<functional_impl::helpers::TaskState<T>&>()))>
+    {
+        typedef decltype(functional_impl::helpers::continueWith(fun, *m_state)) ResultType;
+
+        auto next = std::make_shared<functional_impl::helpers::TaskState<ResultType>>();
+        auto state = m_state;
+        Executor* executor = m_executor;
+        auto schedule = [executor, state, next, fun]() mutable
+        {
+            executor->submit([state, next, fun]() mutable
+            {
+                auto step = [&]()
+                {
+                    if (state->error)
+                    {
+                        std::rethrow_exception(state->error);
+                    }
+                    return functional_impl::helpers::continueWith(fun, *state);
+                };
+                next->run(step);
+            });
+        };
+
+        std::unique_lock<std::mutex> lock(m_state->mutex);
+        if (m_state->ready)
+        {
+            lock.unlock();
+            schedule();
+        }
+        else
+        {
+            m_state->continuations.push_back(schedule);
+        }
+        return task<ResultType>(*m_executor, next);
+    }
+
+private:
+    struct Identity
+    {
+        template<typename V>
+        const V& operator() (const V& v) const { return v; }
+        void operator() () const {}
+    };
+
+    Executor* m_executor;
+    std::shared_ptr<functional_impl::helpers::TaskState<T>> m_state;
+};
+
+inline functional::Executor& functional::defaultExecutor()
+{
+    static Executor executor;
+    return executor;
+}
+
+template<typename Fun>
+auto functional::async(Fun fun) -> task<decltype(fun())>
+{
+    return async(defaultExecutor(), std::move(fun));
+}
+
+template<typename Fun>
+auto functional::async(Executor& executor, Fun fun) -> task<decltype(fun())>
+{
+    typedef decltype(fun()) ResultType;
+
+    auto state = std::make_shared<functional_impl::helpers::TaskState<ResultType>>();
+    executor.submit([state, fun]() mutable { state->run(fun); });
+    return task<ResultType>(executor, state);
+}
+
+#endif // _EXECUTOR_HPP_
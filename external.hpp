@@ -0,0 +1,612 @@
+/*
+Copyright (c) 2013 Janick Bernet
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#ifndef _EXTERNAL_HPP_
+#define _EXTERNAL_HPP_
+
+// Out of core sorting and grouping for inputs larger than memory: elements are gathered into runs of at
+// most the memory budget, each run is sorted and appended to an anonymous temporary file as raw bytes,
+// and the runs are merged back with buffered sequential reads. The result is a single pass generator,
+// so merging happens while it is consumed. Elements must be trivially copyable. When there are more runs
+// than read buffers fit into the budget, groups of runs are merged into longer runs first. All runs of a
+// pass share one file, so the number of open files doesn't grow with the input. I/O errors are thrown
+// as std::runtime_error.
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdio>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "sort.hpp"
+
+namespace functional_impl
+{
+    namespace helpers
+    {
+        template<typename Sequence>
+        struct external_value_t
+        {
+            typedef typename std::decay<decltype(*std::declval<const Sequence&>().begin())>::type type;
+        };
+
+        template<typename Sequence, typename KeyFun, typename Fun, typename Acc>
+        struct external_fold_t
+        {
+            typedef std::pair<typename sort_key_t<Sequence, KeyFun>::type, Acc> type;
+        };
+    }
+};
+
+namespace functional
+{
+    //! externalSortBy :: (a -> a -> Bool) -> Int -> [a] -> [a]
+    template<typename Less, typename Sequence>
+    generator<typename functional_impl::helpers::external_value_t<Sequence>::type> externalSortBy(Less less, std::size_t memoryBudget, const Sequence& input);
+
+    //! externalSortOn :: (a -> b) -> Int -> [a] -> [a]
+    template<typename Key, typename Sequence>
+    generator<typename functional_impl::helpers::external_value_t<Sequence>::type> externalSortOn(Key key, std::size_t memoryBudget, const Sequence& input);
+
+    // folds the elements of every key in key order, only one group's accumulator is held at a time
+    //! externalFoldOn :: (a -> k) -> (b -> a -> b) -> b -> Int -> [a] -> [(k, b)]
+    template<typename Key, typename Fun, typename Acc, typename Sequence>
+    generator<typename functional_impl::helpers::external_fold_t<Sequence, Key, Fun, Acc>::type> externalFoldOn(Key key, Fun fun, Acc init, std::size_t memoryBudget, const Sequence& input);
+
+    // the elements of a file of raw trivially copyable values, read in blocks
+    //! readBinary :: FilePath -> [a]
+    template<typename T>
+    generator<T> readBinary(const std::string& path);
+
+    //! writeBinary :: FilePath -> [a] -> Int
+    template<typename Sequence>
+    std::size_t writeBinary(const std::string& path, const Sequence& input);
+};
+
+namespace functional_impl
+{
+    namespace helpers
+    {
+        // reads and writes are done in blocks of at least this size, which also bounds the merge fan in
+        static const std::size_t externalBlockBytes = 1 << 16;
+
+        struct FileCloser
+        {
+            void operator() (std::FILE* file) const { std::fclose(file); }
+        };
+
+        typedef std::unique_ptr<std::FILE, FileCloser> FilePtr;
+
+        inline std::size_t blockElements(std::size_t bytes, std::size_t elementSize)
+        {
+            return std::max<std::size_t>(1, bytes / elementSize);
+        }
+
+        // sequential reader handing out one element at a time from a buffered block of the file
+        template<typename T>
+        class BlockReader
+        {
+        public:
+            // reads from the current position to the end of the file
+            BlockReader(std::FILE* file, std::size_t blockElements)
+                : m_file(file)
+                , m_block(blockElements)
+                , m_pos(0)
+                , m_count(0)
+                , m_remaining(std::numeric_limits<std::size_t>::max())
+                , m_seek(false)
+            {
+                fill();
+            }
+
+            // reads count elements from start on; readers sharing a file each seek back to where they stopped
+            BlockReader(std::FILE* file, std::size_t blockElements, const std::fpos_t& start, std::size_t count)
+                : m_file(file)
+                , m_block(std::max<std::size_t>(1, std::min(blockElements, count)))
+                , m_pos(0)
+                , m_count(0)
+                , m_remaining(count)
+                , m_seek(true)
+                , m_next(start)
+            {
+                fill();
+            }
+
+            bool valid() const { return m_pos < m_count; }
+            const T& head() const { return m_block[m_pos]; }
+
+            void advance()
+            {
+                if (++m_pos == m_count)
+                {
+                    fill();
+                }
+            }
+
+        private:
+            void fill()
+            {
+                m_pos = 0;
+                m_count = 0;
+                const std::size_t wanted = std::min(m_block.size(), m_remaining);
+                if (wanted == 0)
+                {
+                    return;
+                }
+                if (m_seek && std::fsetpos(m_file, &m_next) != 0)
+                {
+                    throw std::runtime_error("cannot seek in spilled run");
+                }
+                m_count = std::fread(m_block.data(), sizeof(T), wanted, m_file);
+                if (std::ferror(m_file) || (m_seek && (m_count != wanted || std::fgetpos(m_file, &m_next) != 0)))
+                {
+                    throw std::runtime_error("cannot read binary file");
+                }
+                m_remaining -= m_count;
+            }
+
+            std::FILE* m_file;
+            std::vector<T> m_block;
+            std::size_t m_pos;
+            std::size_t m_count;
+            std::size_t m_remaining;
+            bool m_seek;
+            std::fpos_t m_next;
+        };
+
+        // an anonymous temporary file holding sorted runs one after the other, which the system removes
+        // once it is closed; the runs keep it open as long as one of them is left
+        class SpillFile
+        {
+        public:
+            SpillFile()
+                : m_file(std::tmpfile())
+            {
+                if (!m_file)
+                {
+                    throw std::runtime_error("cannot create temporary file for spilling");
+                }
+            }
+
+            std::FILE* get() const { return m_file.get(); }
+
+        private:
+            FilePtr m_file;
+        };
+
+        // one sorted run, appended to the end of a spill file; a run is written completely before the next
+        // one of the same file starts, and read only once all of them are written
+        template<typename T>
+        class SpillRun
+        {
+        public:
+            explicit SpillRun(std::shared_ptr<SpillFile> file)
+                : m_file(std::move(file))
+                , m_count(0)
+            {
+                if (std::fseek(m_file->get(), 0, SEEK_END) != 0 || std::fgetpos(m_file->get(), &m_start) != 0)
+                {
+                    throw std::runtime_error("cannot start spilled run");
+                }
+            }
+
+            void write(const T* values, std::size_t count)
+            {
+                FUNCTIONAL_TRACE_SCOPE("spill");
+                if (std::fwrite(values, sizeof(T), count, m_file->get()) != count)
+                {
+                    throw std::runtime_error("cannot write spilled run");
+                }
+                m_count += count;
+            }
+
+            BlockReader<T> read(std::size_t blockElements) const
+            {
+                return BlockReader<T>(m_file->get(), blockElements, m_start, m_count);
+            }
+
+        private:
+            std::shared_ptr<SpillFile> m_file;
+            std::fpos_t m_start;
+            std::size_t m_count;
+        };
+
+        // k-way merge of sorted runs through a heap of run indices; ties go to the earlier run, which
+        // together with stably sorted runs keeps the merge stable
+        template<typename T, typename Less>
+        class RunMerge
+        {
+        public:
+            RunMerge(std::vector<SpillRun<T>> runs, const Less& less, std::size_t blockElements)
+                : m_runs(std::move(runs))
+                , m_less(less)
+            {
+                m_readers.reserve(m_runs.size());
+                for (std::size_t run = 0; run < m_runs.size(); ++run)
+                {
+                    m_readers.push_back(m_runs[run].read(blockElements));
+                    if (m_readers.back().valid())
+                    {
+                        m_heap.push_back(run);
+                    }
+                }
+                std::make_heap(m_heap.begin(), m_heap.end(), After{ this });
+            }
+
+            bool next(T& value)
+            {
+                if (m_heap.empty())
+                {
+                    return false;
+                }
+                std::pop_heap(m_heap.begin(), m_heap.end(), After{ this });
+                auto& reader = m_readers[m_heap.back()];
+                value = reader.head();
+                reader.advance();
+                if (reader.valid())
+                {
+                    std::push_heap(m_heap.begin(), m_heap.end(), After{ this });
+                }
+                else
+                {
+                    m_heap.pop_back();
+                }
+                return true;
+            }
+
+        private:
+            // heap order with the smallest head on top
+            struct After
+            {
+                const RunMerge* merge;
+
+                bool operator() (std::size_t a, std::size_t b) const
+                {
+                    const T& headA = merge->m_readers[a].head();
+                    const T& headB = merge->m_readers[b].head();
+                    return merge->m_less(headB, headA) || (!merge->m_less(headA, headB) && b < a);
+                }
+            };
+
+            std::vector<SpillRun<T>> m_runs;
+            std::vector<BlockReader<T>> m_readers;
+            std::vector<std::size_t> m_heap;
+            Less m_less;
+        };
+
+        template<typename T, typename Less>
+        inline SpillRun<T> mergeRuns(std::vector<SpillRun<T>> runs, const Less& less, std::size_t blockElements, const std::shared_ptr<SpillFile>& file)
+        {
+            RunMerge<T, Less> merge(std::move(runs), less, blockElements);
+            SpillRun<T> merged(file);
+            std::vector<T> block;
+            block.reserve(blockElements);
+            T value;
+            while (merge.next(value))
+            {
+                block.push_back(value);
+                if (block.size() == blockElements)
+                {
+                    merged.write(block.data(), block.size());
+                    block.clear();
+                }
+            }
+            merged.write(block.data(), block.size());
+            return merged;
+        }
+
+        // the sorted elements, straight from memory when they fit into a single run
+        template<typename T, typename Less>
+        class ExternalSorted
+        {
+        public:
+            ExternalSorted(std::vector<T> values, std::size_t size)
+                : m_values(std::move(values))
+                , m_pos(0)
+                , m_size(size)
+            {
+            }
+
+            ExternalSorted(std::unique_ptr<RunMerge<T, Less>> merge, std::size_t size)
+                : m_pos(0)
+                , m_size(size)
+                , m_merge(std::move(merge))
+            {
+            }
+
+            std::size_t size() const { return m_size; }
+
+            bool next(T& value)
+            {
+                if (m_merge)
+                {
+                    return m_merge->next(value);
+                }
+                if (m_pos == m_values.size())
+                {
+                    return false;
+                }
+                value = m_values[m_pos++];
+                return true;
+            }
+
+        private:
+            std::vector<T> m_values;
+            std::size_t m_pos;
+            std::size_t m_size;
+            std::unique_ptr<RunMerge<T, Less>> m_merge;
+        };
+
+        template<typename T, typename Less, typename Sequence>
+        inline std::shared_ptr<ExternalSorted<T, Less>> externalSort(const Less& less, std::size_t memoryBudget, const Sequence& input)
+        {
+            static_assert(std::is_trivially_copyable<T>::value, "Elements of an external sort must be trivially copyable.");
+
+            const std::size_t runElements = blockElements(memoryBudget, sizeof(T));
+            std::shared_ptr<SpillFile> file;
+            std::vector<SpillRun<T>> runs;
+            std::vector<T> run;
+            std::size_t size = 0;
+            for (const auto& value : input)
+            {
+                // grown by hand, so the run's capacity never exceeds the budget
+                if (run.size() == run.capacity())
+                {
+                    run.reserve(std::min(runElements, std::max<std::size_t>(16, 2 * run.capacity())));
+                }
+                run.push_back(value);
+                ++size;
+                if (run.size() == runElements)
+                {
+                    std::stable_sort(run.begin(), run.end(), less);
+                    if (!file)
+                    {
+                        file = std::make_shared<SpillFile>();
+                    }
+                    runs.emplace_back(file);
+                    runs.back().write(run.data(), run.size());
+                    run.clear();
+                }
+            }
+
+            std::stable_sort(run.begin(), run.end(), less);
+            if (runs.empty())
+            {
+                return std::make_shared<ExternalSorted<T, Less>>(std::move(run), size);
+            }
+            if (!run.empty())
+            {
+                runs.emplace_back(file);
+                runs.back().write(run.data(), run.size());
+            }
+            std::vector<T>().swap(run);
+
+            // a block per run plus one for the output has to fit into the budget, budgets of less than
+            // three blocks merge pairwise with smaller blocks. Every pass writes into a file of its own
+            const std::size_t budgetBlocks = memoryBudget / externalBlockBytes;
+            const std::size_t fanIn = std::max<std::size_t>(2, budgetBlocks > 0 ? budgetBlocks - 1 : 0);
+            while (runs.size() > fanIn)
+            {
+                FUNCTIONAL_TRACE_SCOPE("merge");
+                auto mergedFile = std::make_shared<SpillFile>();
+                std::vector<SpillRun<T>> merged;
+                for (std::size_t first = 0; first < runs.size(); first += fanIn)
+                {
+                    const std::size_t last = std::min(runs.size(), first + fanIn);
+                    std::vector<SpillRun<T>> group(std::make_move_iterator(runs.begin() + first), std::make_move_iterator(runs.begin() + last));
+                    merged.push_back(mergeRuns(std::move(group), less, blockElements(memoryBudget / (last - first + 1), sizeof(T)), mergedFile));
+                }
+                runs.swap(merged);
+            }
+
+            const std::size_t readElements = blockElements(memoryBudget / runs.size(), sizeof(T));
+            std::unique_ptr<RunMerge<T, Less>> merge(new RunMerge<T, Less>(std::move(runs), less, readElements));
+            return std::make_shared<ExternalSorted<T, Less>>(std::move(merge), size);
+        }
+
+        template<typename KeyFun>
+        struct KeyOrder
+        {
+            Applicator<KeyFun> key;
+
+            template<typename T>
+            bool operator() (const T& a, const T& b) const
+            {
+                return key(a) < key(b);
+            }
+        };
+
+        // folds runs of equal keys of a sorted source, looking one element ahead for the next group
+        template<typename T, typename Sorted, typename KeyFun, typename Fun, typename Acc>
+        class GroupFold
+        {
+        public:
+            typedef typename std::decay<decltype(std::declval<const Applicator<KeyFun>&>()(std::declval<const T&>()))>::type key_type;
+
+            GroupFold(std::shared_ptr<Sorted> sorted, KeyFun key, Fun fun, Acc init)
+                : m_sorted(std::move(sorted))
+                , m_key{ std::move(key) }
+                , m_fun{ std::move(fun) }
+                , m_init(std::move(init))
+                , m_started(false)
+            {
+            }
+
+            bool next(std::pair<key_type, Acc>& group)
+            {
+                T value;
+                if (!m_started)
+                {
+                    m_started = true;
+                    if (m_sorted->next(value))
+                    {
+                        m_pending.emplace(value);
+                    }
+                }
+                if (!m_pending)
+                {
+                    return false;
+                }
+
+                key_type key = m_key(*m_pending);
+                Acc acc = m_fun(m_init, *m_pending);
+                m_pending.reset();
+                while (m_sorted->next(value))
+                {
+                    if (key < m_key(value))
+                    {
+                        m_pending.emplace(value);
+                        break;
+                    }
+                    acc = m_fun(std::move(acc), value);
+                }
+                group = std::make_pair(std::move(key), std::move(acc));
+                return true;
+            }
+
+        private:
+            std::shared_ptr<Sorted> m_sorted;
+            const Applicator<KeyFun> m_key;
+            const Applicator<Fun> m_fun;
+            const Acc m_init;
+            Maybe<T> m_pending;
+            bool m_started;
+        };
+    }
+};
+
+template<typename Less, typename Sequence>
+functional::generator<typename functional_impl::helpers::external_value_t<Sequence>::type> functional::externalSortBy(Less less, std::size_t memoryBudget, const Sequence& input)
+{
+    typedef typename functional_impl::helpers::external_value_t<Sequence>::type ValueType;
+    typedef functional_impl::helpers::Applicator<Less> LessType;
+
+    FUNCTIONAL_PROBE("externalSortBy", Less);
+    auto sorted = functional_impl::helpers::externalSort<ValueType>(LessType{ std::move(less) }, memoryBudget, input);
+    FUNCTIONAL_PROBE_ELEMENTS(sorted->size());
+    return generator<ValueType>([sorted](ValueType& value) { return sorted->next(value); });
+}
+
+template<typename Key, typename Sequence>
+functional::generator<typename functional_impl::helpers::external_value_t<Sequence>::type> functional::externalSortOn(Key key, std::size_t memoryBudget, const Sequence& input)
+{
+    typedef typename functional_impl::helpers::external_value_t<Sequence>::type ValueType;
+    typedef functional_impl::helpers::KeyOrder<Key> LessType;
+
+    FUNCTIONAL_PROBE("externalSortOn", Key);
+    auto sorted = functional_impl::helpers::externalSort<ValueType>(LessType{ { std::move(key) } }, memoryBudget, input);
+    FUNCTIONAL_PROBE_ELEMENTS(sorted->size());
+    return generator<ValueType>([sorted](ValueType& value) { return sorted->next(value); });
+}
+
+template<typename Key, typename Fun, typename Acc, typename Sequence>
+functional::generator<typename functional_impl::helpers::external_fold_t<Sequence, Key, Fun, Acc>::type> functional::externalFoldOn(Key key, Fun fun, Acc init, std::size_t memoryBudget, const Sequence& input)
+{
+    typedef typename functional_impl::helpers::external_value_t<Sequence>::type ValueType;
+    typedef typename functional_impl::helpers::external_fold_t<Sequence, Key, Fun, Acc>::type GroupType;
+    typedef functional_impl::helpers::KeyOrder<Key> LessType;
+    typedef functional_impl::helpers::ExternalSorted<ValueType, LessType> SortedType;
+
+    FUNCTIONAL_PROBE("externalFoldOn", Fun);
+    auto sorted = functional_impl::helpers::externalSort<ValueType>(LessType{ { key } }, memoryBudget, input);
+    FUNCTIONAL_PROBE_ELEMENTS(sorted->size());
+    auto groups = std::make_shared<functional_impl::helpers::GroupFold<ValueType, SortedType, Key, Fun, Acc>>(std::move(sorted), std::move(key), std::move(fun), std::move(init));
+    return generator<GroupType>([groups](GroupType& group) { return groups->next(group); });
+}
+
+template<typename T>
+functional::generator<T> functional::readBinary(const std::string& path)
+{
+    static_assert(std::is_trivially_copyable<T>::value, "Elements of a binary file must be trivially copyable.");
+
+    // the reader points into the file, both are kept alive by the generator
+    struct Source
+    {
+        functional_impl::helpers::FilePtr file;
+        functional_impl::helpers::BlockReader<T> reader;
+    };
+
+    functional_impl::helpers::FilePtr file(std::fopen(path.c_str(), "rb"));
+    if (!file)
+    {
+        throw std::runtime_error("cannot open binary file " + path);
+    }
+    std::FILE* raw = file.get();
+    auto source = std::make_shared<Source>(Source{ std::move(file), functional_impl::helpers::BlockReader<T>(raw, functional_impl::helpers::blockElements(functional_impl::helpers::externalBlockBytes, sizeof(T))) });
+    return generator<T>([source](T& value)
+    {
+        if (!source->reader.valid())
+        {
+            return false;
+        }
+        value = source->reader.head();
+        source->reader.advance();
+        return true;
+    });
+}
+
+template<typename Sequence>
+std::size_t functional::writeBinary(const std::string& path, const Sequence& input)
+{
+    typedef typename functional_impl::helpers::external_value_t<Sequence>::type ValueType;
+    static_assert(std::is_trivially_copyable<ValueType>::value, "Elements of a binary file must be trivially copyable.");
+
+    functional_impl::helpers::FilePtr file(std::fopen(path.c_str(), "wb"));
+    if (!file)
+    {
+        throw std::runtime_error("cannot open binary file " + path);
+    }
+    const std::size_t blockElements = functional_impl::helpers::blockElements(functional_impl::helpers::externalBlockBytes, sizeof(ValueType));
+    std::vector<ValueType> block;
+    block.reserve(blockElements);
+    std::size_t size = 0;
+    auto flush = [&]
+    {
+        if (std::fwrite(block.data(), sizeof(ValueType), block.size(), file.get()) != block.size())
+        {
+            throw std::runtime_error("cannot write binary file " + path);
+        }
+        size += block.size();
+        block.clear();
+    };
+    for (const auto& value : input)
+    {
+        block.push_back(value);
+        if (block.size() == blockElements)
+        {
+            flush();
+        }
+    }
+    flush();
+    if (std::fflush(file.get()) != 0)
+    {
+        throw std::runtime_error("cannot write binary file " + path);
+    }
+    return size;
+}
+
+#endif // _EXTERNAL_HPP_
@@ -23,21 +23,44 @@ THE SOFTWARE.
 #ifndef _FUNCTIONAL_HPP_
 #define _FUNCTIONAL_HPP_
 
-#include "functional_impl.hpp"
+#include <functional>
 
-// TODO:
-// - write zipwith so that out container can be specified as first paramter
+#include "functional_impl.hpp"
 
 namespace functional
 {
     //! apply :: (a -> b) -> [a]
     template<typename Fun, typename Iteratable>
-    void apply(Fun fun, Iteratable& inout);
+    void apply(Fun fun, Iteratable&& inout);
 
     //! map :: (a -> b) -> [a] -> [b]
     template<typename ResultContainer = _Derived, typename Fun, typename Container>
     auto map(Fun fun, const Container& input) -> decltype(functional_impl::map<ResultContainer>(fun, input));
 
+    //! mapAsync :: (a -> Future b) -> [a] -> Int -> [b]
+    template<typename ResultContainer = _Derived, typename Fun, typename Container>
+    auto mapAsync(Fun fun, const Container& input, std::size_t maxConcurrency) -> decltype(functional_impl::mapAsync<ResultContainer>(fun, input, maxConcurrency));
+
+    //! applyBatched :: ([a] -> ()) -> [a] -> Int -> ()
+    template<typename Fun, typename Iteratable>
+    void applyBatched(Fun fun, Iteratable&& inout, std::size_t batchSize);
+
+    //! mapBatched :: ([a] -> [b]) -> [a] -> Int -> [b]
+    template<typename ResultContainer = _Derived, typename Fun, typename Container>
+    auto mapBatched(Fun fun, const Container& input, std::size_t batchSize) -> decltype(functional_impl::mapBatched<ResultContainer>(fun, input, batchSize));
+
+    //! concatMap :: (a -> [b]) -> [a] -> [b]
+    template<typename ResultContainer = _Derived, typename Fun, typename Container>
+    auto concatMap(Fun fun, const Container& input) -> decltype(functional_impl::concatMap<ResultContainer>(fun, input));
+
+    //! concatMap :: (a -> [b]) -> [a] -> (a -> Int) -> [b]
+    template<typename ResultContainer = _Derived, typename Fun, typename Container, typename SizeHint>
+    auto concatMap(Fun fun, const Container& input, SizeHint sizeHint) -> decltype(functional_impl::concatMap<ResultContainer>(fun, input, sizeHint));
+
+    //! join :: [[a]] -> [a]
+    template<typename Container>
+    auto join(const Container& containers) -> decltype(functional_impl::join(containers));
+
     //! foldr :: (a -> b -> b) -> b -> [a] -> b
     template<typename ResultType, typename Fun, typename Iteratable>
     ResultType foldr(Fun f, ResultType neutralValue, const Iteratable& iteratable);
@@ -46,13 +69,13 @@ namespace functional
     template<typename ResultType, typename Fun, typename Iteratable>
     ResultType foldl(Fun f, ResultType neutralValue, const Iteratable& iteratable);
 
-    //! zipWith :: (a -> b -> c) -> [a] -> [b] -> [c]
-    template<typename Fun, typename LhsContainer, typename RhsContainer>
-    auto zipWith(Fun f, const LhsContainer& lhs, const RhsContainer& rhs) -> decltype(functional_impl::zipWith(f, lhs, rhs));
+    //! zipWith :: (a -> b -> ... -> c) -> [a] -> [b] -> ... -> [c]
+    template<typename ResultContainer = _Derived, typename Fun, typename... Containers>
+    auto zipWith(Fun f, const Containers&... containers) -> decltype(functional_impl::zipWith<ResultContainer>(f, containers...));
 
-    //! zip :: [a] -> [b] -> [(a,b)]
-    template<typename LhsContainer, typename RhsContainer>
-    auto zip(const LhsContainer& lhs, const RhsContainer& rhs) -> decltype(functional_impl::zip(lhs, rhs));
+    //! zip :: [a] -> [b] -> ... -> [(a, b, ...)]
+    template<typename... Containers>
+    auto zip(const Containers&... containers) -> decltype(functional_impl::zip(containers...));
   
     //! curry: ((a,b,...) -> c) -> (a -> b -> ... -> c)
     template<typename Fun>
@@ -68,11 +91,60 @@ namespace functional
     //! range :: a -> b -> [a..b]
     template<typename T>
     Range<T> range(T from, T to);
+
+    template<typename Seed, typename Fun>
+    class Unfold;
+
+    //! unfold :: (b -> (a, b)) -> b -> [a]
+    template<typename Seed, typename Fun>
+    Unfold<Seed, Fun> unfold(Seed seed, Fun step);
+
+    template<typename T, typename Fun>
+    class Iterate;
+
+    //! iterate :: (a -> a) -> a -> [a]
+    template<typename T, typename Fun>
+    Iterate<T, Fun> iterate(Fun fun, T start);
+
+    template<typename T>
+    class Repeat;
+
+    //! repeat :: a -> [a]
+    template<typename T>
+    Repeat<T> repeat(T value);
+
+    template<typename Container>
+    class Cycle;
+
+    //! cycle :: [a] -> [a]
+    template<typename Container>
+    Cycle<Container> cycle(const Container& container);
+
+    template<typename Sequence>
+    class Take;
+
+    //! take :: Int -> [a] -> [a]
+    template<typename Sequence>
+    Take<Sequence> take(std::size_t n, const Sequence& sequence);
+
+    template<typename Sequence, typename Fun>
+    class TakeWhile;
+
+    //! takeWhile :: (a -> Bool) -> [a] -> [a]
+    template<typename Fun, typename Sequence>
+    TakeWhile<Sequence, Fun> takeWhile(Fun predicate, const Sequence& sequence);
+
+    // general single pass sequence pulling its values from a callable bool(T&) until it returns false
+    template<typename T>
+    class generator;
 };
 
 template<typename Fun, typename Iteratable>
-void functional::apply(Fun fun, Iteratable& inout)
+void functional::apply(Fun fun, Iteratable&& inout)
 {
+    // probed here rather than in the implementation, which the other combinators use internally
+    FUNCTIONAL_PROBE("apply", Fun);
+    FUNCTIONAL_PROBE_ELEMENTS(functional_impl::instrumentation::elementCount(inout, 0));
     return functional_impl::apply(fun, inout);
 }
 
@@ -82,6 +154,44 @@ auto functional::map(Fun fun, const Container& input) -> decltype(functional_imp
     return functional_impl::map<ResultContainer>(fun, input);
 }
 
+template<typename ResultContainer, typename Fun, typename Container>
+auto functional::mapAsync(Fun fun, const Container& input, std::size_t maxConcurrency) -> decltype(functional_impl::mapAsync<ResultContainer>(fun, input, maxConcurrency))
+{
+    return functional_impl::mapAsync<ResultContainer>(fun, input, maxConcurrency);
+}
+
+template<typename Fun, typename Iteratable>
+void functional::applyBatched(Fun fun, Iteratable&& inout, std::size_t batchSize)
+{
+    FUNCTIONAL_PROBE("applyBatched", Fun);
+    FUNCTIONAL_PROBE_ELEMENTS(functional_impl::instrumentation::elementCount(inout, 0));
+    return functional_impl::applyBatched(fun, inout, batchSize);
+}
+
+template<typename ResultContainer, typename Fun, typename Container>
+auto functional::mapBatched(Fun fun, const Container& input, std::size_t batchSize) -> decltype(functional_impl::mapBatched<ResultContainer>(fun, input, batchSize))
+{
+    return functional_impl::mapBatched<ResultContainer>(fun, input, batchSize);
+}
+
+template<typename ResultContainer, typename Fun, typename Container>
+auto functional::concatMap(Fun fun, const Container& input) -> decltype(functional_impl::concatMap<ResultContainer>(fun, input))
+{
+    return functional_impl::concatMap<ResultContainer>(fun, input);
+}
+
+template<typename ResultContainer, typename Fun, typename Container, typename SizeHint>
+auto functional::concatMap(Fun fun, const Container& input, SizeHint sizeHint) -> decltype(functional_impl::concatMap<ResultContainer>(fun, input, sizeHint))
+{
+    return functional_impl::concatMap<ResultContainer>(fun, input, sizeHint);
+}
+
+template<typename Container>
+auto functional::join(const Container& containers) -> decltype(functional_impl::join(containers))
+{
+    return functional_impl::join(containers);
+}
+
 template<typename ResultType, typename Fun, typename Iteratable>
 ResultType functional::foldr(Fun f, ResultType neutralValue, const Iteratable& iteratable)
 {
@@ -94,16 +204,16 @@ ResultType functional::foldl(Fun f, ResultType neutralValue, const Iteratable& i
     return functional_impl::foldl<ResultType>(f, neutralValue, iteratable);
 }
 
-template<typename Fun, typename LhsContainer, typename RhsContainer>
-auto functional::zipWith(Fun f, const LhsContainer& lhs, const RhsContainer& rhs) -> decltype(functional_impl::zipWith(f, lhs, rhs))
+template<typename ResultContainer, typename Fun, typename... Containers>
+auto functional::zipWith(Fun f, const Containers&... containers) -> decltype(functional_impl::zipWith<ResultContainer>(f, containers...))
 {
-    return functional_impl::zipWith(f, lhs, rhs);
+    return functional_impl::zipWith<ResultContainer>(f, containers...);
 }
 
-template<typename LhsContainer, typename RhsContainer>
-auto functional::zip(const LhsContainer& lhs, const RhsContainer& rhs) -> decltype(functional_impl::zip(lhs, rhs))
+template<typename... Containers>
+auto functional::zip(const Containers&... containers) -> decltype(functional_impl::zip(containers...))
 {
-    return functional_impl::zip(lhs, rhs);
+    return functional_impl::zip(containers...);
 }
 
 template<typename Fun>
@@ -119,9 +229,11 @@ auto functional::uncurry(Fun f) -> decltype(functional_impl::uncurry(f))
 }
 
 template<typename T>
-class functional::Range
+class functional::Range : public _Sequence
 {
 public:
+    typedef T value_type;
+
     Range(T from, T to)
         : m_from(from)
         , m_to(to)
@@ -161,6 +273,10 @@ public:
     Itr begin() const { return Itr(m_from); }
     Itr end() const { return Itr(m_to); }
 
+    std::size_t size() const { return m_to > m_from ? static_cast<std::size_t>(m_to - m_from) : 0; }
+
+    T operator[] (std::size_t pos) const { return static_cast<T>(m_from + pos); }
+
 private:
     const T m_from;
     const T m_to;
@@ -172,4 +288,486 @@ functional::Range<T> functional::range(T from, T to)
     return { from, to };
 }
 
+// a batch of consecutive elements: a pointer range into contiguous containers (so callables can hand
+// it to APIs taking pointer and length), an iterator range otherwise; the container has to outlive it
+template<typename Itr>
+class functional::Chunk : public _Sequence
+{
+public:
+    typedef typename std::decay<decltype(*std::declval<Itr>())>::type value_type;
+    typedef Itr iterator;
+
+    Chunk(Itr first, Itr last, std::size_t size)
+        : m_first(first)
+        , m_last(last)
+        , m_size(size)
+    {
+    }
+
+    Itr begin() const { return m_first; }
+    Itr end() const { return m_last; }
+
+    std::size_t size() const { return m_size; }
+    bool empty() const { return m_size == 0; }
+
+    // only available for random access iterators
+    template<typename I = Itr>
+    auto operator[] (std::size_t pos) const -> decltype(std::declval<const I&>()[pos])
+    {
+        return m_first[pos];
+    }
+
+private:
+    Itr m_first;
+    Itr m_last;
+    std::size_t m_size;
+};
+
+template<typename Seed, typename Fun>
+class functional::Unfold : public _Infinite
+{
+    typedef decltype(std::declval<functional_impl::helpers::Applicator<Fun>>()(std::declval<const Seed&>())) Step;
+
+public:
+    typedef typename std::decay<decltype(std::declval<Step>().first)>::type value_type;
+
+    Unfold(Seed seed, Fun step)
+        : m_seed(std::move(seed))
+        , m_step{ std::move(step) }
+    {
+    }
+
+    class Itr
+    {
+    public:
+        bool operator!= (const Itr& other) const
+        {
+            return static_cast<bool>(m_state) != static_cast<bool>(other.m_state);
+        }
+
+        const value_type& operator* () const
+        {
+            return (*m_state).first;
+        }
+
+        const Itr& operator++ ()
+        {
+            m_state = m_owner->m_step((*m_state).second);
+            return *this;
+        }
+
+    private:
+        friend class Unfold<Seed, Fun>;
+
+        Itr(const Unfold* owner)
+            : m_owner(owner)
+        {
+        }
+
+        Itr(const Unfold* owner, const Seed& seed)
+            : m_owner(owner)
+            , m_state(owner->m_step(seed))
+        {
+        }
+
+        const Unfold* m_owner;
+        functional_impl::helpers::Maybe<std::pair<value_type, Seed>> m_state;
+    };
+
+    Itr begin() const { return Itr(this, m_seed); }
+    Itr end() const { return Itr(this); }
+
+private:
+    const Seed m_seed;
+    const functional_impl::helpers::Applicator<Fun> m_step;
+};
+
+template<typename Seed, typename Fun>
+functional::Unfold<Seed, Fun> functional::unfold(Seed seed, Fun step)
+{
+    return { std::move(seed), std::move(step) };
+}
+
+template<typename T, typename Fun>
+class functional::Iterate : public _Infinite
+{
+public:
+    typedef T value_type;
+
+    Iterate(T start, Fun fun)
+        : m_start(std::move(start))
+        , m_fun{ std::move(fun) }
+    {
+    }
+
+    class Itr
+    {
+    public:
+        bool operator!= (const Itr& other) const
+        {
+            return static_cast<bool>(m_current) != static_cast<bool>(other.m_current);
+        }
+
+        const T& operator* () const
+        {
+            return *m_current;
+        }
+
+        const Itr& operator++ ()
+        {
+            m_current = m_owner->m_fun(*m_current);
+            return *this;
+        }
+
+    private:
+        friend class Iterate<T, Fun>;
+
+        Itr(const Iterate* owner)
+            : m_owner(owner)
+        {
+        }
+
+        Itr(const Iterate* owner, const T& start)
+            : m_owner(owner)
+            , m_current(start)
+        {
+        }
+
+        const Iterate* m_owner;
+        functional_impl::helpers::Maybe<T> m_current;
+    };
+
+    Itr begin() const { return Itr(this, m_start); }
+    Itr end() const { return Itr(this); }
+
+private:
+    const T m_start;
+    const functional_impl::helpers::Applicator<Fun> m_fun;
+};
+
+template<typename T, typename Fun>
+functional::Iterate<T, Fun> functional::iterate(Fun fun, T start)
+{
+    return { std::move(start), std::move(fun) };
+}
+
+template<typename T>
+class functional::Repeat : public _Infinite
+{
+public:
+    typedef T value_type;
+
+    Repeat(T value)
+        : m_value(std::move(value))
+    {
+    }
+
+    class Itr
+    {
+    public:
+        bool operator!= (const Itr& other) const
+        {
+            return m_value != other.m_value;
+        }
+
+        const T& operator* () const
+        {
+            return *m_value;
+        }
+
+        const Itr& operator++ ()
+        {
+            return *this;
+        }
+
+    private:
+        friend class Repeat<T>;
+
+        Itr(const T* value)
+            : m_value(value)
+        {
+        }
+
+        const T* m_value;
+    };
+
+    Itr begin() const { return Itr(&m_value); }
+    Itr end() const { return Itr(nullptr); }
+
+private:
+    const T m_value;
+};
+
+template<typename T>
+functional::Repeat<T> functional::repeat(T value)
+{
+    return { std::move(value) };
+}
+
+// sequences are stored by value, containers by reference (and have to outlive the cycle)
+template<typename Container>
+class functional::Cycle : public _Infinite
+{
+    typedef decltype(std::declval<const Container&>().begin()) ContainerItr;
+
+public:
+    typedef typename std::decay<decltype(*std::declval<ContainerItr>())>::type value_type;
+
+    Cycle(const Container& container)
+        : m_container(container)
+    {
+    }
+
+    class Itr
+    {
+    public:
+        bool operator!= (const Itr& other) const
+        {
+            return m_done != other.m_done;
+        }
+
+        auto operator* () const -> decltype(*std::declval<ContainerItr>())
+        {
+            return *m_pos;
+        }
+
+        const Itr& operator++ ()
+        {
+            if (!(++m_pos != m_owner->m_container.end()))
+            {
+                m_pos = m_owner->m_container.begin();
+            }
+            return *this;
+        }
+
+    private:
+        friend class Cycle<Container>;
+
+        Itr(const Cycle* owner, bool done)
+            : m_owner(owner)
+            , m_pos(owner->m_container.begin())
+            , m_done(done || !(m_pos != owner->m_container.end()))
+        {
+        }
+
+        const Cycle* m_owner;
+        ContainerItr m_pos;
+        bool m_done;
+    };
+
+    Itr begin() const { return Itr(this, false); }
+    Itr end() const { return Itr(this, true); }
+
+private:
+    typename std::conditional<functional_impl::helpers::is_sequence<Container>::value, const Container, const Container&>::type m_container;
+};
+
+template<typename Container>
+functional::Cycle<Container> functional::cycle(const Container& container)
+{
+    return { container };
+}
+
+// sequences are stored by value, containers by reference (and have to outlive the take)
+template<typename Sequence>
+class functional::Take : public _Sequence
+{
+    typedef decltype(std::declval<const Sequence&>().begin()) SequenceItr;
+
+public:
+    typedef typename std::decay<decltype(*std::declval<SequenceItr>())>::type value_type;
+
+    Take(const Sequence& sequence, std::size_t n)
+        : m_sequence(sequence)
+        , m_n(n)
+    {
+    }
+
+    class Itr
+    {
+    public:
+        bool operator!= (const Itr& other) const
+        {
+            return m_left != other.m_left && m_pos != other.m_pos;
+        }
+
+        auto operator* () const -> decltype(*std::declval<SequenceItr>())
+        {
+            return *m_pos;
+        }
+
+        const Itr& operator++ ()
+        {
+            // never step the underlying sequence past the last taken element
+            if (--m_left != 0)
+            {
+                ++m_pos;
+            }
+            return *this;
+        }
+
+    private:
+        friend class Take<Sequence>;
+
+        Itr(SequenceItr pos, std::size_t left)
+            : m_pos(pos)
+            , m_left(left)
+        {
+        }
+
+        SequenceItr m_pos;
+        std::size_t m_left;
+    };
+
+    Itr begin() const { return Itr(m_sequence.begin(), m_n); }
+    Itr end() const { return Itr(m_sequence.end(), 0); }
+
+    template<typename S = Sequence>
+    auto size() const -> decltype(functional_impl::helpers::boundedSize(std::declval<const S&>(), 0, 0))
+    {
+        return functional_impl::helpers::boundedSize(m_sequence, m_n, 0);
+    }
+
+private:
+    typename std::conditional<functional_impl::helpers::is_sequence<Sequence>::value, const Sequence, const Sequence&>::type m_sequence;
+    const std::size_t m_n;
+};
+
+template<typename Sequence>
+functional::Take<Sequence> functional::take(std::size_t n, const Sequence& sequence)
+{
+    return { sequence, n };
+}
+
+template<typename Sequence, typename Fun>
+class functional::TakeWhile : public _Sequence
+{
+    typedef decltype(std::declval<const Sequence&>().begin()) SequenceItr;
+
+public:
+    typedef typename std::decay<decltype(*std::declval<SequenceItr>())>::type value_type;
+
+    TakeWhile(const Sequence& sequence, Fun predicate)
+        : m_sequence(sequence)
+        , m_predicate{ std::move(predicate) }
+    {
+    }
+
+    class Itr
+    {
+    public:
+        bool operator!= (const Itr& other) const
+        {
+            return m_done != other.m_done;
+        }
+
+        auto operator* () const -> decltype(*std::declval<SequenceItr>())
+        {
+            return *m_pos;
+        }
+
+        const Itr& operator++ ()
+        {
+            ++m_pos;
+            check();
+            return *this;
+        }
+
+    private:
+        friend class TakeWhile<Sequence, Fun>;
+
+        Itr(const TakeWhile* owner, SequenceItr pos, bool done)
+            : m_owner(owner)
+            , m_pos(pos)
+            , m_done(done)
+        {
+            if (!m_done)
+            {
+                check();
+            }
+        }
+
+        void check()
+        {
+            m_done = !(m_pos != m_owner->m_sequence.end()) || !m_owner->m_predicate(*m_pos);
+        }
+
+        const TakeWhile* m_owner;
+        SequenceItr m_pos;
+        bool m_done;
+    };
+
+    Itr begin() const { return Itr(this, m_sequence.begin(), false); }
+    Itr end() const { return Itr(this, m_sequence.end(), true); }
+
+private:
+    typename std::conditional<functional_impl::helpers::is_sequence<Sequence>::value, const Sequence, const Sequence&>::type m_sequence;
+    const functional_impl::helpers::Applicator<Fun> m_predicate;
+};
+
+template<typename Fun, typename Sequence>
+functional::TakeWhile<Sequence, Fun> functional::takeWhile(Fun predicate, const Sequence& sequence)
+{
+    return { sequence, std::move(predicate) };
+}
+
+// the callable is type erased once at construction, pulling values does not allocate;
+// being single pass, every begin() continues where the previous iteration stopped
+template<typename T>
+class functional::generator : public _Sequence
+{
+public:
+    typedef T value_type;
+
+    template<typename Fun>
+    explicit generator(Fun next)
+        : m_next(std::move(next))
+    {
+    }
+
+    class Itr
+    {
+    public:
+        bool operator!= (const Itr& other) const
+        {
+            return m_done != other.m_done;
+        }
+
+        const T& operator* () const
+        {
+            return m_value;
+        }
+
+        const Itr& operator++ ()
+        {
+            m_done = !m_owner->m_next(m_value);
+            return *this;
+        }
+
+    private:
+        friend class generator<T>;
+
+        Itr(const generator* owner, bool done)
+            : m_owner(owner)
+            , m_value()
+            , m_done(done)
+        {
+            if (!m_done)
+            {
+                ++*this;
+            }
+        }
+
+        const generator* m_owner;
+        T m_value;
+        bool m_done;
+    };
+
+    Itr begin() const { return Itr(this, false); }
+    Itr end() const { return Itr(this, true); }
+
+private:
+    mutable std::function<bool(T&)> m_next;
+};
+
 #endif // _FUNCTIONAL_HPP_
\ No newline at end of file
@@ -37,17 +37,45 @@ THE SOFTWARE.
     #define PACKED
 #endif
 
+#include <algorithm>
+#include <array>
 #include <cstddef>
+#include <deque>
+#include <initializer_list>
+#include <new>
+#include <stdexcept>
 #include <tuple>
+#include <type_traits>
+#include <vector>
 #include <utility>
 #include <assert.h>
 
 #include "applicator.hpp"
+#include "instrumentation.hpp"
+#include "small_vector.hpp"
+#include "trace.hpp"
 
 namespace functional
 {
     // a struct indicating that the type should be derived instead of manually specified
     struct _Derived {};
+
+    // like _Derived, but collecting into a small_vector with N inline elements, for results known to be short
+    template<std::size_t N>
+    struct _Small {};
+
+    // base of lazily generated sequences (range, unfold, take, ...), which map into a std::vector
+    struct _Sequence {};
+
+    // base of sequences that never end on their own and have to be cut with take/takeWhile
+    struct _Infinite : _Sequence {};
+
+    // view of consecutive elements handed to the batched combinators, defined in functional.hpp
+    template<typename Itr>
+    class Chunk;
+
+    // execution policy of the parallel overloads, defined in parallel.hpp
+    class parallel_policy;
 }
 
 namespace functional_impl
@@ -63,11 +91,72 @@ namespace functional_impl
         template<std::size_t>
         struct index {} PACKED;
 
+        // below sequence generation code, in lieu of C++14 std::integer_sequence, is blatantly copied from 
+        // http://stackoverflow.com/questions/17424477/implementation-c14-make-integer-sequence
+
+        template<class T> using Invoke = typename T::type;
+
+        template<unsigned...> struct seq{ using type = seq; };
+
+        template<class S1, class S2> struct concat;
+
+        template<unsigned... I1, unsigned... I2>
+        struct concat<seq<I1...>, seq<I2...>>
+            : seq<I1..., (sizeof...(I1)+I2)...>{};
+
+        template<class S1, class S2>
+        using Concat = Invoke<concat<S1, S2>>;
+
+        template<unsigned N> struct gen_seq;
+        template<unsigned N> using GenSeq = Invoke<gen_seq<N>>;
+
+        template<unsigned N>
+        struct gen_seq : Concat<GenSeq<N / 2>, GenSeq<N - N / 2>>{};
+
+        template<> struct gen_seq<0> : seq<>{};
+        template<> struct gen_seq<1> : seq<0>{};
+
+        template<typename T>
+        struct is_sequence : std::is_base_of<_Sequence, T> {};
+
+        template<typename T>
+        struct is_infinite : std::is_base_of<_Infinite, T> {};
+
+        // iteratables that map into a std::vector of results instead of their own container kind,
+        // specialized by views like soa whose template cannot be re-instantiated with the result type
+        template<typename T>
+        struct maps_to_vector : is_sequence<T> {};
+
+        // containers with an overload of map of their own (like persistent_map, which maps its values and keeps
+        // the keys), for which the element wise result types must not be derived
+        template<typename T>
+        struct maps_itself : std::false_type {};
+
+        // the result container: the explicitly given one, the derived default or a small_vector for _Small<N>
+        template<typename ResultContainerExplicit, typename Default, typename ResultType>
+        struct derive_container
+        {
+            typedef ResultContainerExplicit type;
+        };
+
+        template<typename Default, typename ResultType>
+        struct derive_container<_Derived, Default, ResultType>
+        {
+            typedef Default type;
+        };
+
+        template<std::size_t N, typename Default, typename ResultType>
+        struct derive_container<_Small<N>, Default, ResultType>
+        {
+            typedef small_vector<ResultType, N> type;
+        };
+
         // helper struct to derive input type, output type and output container given input container, explcit output container (or _Derived) and function type
         template<
             typename ResultContainerTypeExplicit,
             typename InputContainerType,
-            typename FunType>
+            typename FunType,
+            typename Enable = void>
         struct result_t;
 
         // specialization for generic containers
@@ -80,14 +169,12 @@ namespace functional_impl
         struct result_t<
             ResultContainerExplicit,
             ContainerType<ValueType, MoreTypes...>,
-            Fun>
+            Fun,
+            typename std::enable_if<!maps_to_vector<ContainerType<ValueType, MoreTypes...>>::value && !maps_itself<ContainerType<ValueType, MoreTypes...>>::value>::type>
         {
             typedef ValueType value_type;
             typedef decltype(std::declval<helpers::Applicator<Fun>>()(std::declval<ValueType>())) result_type;
-            typedef typename std::conditional<
-                std::is_same<ResultContainerExplicit, _Derived>::value,
-                ContainerType<result_type>,
-                ResultContainerExplicit>::type container_type;
+            typedef typename derive_container<ResultContainerExplicit, ContainerType<result_type>, result_type>::type container_type;
             static_assert(std::is_convertible<result_type, typename container_type::value_type>::value, "ResultContainer does not have proper value type.");
         };
 
@@ -104,45 +191,159 @@ namespace functional_impl
         {
             typedef ValueType value_type;
             typedef decltype(std::declval<helpers::Applicator<Fun>>()(std::declval<ValueType>())) result_type;
-            typedef typename std::conditional<
-                std::is_same<ResultContainerExplicit, _Derived>::value,
-                std::array<result_type, size>,
-                ResultContainerExplicit>::type container_type;
+            typedef typename derive_container<ResultContainerExplicit, std::array<result_type, size>, result_type>::type container_type;
+            static_assert(std::is_convertible<result_type, typename container_type::value_type>::value, "ResultContainer does not have proper value type.");
+        };
+
+        // specialization for small vectors, which map into small vectors of the same inline size
+        template<
+            typename ResultContainerExplicit,
+            typename Fun,
+            typename ValueType,
+            size_t size>
+        struct result_t<
+            ResultContainerExplicit,
+            small_vector<ValueType, size>,
+            Fun>
+        {
+            typedef ValueType value_type;
+            typedef decltype(std::declval<helpers::Applicator<Fun>>()(std::declval<ValueType>())) result_type;
+            typedef typename derive_container<ResultContainerExplicit, small_vector<result_type, size>, result_type>::type container_type;
             static_assert(std::is_convertible<result_type, typename container_type::value_type>::value, "ResultContainer does not have proper value type.");
         };
 
+        // specialization for lazy sequences and views, which are materialized into a vector
+        template<
+            typename ResultContainerExplicit,
+            typename SequenceType,
+            typename Fun>
+        struct result_t<
+            ResultContainerExplicit,
+            SequenceType,
+            Fun,
+            typename std::enable_if<maps_to_vector<SequenceType>::value>::type>
+        {
+            typedef typename std::decay<decltype(*std::declval<const SequenceType&>().begin())>::type value_type;
+            typedef decltype(std::declval<helpers::Applicator<Fun>>()(std::declval<value_type>())) result_type;
+            typedef typename derive_container<ResultContainerExplicit, std::vector<result_type>, result_type>::type container_type;
+            static_assert(std::is_convertible<result_type, typename container_type::value_type>::value, "ResultContainer does not have proper value type.");
+        };
+
+        // minimal optional value, used by sequence iterators whose state cannot be default constructed
+        template<typename T>
+        class Maybe
+        {
+        public:
+            Maybe() : m_just(false) {}
+            Maybe(const T& t) : m_just(false) { emplace(t); }
+            Maybe(const Maybe& other) : m_just(false) { if (other.m_just) emplace(*other); }
+            Maybe(Maybe&& other) : m_just(false) { if (other.m_just) emplace(std::move(*other)); }
+            ~Maybe() { reset(); }
+
+            Maybe& operator= (Maybe other)
+            {
+                reset();
+                if (other.m_just)
+                {
+                    emplace(std::move(*other));
+                }
+                return *this;
+            }
+
+            template<typename... Args>
+            void emplace(Args&&... args)
+            {
+                reset();
+                new (&m_storage) T(std::forward<Args>(args)...);
+                m_just = true;
+            }
+
+            void reset()
+            {
+                if (m_just)
+                {
+                    (**this).~T();
+                    m_just = false;
+                }
+            }
+
+            explicit operator bool() const { return m_just; }
+            T& operator* () { return *reinterpret_cast<T*>(&m_storage); }
+            const T& operator* () const { return *reinterpret_cast<const T*>(&m_storage); }
+
+        private:
+            typename std::aligned_storage<sizeof(T), std::alignment_of<T>::value>::type m_storage;
+            bool m_just;
+        };
+
+        // number of elements a take can yield: bounded by the input size, or exactly n for infinite inputs
+        template<typename Sequence>
+        forceinline auto boundedSize(const Sequence& seq, std::size_t n, int) -> decltype(static_cast<std::size_t>(seq.size()))
+        {
+            return static_cast<std::size_t>(seq.size()) < n ? static_cast<std::size_t>(seq.size()) : n;
+        }
+
+        template<typename Sequence>
+        forceinline auto boundedSize(const Sequence&, std::size_t n, long) -> typename std::enable_if<is_infinite<Sequence>::value, std::size_t>::type
+        {
+            return n;
+        }
+
         // helper struct to do accumulation for different containers
         template<typename ContainerT>
         struct Accumulator
         {
             ContainerT container;
-            
-            // specialization for types that have reserve method (using SFINAE)
+
+            template<typename CIn>
+            forceinline void reserve(const CIn& inc)
+            {
+                reserve(container, inc, 0);
+            }
+
+            // specialization for types that have reserve method and inputs that know their size (using SFINAE)
             template<typename COut, typename CIn>
-            forceinline auto reserve(COut& outc, const CIn& inc) -> decltype(outc.reserve(inc.size()))
+            forceinline auto reserve(COut& outc, const CIn& inc, int) -> decltype(outc.reserve(inc.size()))
             {
                 outc.reserve(inc.size());
             }
 
             // specialization for types that don't have reserve method
-            template <typename... T>
-            forceinline void reserve(T...)
+            template<typename COut, typename CIn>
+            forceinline void reserve(COut&, const CIn&, long)
+            {
+            }
+
+            // reserve for a number of elements computed up front
+            forceinline void reserveCount(std::size_t n)
+            {
+                reserveCount(container, n, 0);
+            }
+
+            template<typename COut>
+            forceinline auto reserveCount(COut& outc, std::size_t n, int) -> decltype(outc.reserve(n))
+            {
+                outc.reserve(n);
+            }
+
+            template<typename COut>
+            forceinline void reserveCount(COut&, std::size_t, long)
             {
             }
 
             template<typename T>
-            forceinline void accumulate(const T& t)
+            forceinline void accumulate(T&& t)
             {
-                container.push_back(t);
+                container.push_back(std::forward<T>(t));
             }
         };
 
-        // helper struct to do accumulation for different containers
+        // accumulation into arrays from inputs of runtime size or past UNROLL_MAX, smaller arrays from arrays are built in place (see builds_array)
         template<typename ValueT, size_t size>
         struct Accumulator<std::array<ValueT, size>>
         {
             std::array<ValueT, size> container;
-            int pos = { 0 };
+            std::size_t pos = { 0 };
 
             template<typename CIn>
             forceinline void reserve(const CIn& input)
@@ -150,19 +351,64 @@ namespace functional_impl
                 assert(input.size() <= size);
             }
 
-            template<typename InT, size_t size_in>
-            forceinline void reserve(const std::array<InT, size_in>&)
+            forceinline void reserveCount(std::size_t n)
             {
-                static_assert(size_in <= size, "Result array cannot all elements of input array.");
+                assert(n <= size);
             }
 
             template<typename T>
-            forceinline void accumulate(const T& t)
+            forceinline void accumulate(T&& t)
             {
-                container[pos++] = t;
+                if (pos == size)
+                {
+                    throw std::out_of_range("functional: more results than the std::array result holds");
+                }
+                container[pos++] = std::forward<T>(t);
             }
         };
 
+        template<typename T>
+        struct is_std_array : std::false_type {};
+
+        template<typename ValueT, size_t size>
+        struct is_std_array<std::array<ValueT, size>> : std::true_type {};
+
+        template<bool...>
+        struct bools {};
+
+        template<bool... Bs>
+        struct all_of : std::is_same<bools<true, Bs...>, bools<Bs..., true>> {};
+
+        constexpr std::size_t minSize(std::size_t size)
+        {
+            return size;
+        }
+
+        template<typename... Sizes>
+        constexpr std::size_t minSize(std::size_t lhs, std::size_t rhs, Sizes... more)
+        {
+            return minSize(lhs < rhs ? lhs : rhs, more...);
+        }
+
+        template<typename Container>
+        struct is_unrolled_array : std::false_type {};
+
+        template<typename ValueT, size_t size>
+        struct is_unrolled_array<std::array<ValueT, size>> : std::integral_constant<bool, (size <= UNROLL_MAX)> {};
+
+        // results collected into a std::array from inputs that are all std::arrays are known to fit at compile
+        // time, so up to UNROLL_MAX elements the array is constructed in place instead of default constructed
+        // and assigned element-wise; larger arrays take the loop, like apply, to keep compile times bounded
+        template<typename ResultContainer, typename... Inputs>
+        struct builds_array : std::integral_constant<bool, is_unrolled_array<ResultContainer>::value && all_of<is_std_array<Inputs>::value...>::value> {};
+
+        // aggregate initialization evaluates gen(0), gen(1), ... in order, elements past the last index are value initialized
+        template<typename Array, typename Gen, unsigned... Is>
+        forceinline Array buildArray(const Gen& gen, seq<Is...>)
+        {
+            return Array{ { typename Array::value_type(gen(Is))... } };
+        }
+
 
         template<std::size_t N, typename Fun, typename Iteratable, std::size_t I = N>
         forceinline auto apply(Fun fun, Iteratable& inout, index<I> = index<N>())
@@ -194,7 +440,7 @@ namespace functional_impl
     template<typename Fun, typename Iteratable>
     forceinline void apply(Fun fun, Iteratable& inout)
     {
-        for (auto& value : inout)
+        for (auto&& value : inout)
         {
             helpers::Applicator<Fun>{fun}(value);
         }
@@ -222,59 +468,163 @@ namespace functional_impl
         typename ValueType = typename ResultHelperT::value_type,
         typename ResultType = typename ResultHelperT::result_type,
         typename ResultContainer = typename ResultHelperT::container_type>
-    forceinline ResultContainer map(Fun fun, const InputContainerType& input)
+    forceinline auto map(Fun fun, const InputContainerType& input)
+        -> typename std::enable_if<!helpers::builds_array<ResultContainer, InputContainerType>::value, ResultContainer>::type
     {
+        FUNCTIONAL_PROBE("map", Fun);
         helpers::Accumulator<ResultContainer> accumulator;
         accumulator.reserve(input);
         apply(
             [&](const ValueType& value)
             { 
+                FUNCTIONAL_PROBE_ELEMENT();
                 accumulator.accumulate(helpers::Applicator<Fun>{fun}(value));
             },
             input);
-        return accumulator.container;
+        FUNCTIONAL_PROBE_ALLOCATED(accumulator.container);
+        return std::move(accumulator.container);
+    }
+
+    // specialization for arrays mapped into arrays, one construction per element and no default constructor needed
+    template<
+        typename ResultContainerTypeExplicit,
+        typename InputContainerType,
+        typename Fun,
+        typename ResultHelperT = typename helpers::result_t<ResultContainerTypeExplicit, InputContainerType, Fun>,
+        typename ValueType = typename ResultHelperT::value_type,
+        typename ResultType = typename ResultHelperT::result_type,
+        typename ResultContainer = typename ResultHelperT::container_type>
+    forceinline auto map(Fun fun, const InputContainerType& input)
+        -> typename std::enable_if<helpers::builds_array<ResultContainer, InputContainerType>::value, ResultContainer>::type
+    {
+        static_assert(std::tuple_size<InputContainerType>::value <= std::tuple_size<ResultContainer>::value, "Result array cannot hold all elements of input array.");
+
+        FUNCTIONAL_PROBE("map", Fun);
+        FUNCTIONAL_PROBE_ELEMENTS(std::tuple_size<InputContainerType>::value);
+        const helpers::Applicator<Fun> f{ fun };
+        return helpers::buildArray<ResultContainer>(
+            [&](std::size_t pos) { return f(input[pos]); },
+            helpers::GenSeq<std::tuple_size<InputContainerType>::value>());
     }
 
-    template<typename ResultType, template<typename...> class Iteratable, typename InValue, typename Fun, typename... ExtraArgs>
-    forceinline ResultType foldr(Fun fun, ResultType neutralValue, const Iteratable<InValue, ExtraArgs...>& iteratable)
+    namespace helpers
     {
-        ResultType res = neutralValue;
-        for (InValue value : iteratable)
+        // the folds move their accumulator into steps that accept an rvalue, so a large accumulator (a sketch,
+        // a container) isn't copied per element; steps taking it by non-const reference get the lvalue
+        template<typename F, typename Acc, typename Value>
+        forceinline auto foldStep(const F& f, Acc& acc, Value&& value, int) -> decltype(f(std::move(acc), std::forward<Value>(value)))
         {
-            res = helpers::Applicator<Fun>{fun}(value, res);
+            return f(std::move(acc), std::forward<Value>(value));
+        }
+
+        template<typename F, typename Acc, typename Value>
+        forceinline auto foldStep(const F& f, Acc& acc, Value&& value, long) -> decltype(f(acc, std::forward<Value>(value)))
+        {
+            return f(acc, std::forward<Value>(value));
+        }
+
+        template<typename F, typename Value, typename Acc>
+        forceinline auto foldStepRight(const F& f, Value&& value, Acc& acc, int) -> decltype(f(std::forward<Value>(value), std::move(acc)))
+        {
+            return f(std::forward<Value>(value), std::move(acc));
+        }
+
+        template<typename F, typename Value, typename Acc>
+        forceinline auto foldStepRight(const F& f, Value&& value, Acc& acc, long) -> decltype(f(std::forward<Value>(value), acc))
+        {
+            return f(std::forward<Value>(value), acc);
         }
-        return res;
     }
 
-    template<typename ResultType, template<typename...> class Iteratable, typename Fun, typename InValue, typename... ExtraArgs>
-    forceinline ResultType foldl(Fun fun, ResultType neutralValue, const Iteratable<InValue, ExtraArgs...>& iteratable)
+    template<typename ResultType, typename Iteratable, typename Fun>
+    forceinline ResultType foldr(Fun fun, ResultType neutralValue, const Iteratable& iteratable)
     {
-        ResultType res = neutralValue;
-        for (InValue value : iteratable)
+        FUNCTIONAL_PROBE("foldr", Fun);
+        const helpers::Applicator<Fun> f{ fun };
+        ResultType res = std::move(neutralValue);
+        for (auto&& value : iteratable)
         {
-            res = helpers::Applicator<Fun>{fun}(res, value);
+            FUNCTIONAL_PROBE_ELEMENT();
+            res = helpers::foldStepRight(f, value, res, 0);
         }
         return res;
     }
 
-    template<typename Fun, template<typename...> class Container, typename LhsValue, typename RhsValue, typename ResultType = decltype(std::declval<Fun>()(std::declval<LhsValue>(), std::declval<RhsValue>())), typename... ExtraArgs1, typename... ExtraArgs2, typename OutContainer = Container<ResultType>>
-    forceinline OutContainer zipWith(Fun fun, const Container<LhsValue, ExtraArgs1...>& lhs, const Container<RhsValue, ExtraArgs2...>& rhs)
+    template<typename ResultType, typename Iteratable, typename Fun>
+    forceinline ResultType foldl(Fun fun, ResultType neutralValue, const Iteratable& iteratable)
     {
-        OutContainer out;
-        auto lhsIt = lhs.begin();
-        auto rhsIt = rhs.begin();
-        while (lhsIt != lhs.end() && rhsIt != rhs.end())
+        FUNCTIONAL_PROBE("foldl", Fun);
+        const helpers::Applicator<Fun> f{ fun };
+        ResultType res = std::move(neutralValue);
+        for (auto&& value : iteratable)
         {
-            out.push_back(helpers::Applicator<Fun>{fun}(*lhsIt, *rhsIt));
-            ++lhsIt; ++rhsIt;
+            FUNCTIONAL_PROBE_ELEMENT();
+            res = helpers::foldStep(f, res, value, 0);
         }
-        return out;
+        return res;
+    }
+
+    namespace helpers
+    {
+        // wraps a function returning a future (anything with get()) into one returning the awaited value,
+        // so result_t derives the container of values instead of a container of futures
+        template<typename Fun>
+        struct Awaited
+        {
+            Applicator<Fun> f;
+
+            template<typename... Args>
+            forceinline auto operator () (Args&&... args) const -> typename std::decay<decltype(f(std::forward<Args>(args)...).get())>::type
+            {
+                return f(std::forward<Args>(args)...).get();
+            }
+        };
     }
 
-    template<template<typename...> class Container, typename LhsValue, typename RhsValue, typename... ExtraArgs1, typename... ExtraArgs2, typename OutContainer = Container<std::pair<LhsValue, RhsValue>>>
-    forceinline OutContainer zip(const Container<LhsValue, ExtraArgs1...>& lhs, const Container<RhsValue, ExtraArgs2...>& rhs)
+    template<
+        typename ResultContainerTypeExplicit,
+        typename InputContainerType,
+        typename Fun,
+        typename ResultHelperT = typename helpers::result_t<ResultContainerTypeExplicit, InputContainerType, helpers::Awaited<Fun>>,
+        typename ValueType = typename ResultHelperT::value_type,
+        typename ResultContainer = typename ResultHelperT::container_type>
+    forceinline ResultContainer mapAsync(Fun fun, const InputContainerType& input, std::size_t maxConcurrency)
     {
-        return zipWith([](LhsValue l, RhsValue r) { return std::make_pair(l, r); }, lhs, rhs);
+        typedef typename std::decay<decltype(helpers::Applicator<Fun>{fun}(std::declval<const ValueType&>()))>::type Future;
+
+        if (maxConcurrency == 0)
+        {
+            maxConcurrency = 1;
+        }
+
+        FUNCTIONAL_PROBE("mapAsync", Fun);
+        FUNCTIONAL_TRACE_SCOPE("mapAsync");
+
+        // futures are collected strictly in input order, a new call is only started once the oldest one is drained
+        std::deque<Future> inFlight;
+        helpers::Accumulator<ResultContainer> accumulator;
+        accumulator.reserve(input);
+        apply(
+            [&](const ValueType& value)
+            {
+                FUNCTIONAL_PROBE_ELEMENT();
+                if (inFlight.size() == maxConcurrency)
+                {
+                    FUNCTIONAL_TRACE_SCOPE("await");
+                    accumulator.accumulate(inFlight.front().get());
+                    inFlight.pop_front();
+                }
+                inFlight.push_back(helpers::Applicator<Fun>{fun}(value));
+            },
+            input);
+        while (!inFlight.empty())
+        {
+            FUNCTIONAL_TRACE_SCOPE("await");
+            accumulator.accumulate(inFlight.front().get());
+            inFlight.pop_front();
+        }
+        FUNCTIONAL_PROBE_ALLOCATED(accumulator.container);
+        return std::move(accumulator.container);
     }
 
     namespace helpers
@@ -291,34 +641,7 @@ namespace functional_impl
             }            
         };
 
-
-        // below sequence generation code, in lieu of C++14 std::integer_sequence, is blatantly copied from 
-        // http://stackoverflow.com/questions/17424477/implementation-c14-make-integer-sequence
-
-        template<class T> using Invoke = typename T::type;
-
-        template<unsigned...> struct seq{ using type = seq; };
-
-        template<class S1, class S2> struct concat;
-
-        template<unsigned... I1, unsigned... I2>
-        struct concat<seq<I1...>, seq<I2...>>
-            : seq<I1..., (sizeof...(I1)+I2)...>{};
-
-        template<class S1, class S2>
-        using Concat = Invoke<concat<S1, S2>>;
-
-        template<unsigned N> struct gen_seq;
-        template<unsigned N> using GenSeq = Invoke<gen_seq<N>>;
-
-        template<unsigned N>
-        struct gen_seq : Concat<GenSeq<N / 2>, GenSeq<N - N / 2>>{};
-
-        template<> struct gen_seq<0> : seq<>{};
-        template<> struct gen_seq<1> : seq<0>{};
-
-        
-        template<typename Fun, typename... Args, std::size_t... Is>
+        template<typename Fun, typename... Args, unsigned... Is>
         forceinline auto uncurryTuple(Fun& f, const std::tuple<Args...>& args, seq<Is...>) -> decltype(f(std::get<Is>(args)...))
         {
             return f(std::get<Is>(args)...);
@@ -348,6 +671,519 @@ namespace functional_impl
     {
         return helpers::UnCurry<Fun> { { std::move(f) } };
     }
+
+    namespace helpers
+    {
+        template<typename Itr>
+        using deref_t = decltype(*std::declval<Itr>());
+
+        // sequences are stored by value, containers by reference
+        template<typename Container>
+        using stored_t = typename std::conditional<is_sequence<Container>::value, const Container, const Container&>::type;
+
+        template<typename... Itrs, unsigned... Is>
+        forceinline bool noneEqual(const std::tuple<Itrs...>& lhs, const std::tuple<Itrs...>& rhs, seq<Is...>)
+        {
+            bool differ = true;
+            (void)std::initializer_list<int>{ (differ = differ && (std::get<Is>(lhs) != std::get<Is>(rhs)), 0)... };
+            return differ;
+        }
+
+        template<typename... Itrs, unsigned... Is>
+        forceinline void advance(std::tuple<Itrs...>& itrs, seq<Is...>)
+        {
+            (void)std::initializer_list<int>{ (++std::get<Is>(itrs), 0)... };
+        }
+
+        template<typename... Inputs, unsigned... Is>
+        forceinline auto zipSize(const std::tuple<Inputs...>& inputs, seq<Is...>) -> decltype(std::min({ static_cast<std::size_t>(std::get<Is>(inputs).size())... }))
+        {
+            return std::min({ static_cast<std::size_t>(std::get<Is>(inputs).size())... });
+        }
+
+        template<typename... Inputs, unsigned... Is>
+        forceinline auto zipAt(const std::tuple<Inputs...>& inputs, std::size_t pos, seq<Is...>) -> std::tuple<decltype(std::get<Is>(inputs)[pos])...>
+        {
+            return std::tuple<decltype(std::get<Is>(inputs)[pos])...>(std::get<Is>(inputs)[pos]...);
+        }
+
+        // lazy view walking any number of iteratables in lockstep until the shortest ends,
+        // yielding tuples of whatever the inputs dereference to (references for containers, no copies)
+        template<typename... Containers>
+        class Zip : public _Sequence
+        {
+            typedef std::tuple<stored_t<Containers>...> Inputs;
+            typedef std::tuple<decltype(std::declval<const Containers&>().begin())...> Itrs;
+            typedef GenSeq<sizeof...(Containers)> Indices;
+
+        public:
+            typedef std::tuple<deref_t<decltype(std::declval<const Containers&>().begin())>...> reference;
+            typedef reference value_type;
+
+            Zip(const Containers&... containers)
+                : m_inputs(containers...)
+            {
+            }
+
+            class Itr
+            {
+            public:
+                bool operator!= (const Itr& other) const
+                {
+                    return noneEqual(m_pos, other.m_pos, Indices());
+                }
+
+                reference operator* () const
+                {
+                    return deref(Indices());
+                }
+
+                const Itr& operator++ ()
+                {
+                    advance(m_pos, Indices());
+                    return *this;
+                }
+
+            private:
+                friend class Zip<Containers...>;
+
+                Itr(Itrs pos)
+                    : m_pos(std::move(pos))
+                {
+                }
+
+                template<unsigned... Is>
+                forceinline reference deref(seq<Is...>) const
+                {
+                    return reference(*std::get<Is>(m_pos)...);
+                }
+
+                Itrs m_pos;
+            };
+
+            Itr begin() const { return Itr(begins(Indices())); }
+            Itr end() const { return Itr(ends(Indices())); }
+
+            // only available if all inputs know their size, e.g. to reserve the output
+            template<typename I = Inputs>
+            auto size() const -> decltype(zipSize(std::declval<const I&>(), Indices()))
+            {
+                return zipSize(m_inputs, Indices());
+            }
+
+            // only available if all inputs are random access, e.g. to split the work into chunks
+            template<typename I = Inputs>
+            auto operator[] (std::size_t pos) const -> decltype(zipAt(std::declval<const I&>(), pos, Indices()))
+            {
+                return zipAt(m_inputs, pos, Indices());
+            }
+
+        private:
+            template<unsigned... Is>
+            forceinline Itrs begins(seq<Is...>) const
+            {
+                return Itrs(std::get<Is>(m_inputs).begin()...);
+            }
+
+            template<unsigned... Is>
+            forceinline Itrs ends(seq<Is...>) const
+            {
+                return Itrs(std::get<Is>(m_inputs).end()...);
+            }
+
+            Inputs m_inputs;
+        };
+
+        // stands in for a function returning ResultType, to derive a result container via result_t
+        template<typename ResultType>
+        struct Returning
+        {
+            template<typename... Args>
+            ResultType operator () (Args&&...) const;
+        };
+
+        // container of the kind of the given input (vector for sequences) holding ResultType, unless given explicitly
+        template<typename ResultContainerExplicit, typename FirstContainer, typename ResultType>
+        struct collect_result_t
+        {
+            typedef typename result_t<ResultContainerExplicit, FirstContainer, Returning<ResultType>>::container_type type;
+        };
+    }
+
+    template<typename... Containers>
+    forceinline helpers::Zip<Containers...> zip(const Containers&... containers)
+    {
+        return helpers::Zip<Containers...>(containers...);
+    }
+
+    template<
+        typename ResultContainerTypeExplicit,
+        typename Fun,
+        typename FirstContainer,
+        typename... MoreContainers,
+        typename ResultType = decltype(std::declval<helpers::UnCurry<Fun>>()(std::declval<typename helpers::Zip<FirstContainer, MoreContainers...>::reference>())),
+        typename ResultContainer = typename helpers::collect_result_t<ResultContainerTypeExplicit, FirstContainer, ResultType>::type>
+    forceinline auto zipWith(Fun fun, const FirstContainer& first, const MoreContainers&... more)
+        -> typename std::enable_if<!helpers::builds_array<ResultContainer, FirstContainer, MoreContainers...>::value, ResultContainer>::type
+    {
+        return functional_impl::map<ResultContainer>(uncurry(fun), functional_impl::zip(first, more...));
+    }
+
+    // specialization for arrays zipped into an array, constructed in place up to the length of the shortest input
+    template<
+        typename ResultContainerTypeExplicit,
+        typename Fun,
+        typename FirstContainer,
+        typename... MoreContainers,
+        typename ResultType = decltype(std::declval<helpers::UnCurry<Fun>>()(std::declval<typename helpers::Zip<FirstContainer, MoreContainers...>::reference>())),
+        typename ResultContainer = typename helpers::collect_result_t<ResultContainerTypeExplicit, FirstContainer, ResultType>::type>
+    forceinline auto zipWith(Fun fun, const FirstContainer& first, const MoreContainers&... more)
+        -> typename std::enable_if<helpers::builds_array<ResultContainer, FirstContainer, MoreContainers...>::value, ResultContainer>::type
+    {
+        static constexpr std::size_t size = helpers::minSize(std::tuple_size<FirstContainer>::value, std::tuple_size<MoreContainers>::value...);
+        static_assert(size <= std::tuple_size<ResultContainer>::value, "Result array cannot hold all elements of the zipped arrays.");
+
+        FUNCTIONAL_PROBE("zipWith", Fun);
+        FUNCTIONAL_PROBE_ELEMENTS(size);
+        const auto f = functional_impl::uncurry(fun);
+        const auto zipped = functional_impl::zip(first, more...);
+        return helpers::buildArray<ResultContainer>(
+            [&](std::size_t pos) { return f(zipped[pos]); },
+            helpers::GenSeq<size>());
+    }
+
+    namespace helpers
+    {
+        // containers whose elements are laid out contiguously, so their batches are plain pointer ranges
+        template<typename Container>
+        struct is_contiguous : std::false_type {};
+
+        template<typename ValueT, typename Allocator>
+        struct is_contiguous<std::vector<ValueT, Allocator>> : std::true_type {};
+
+        template<typename Allocator>
+        struct is_contiguous<std::vector<bool, Allocator>> : std::false_type {};
+
+        template<typename ValueT, size_t size>
+        struct is_contiguous<std::array<ValueT, size>> : std::true_type {};
+
+        template<typename ValueT, size_t size>
+        struct is_contiguous<small_vector<ValueT, size>> : std::true_type {};
+
+        // chunk type of a (possibly const) container: pointers for contiguous ones, its own iterators otherwise
+        template<typename Container, typename Enable = void>
+        struct chunk_t
+        {
+            typedef Chunk<decltype(std::declval<Container&>().begin())> type;
+        };
+
+        template<typename Container>
+        struct chunk_t<Container, typename std::enable_if<is_contiguous<typename std::remove_const<Container>::type>::value>::type>
+        {
+            typedef Chunk<typename std::remove_reference<decltype(*std::declval<Container&>().begin())>::type*> type;
+        };
+
+        template<typename Container, typename Fun>
+        forceinline void forEachChunk(Container& container, std::size_t batchSize, Fun& fun, std::true_type)
+        {
+            typedef typename chunk_t<Container>::type ChunkType;
+
+            const std::size_t size = container.size();
+            if (size == 0)
+            {
+                return;
+            }
+            auto first = &*container.begin();
+            for (std::size_t pos = 0; pos < size; pos += batchSize)
+            {
+                const std::size_t n = std::min(batchSize, size - pos);
+                fun(ChunkType(first + pos, first + pos + n, n));
+            }
+        }
+
+        // non-contiguous inputs are cut by walking their iterators once, which requires a multi pass input
+        template<typename Container, typename Fun>
+        forceinline void forEachChunk(Container& container, std::size_t batchSize, Fun& fun, std::false_type)
+        {
+            typedef typename chunk_t<Container>::type ChunkType;
+
+            auto pos = container.begin();
+            auto end = container.end();
+            while (pos != end)
+            {
+                auto first = pos;
+                std::size_t n = 0;
+                while (n < batchSize && pos != end)
+                {
+                    ++pos;
+                    ++n;
+                }
+                fun(ChunkType(first, pos, n));
+            }
+        }
+
+        // calls fun with consecutive chunks of at most batchSize elements covering the container in order
+        template<typename Container, typename Fun>
+        forceinline void forEachChunk(Container& container, std::size_t batchSize, Fun fun)
+        {
+            assert(batchSize > 0);
+            forEachChunk(container, batchSize > 0 ? batchSize : 1, fun, is_contiguous<typename std::remove_const<Container>::type>());
+        }
+
+        // concatMap and mapBatched collect into the container kind of their input, but never into an array, as the output size isn't known statically
+        template<typename ResultContainerExplicit, typename InputContainer, typename ResultType>
+        struct concat_result_t
+        {
+            typedef typename collect_result_t<ResultContainerExplicit, InputContainer, ResultType>::type type;
+        };
+
+        template<typename ResultContainerExplicit, typename ValueT, size_t size, typename ResultType>
+        struct concat_result_t<ResultContainerExplicit, std::array<ValueT, size>, ResultType>
+        {
+            typedef typename derive_container<ResultContainerExplicit, std::vector<ResultType>, ResultType>::type type;
+        };
+
+        // mapBatched calls fun once per chunk, every batch it returns is an iteratable of results
+        template<typename ResultContainerExplicit, typename InputContainer, typename Fun>
+        struct batched_result_t
+        {
+            typedef typename chunk_t<const InputContainer>::type chunk_type;
+            typedef typename std::decay<decltype(std::declval<Applicator<Fun>>()(std::declval<const chunk_type&>()))>::type batch_type;
+            typedef typename std::decay<decltype(*std::declval<const batch_type&>().begin())>::type result_type;
+            typedef typename concat_result_t<ResultContainerExplicit, InputContainer, result_type>::type container_type;
+        };
+    }
+
+    template<typename Fun, typename Iteratable>
+    forceinline void applyBatched(Fun fun, Iteratable& inout, std::size_t batchSize)
+    {
+        typedef typename helpers::chunk_t<Iteratable>::type ChunkType;
+
+        helpers::forEachChunk(inout, batchSize, [&](const ChunkType& chunk) { helpers::Applicator<Fun>{fun}(chunk); });
+    }
+
+    template<
+        typename ResultContainerTypeExplicit,
+        typename InputContainerType,
+        typename Fun,
+        typename ResultHelperT = helpers::batched_result_t<ResultContainerTypeExplicit, InputContainerType, Fun>,
+        typename ChunkType = typename ResultHelperT::chunk_type,
+        typename ResultContainer = typename ResultHelperT::container_type>
+    forceinline ResultContainer mapBatched(Fun fun, const InputContainerType& input, std::size_t batchSize)
+    {
+        FUNCTIONAL_PROBE("mapBatched", Fun);
+        FUNCTIONAL_PROBE_ELEMENTS(functional_impl::instrumentation::elementCount(input, 0));
+        helpers::Accumulator<ResultContainer> accumulator;
+        accumulator.reserve(input);
+        helpers::forEachChunk(
+            input,
+            batchSize,
+            [&](const ChunkType& chunk)
+            {
+                for (auto&& result : helpers::Applicator<Fun>{fun}(chunk))
+                {
+                    accumulator.accumulate(result);
+                }
+            });
+        FUNCTIONAL_PROBE_ALLOCATED(accumulator.container);
+        return std::move(accumulator.container);
+    }
+
+    namespace helpers
+    {
+        // number of elements of an iteratable, counted by walking it if it doesn't know its size
+        template<typename Iteratable>
+        forceinline auto iteratableSize(const Iteratable& iteratable, int) -> decltype(static_cast<std::size_t>(iteratable.size()))
+        {
+            return static_cast<std::size_t>(iteratable.size());
+        }
+
+        template<typename Iteratable>
+        forceinline std::size_t iteratableSize(const Iteratable& iteratable, long)
+        {
+            std::size_t size = 0;
+            for (auto pos = iteratable.begin(), end = iteratable.end(); pos != end; ++pos)
+            {
+                ++size;
+            }
+            return size;
+        }
+
+        // fun maps every input element to an iteratable (the inner type), whose elements are concatenated
+        template<typename ResultContainerExplicit, typename InputContainer, typename Fun>
+        struct concat_map_t
+        {
+            typedef typename std::decay<typename result_t<_Derived, InputContainer, Fun>::result_type>::type inner_type;
+            typedef typename std::decay<decltype(*std::declval<const inner_type&>().begin())>::type result_type;
+            typedef typename concat_result_t<ResultContainerExplicit, InputContainer, result_type>::type container_type;
+        };
+
+        // flattening view over an iteratable of iteratables, which has to yield references to its inner iteratables
+        template<typename Outer>
+        class Join : public _Sequence
+        {
+            typedef decltype(std::declval<const Outer&>().begin()) OuterItr;
+            typedef typename std::remove_reference<deref_t<OuterItr>>::type Inner;
+            typedef decltype(std::declval<Inner&>().begin()) InnerItr;
+
+            static_assert(std::is_lvalue_reference<deref_t<OuterItr>>::value, "join needs inner iteratables it can reference, not temporaries.");
+
+        public:
+            typedef deref_t<InnerItr> reference;
+            typedef typename std::decay<reference>::type value_type;
+
+            Join(const Outer& outer)
+                : m_outer(outer)
+            {
+            }
+
+            class Itr
+            {
+            public:
+                bool operator!= (const Itr& other) const
+                {
+                    return m_outer != other.m_outer || (m_inner && other.m_inner && *m_inner != *other.m_inner);
+                }
+
+                reference operator* () const
+                {
+                    return **m_inner;
+                }
+
+                const Itr& operator++ ()
+                {
+                    ++*m_inner;
+                    skipEmpty();
+                    return *this;
+                }
+
+            private:
+                friend class Join<Outer>;
+
+                Itr(OuterItr outer, OuterItr outerEnd)
+                    : m_outer(outer)
+                    , m_outerEnd(outerEnd)
+                {
+                    if (m_outer != m_outerEnd)
+                    {
+                        m_inner = (*m_outer).begin();
+                        skipEmpty();
+                    }
+                }
+
+                // moves on to the next non-empty inner iteratable once the current one is exhausted
+                void skipEmpty()
+                {
+                    while (!(*m_inner != (*m_outer).end()))
+                    {
+                        if (!(++m_outer != m_outerEnd))
+                        {
+                            m_inner.reset();
+                            return;
+                        }
+                        m_inner = (*m_outer).begin();
+                    }
+                }
+
+                OuterItr m_outer;
+                OuterItr m_outerEnd;
+                Maybe<InnerItr> m_inner;
+            };
+
+            Itr begin() const { return Itr(m_outer.begin(), m_outer.end()); }
+            Itr end() const { return Itr(m_outer.end(), m_outer.end()); }
+
+            // only available if the inner iteratables know their size, walks the outer one to sum them up
+            template<typename I = Inner>
+            auto size() const -> decltype(static_cast<std::size_t>(std::declval<const I&>().size()))
+            {
+                std::size_t size = 0;
+                for (auto&& inner : m_outer)
+                {
+                    size += static_cast<std::size_t>(inner.size());
+                }
+                return size;
+            }
+
+        private:
+            stored_t<Outer> m_outer;
+        };
+    }
+
+    template<typename Outer>
+    forceinline helpers::Join<Outer> join(const Outer& outer)
+    {
+        return helpers::Join<Outer>(outer);
+    }
+
+    // the inner results are kept from a first pass, so the output is allocated once at its final size
+    template<
+        typename ResultContainerTypeExplicit,
+        typename InputContainerType,
+        typename Fun,
+        typename ResultHelperT = helpers::concat_map_t<ResultContainerTypeExplicit, InputContainerType, Fun>,
+        typename InnerType = typename ResultHelperT::inner_type,
+        typename ResultContainer = typename ResultHelperT::container_type>
+    forceinline ResultContainer concatMap(Fun fun, const InputContainerType& input)
+    {
+        FUNCTIONAL_PROBE("concatMap", Fun);
+        const helpers::Applicator<Fun> f{ fun };
+        helpers::Accumulator<std::vector<InnerType>> inners;
+        inners.reserve(input);
+        std::size_t size = 0;
+        for (auto&& value : input)
+        {
+            FUNCTIONAL_PROBE_ELEMENT();
+            inners.accumulate(f(value));
+            size += helpers::iteratableSize(inners.container.back(), 0);
+        }
+
+        helpers::Accumulator<ResultContainer> accumulator;
+        accumulator.reserveCount(size);
+        for (auto& inner : inners.container)
+        {
+            for (auto&& result : inner)
+            {
+                accumulator.accumulate(std::move(result));
+            }
+        }
+        FUNCTIONAL_PROBE_ALLOCATED(accumulator.container);
+        return std::move(accumulator.container);
+    }
+
+    // single pass variant, the output is reserved from sizeHint(element) summed over the input
+    template<
+        typename ResultContainerTypeExplicit,
+        typename InputContainerType,
+        typename Fun,
+        typename SizeHint,
+        typename = typename std::enable_if<!std::is_same<Fun, parallel_policy>::value>::type,
+        typename ResultHelperT = helpers::concat_map_t<ResultContainerTypeExplicit, InputContainerType, Fun>,
+        typename ResultContainer = typename ResultHelperT::container_type>
+    forceinline ResultContainer concatMap(Fun fun, const InputContainerType& input, SizeHint sizeHint)
+    {
+        FUNCTIONAL_PROBE("concatMap", Fun);
+        const helpers::Applicator<Fun> f{ fun };
+        const helpers::Applicator<SizeHint> hint{ sizeHint };
+        std::size_t size = 0;
+        for (auto&& value : input)
+        {
+            size += static_cast<std::size_t>(hint(value));
+        }
+
+        helpers::Accumulator<ResultContainer> accumulator;
+        accumulator.reserveCount(size);
+        for (auto&& value : input)
+        {
+            FUNCTIONAL_PROBE_ELEMENT();
+            for (auto&& result : f(value))
+            {
+                accumulator.accumulate(result);
+            }
+        }
+        FUNCTIONAL_PROBE_ALLOCATED(accumulator.container);
+        return std::move(accumulator.container);
+    }
 };
 
 #undef forceinline
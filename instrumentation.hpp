@@ -0,0 +1,292 @@
+/*
+Copyright (c) 2013 Janick Bernet
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#ifndef _INSTRUMENTATION_HPP_
+#define _INSTRUMENTATION_HPP_
+
+// Per call site counters for the combinators, enabled by defining FUNCTIONAL_INSTRUMENTATION
+// before including functional.hpp. A call site is one instantiation of a combinator, i.e. one
+// combinator/function type pair, which for lambdas is unique per place in the source.
+// Without the define all probes expand to nothing and the snapshot is always empty.
+
+#include <array>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include "small_vector.hpp"
+
+#if defined(FUNCTIONAL_INSTRUMENTATION)
+    #include <atomic>
+    #include <chrono>
+    #include <cstdlib>
+    #include <deque>
+    #include <mutex>
+    #include <typeinfo>
+    #if defined(__GNUC__)
+        #include <cxxabi.h>
+    #endif
+#endif
+
+namespace functional
+{
+    namespace instrumentation
+    {
+        // counters of one call site (or one executor worker, with combinator "worker")
+        struct Stats
+        {
+            std::string combinator;
+            std::string site;
+            std::uint64_t calls;
+            std::uint64_t elements;
+            std::uint64_t nanoseconds;
+            std::uint64_t bytesAllocated;
+        };
+
+        //! all call sites recorded so far, in order of first use
+        std::vector<Stats> snapshot();
+
+        //! zeroes all counters, keeping the call sites
+        void reset();
+
+        //! writes the snapshot as a JSON array of objects
+        void dumpJson(std::ostream& out);
+    }
+};
+
+namespace functional_impl
+{
+    namespace instrumentation
+    {
+#if defined(FUNCTIONAL_INSTRUMENTATION)
+        struct Record
+        {
+            Record(std::string combinator, std::string site)
+                : combinator(std::move(combinator))
+                , site(std::move(site))
+                , calls(0)
+                , elements(0)
+                , nanoseconds(0)
+                , bytesAllocated(0)
+            {
+            }
+
+            const std::string combinator;
+            const std::string site;
+            std::atomic<std::uint64_t> calls;
+            std::atomic<std::uint64_t> elements;
+            std::atomic<std::uint64_t> nanoseconds;
+            std::atomic<std::uint64_t> bytesAllocated;
+        };
+
+        // records live in a deque so references handed out stay valid while new sites are added
+        struct Registry
+        {
+            std::mutex mutex;
+            std::deque<Record> records;
+
+            static Registry& instance()
+            {
+                static Registry registry;
+                return registry;
+            }
+
+            Record& add(std::string combinator, std::string site)
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                records.emplace_back(std::move(combinator), std::move(site));
+                return records.back();
+            }
+        };
+
+        inline std::string demangle(const char* name)
+        {
+#if defined(__GNUC__)
+            int status = 0;
+            char* demangled = abi::__cxa_demangle(name, nullptr, nullptr, &status);
+            if (status == 0 && demangled)
+            {
+                std::string result(demangled);
+                std::free(demangled);
+                return result;
+            }
+#endif
+            return name;
+        }
+
+        template<typename Fun>
+        Record& site(const char* combinator)
+        {
+            return Registry::instance().add(combinator, demangle(typeid(Fun).name()));
+        }
+
+        // measures one call of a combinator from construction to destruction
+        class Probe
+        {
+        public:
+            explicit Probe(Record& record)
+                : m_record(record)
+                , m_elements(0)
+                , m_start(std::chrono::steady_clock::now())
+            {
+            }
+
+            ~Probe()
+            {
+                auto elapsed = std::chrono::steady_clock::now() - m_start;
+                m_record.calls.fetch_add(1, std::memory_order_relaxed);
+                m_record.elements.fetch_add(m_elements, std::memory_order_relaxed);
+                m_record.nanoseconds.fetch_add(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count(), std::memory_order_relaxed);
+            }
+
+            void element() { ++m_elements; }
+            void elements(std::uint64_t n) { m_elements += n; }
+            void allocated(std::uint64_t bytes) { m_record.bytesAllocated.fetch_add(bytes, std::memory_order_relaxed); }
+
+        private:
+            Record& m_record;
+            std::uint64_t m_elements;
+            std::chrono::steady_clock::time_point m_start;
+        };
+
+        // heap bytes held by a result container: exact for contiguous containers, estimated per node otherwise
+        template<typename Container>
+        auto allocatedBytes(const Container& container, int) -> decltype(static_cast<std::uint64_t>(container.capacity()))
+        {
+            return static_cast<std::uint64_t>(container.capacity()) * sizeof(typename Container::value_type);
+        }
+
+        template<typename Container>
+        auto allocatedBytes(const Container& container, long) -> decltype(static_cast<std::uint64_t>(container.size()))
+        {
+            return static_cast<std::uint64_t>(container.size()) * (sizeof(typename Container::value_type) + 2 * sizeof(void*));
+        }
+
+        template<typename ValueT, std::size_t size>
+        std::uint64_t allocatedBytes(const std::array<ValueT, size>&, int)
+        {
+            return 0;
+        }
+
+        template<typename ValueT, std::size_t size>
+        std::uint64_t allocatedBytes(const functional::small_vector<ValueT, size>& container, int)
+        {
+            return container.is_inline() ? 0 : static_cast<std::uint64_t>(container.capacity()) * sizeof(ValueT);
+        }
+
+        // number of elements of inputs that know their size, 0 for single pass sequences
+        template<typename Container>
+        auto elementCount(const Container& container, int) -> decltype(static_cast<std::uint64_t>(container.size()))
+        {
+            return static_cast<std::uint64_t>(container.size());
+        }
+
+        template<typename... Args>
+        std::uint64_t elementCount(const std::tuple<Args...>&, int)
+        {
+            return sizeof...(Args);
+        }
+
+        template<typename Container>
+        std::uint64_t elementCount(const Container&, long)
+        {
+            return 0;
+        }
+
+        #define FUNCTIONAL_PROBE(combinator, Fun) \
+            static functional_impl::instrumentation::Record& _probeSite = functional_impl::instrumentation::site<Fun>(combinator); \
+            functional_impl::instrumentation::Probe _probe(_probeSite)
+        #define FUNCTIONAL_PROBE_ELEMENT() _probe.element()
+        #define FUNCTIONAL_PROBE_ELEMENTS(n) _probe.elements(n)
+        #define FUNCTIONAL_PROBE_ALLOCATED(container) _probe.allocated(functional_impl::instrumentation::allocatedBytes(container, 0))
+#else
+        #define FUNCTIONAL_PROBE(combinator, Fun)
+        #define FUNCTIONAL_PROBE_ELEMENT()
+        #define FUNCTIONAL_PROBE_ELEMENTS(n)
+        #define FUNCTIONAL_PROBE_ALLOCATED(container)
+#endif
+    }
+};
+
+inline std::vector<functional::instrumentation::Stats> functional::instrumentation::snapshot()
+{
+    std::vector<Stats> stats;
+#if defined(FUNCTIONAL_INSTRUMENTATION)
+    auto& registry = functional_impl::instrumentation::Registry::instance();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    stats.reserve(registry.records.size());
+    for (auto& record : registry.records)
+    {
+        stats.push_back(Stats{ record.combinator, record.site, record.calls.load(), record.elements.load(), record.nanoseconds.load(), record.bytesAllocated.load() });
+    }
+#endif
+    return stats;
+}
+
+inline void functional::instrumentation::reset()
+{
+#if defined(FUNCTIONAL_INSTRUMENTATION)
+    auto& registry = functional_impl::instrumentation::Registry::instance();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    for (auto& record : registry.records)
+    {
+        record.calls = 0;
+        record.elements = 0;
+        record.nanoseconds = 0;
+        record.bytesAllocated = 0;
+    }
+#endif
+}
+
+inline void functional::instrumentation::dumpJson(std::ostream& out)
+{
+    auto escaped = [](const std::string& s)
+    {
+        std::string result;
+        result.reserve(s.size());
+        for (char c : s)
+        {
+            if (c == '"' || c == '\\')
+            {
+                result.push_back('\\');
+            }
+            result.push_back(c);
+        }
+        return result;
+    };
+
+    out << "[";
+    bool first = true;
+    for (const auto& stats : snapshot())
+    {
+        out << (first ? "\n" : ",\n");
+        out << "  {\"combinator\": \"" << escaped(stats.combinator) << "\", \"site\": \"" << escaped(stats.site)
+            << "\", \"calls\": " << stats.calls << ", \"elements\": " << stats.elements
+            << ", \"nanoseconds\": " << stats.nanoseconds << ", \"bytesAllocated\": " << stats.bytesAllocated << "}";
+        first = false;
+    }
+    out << "\n]\n";
+}
+
+#endif // _INSTRUMENTATION_HPP_
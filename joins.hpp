@@ -0,0 +1,602 @@
+/*
+Copyright (c) 2013 Janick Bernet
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#ifndef _JOINS_HPP_
+#define _JOINS_HPP_
+
+// Joins of two sequences on a key, as lazy views like zip: the inner joins yield pairs of whatever the
+// inputs dereference to (references for containers), left joins pair every left element with a pointer
+// to its match or nullptr, and semi joins yield the left elements that have a match. Matches of a left
+// element come in the order of the right input. The left input is walked once and may be a single pass
+// sequence; the right one is walked again (merge join) or referenced (hash join), so it has to be multi pass.
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include <assert.h>
+
+#include "parallel.hpp"
+
+namespace functional_impl
+{
+    namespace helpers
+    {
+        enum JoinKind { InnerJoin, LeftJoin, SemiJoin };
+
+        template<JoinKind Kind, typename KeyL, typename KeyR, typename Lhs, typename Rhs>
+        class MergeJoin;
+
+        template<typename Rhs, typename KeyR>
+        class JoinTable;
+
+        template<JoinKind Kind, typename KeyL, typename KeyR, typename Lhs, typename Rhs>
+        class HashJoin;
+    }
+};
+
+namespace functional
+{
+    // merge joins expect both inputs sorted ascending by their keys and make a single pass over them without allocating
+
+    //! mergeJoin :: (a -> k) -> (b -> k) -> [a] -> [b] -> [(a, b)]
+    template<typename KeyL, typename KeyR, typename Lhs, typename Rhs>
+    functional_impl::helpers::MergeJoin<functional_impl::helpers::InnerJoin, KeyL, KeyR, Lhs, Rhs> mergeJoin(KeyL keyL, KeyR keyR, const Lhs& lhs, const Rhs& rhs);
+
+    //! mergeLeftJoin :: (a -> k) -> (b -> k) -> [a] -> [b] -> [(a, Maybe b)]
+    template<typename KeyL, typename KeyR, typename Lhs, typename Rhs>
+    functional_impl::helpers::MergeJoin<functional_impl::helpers::LeftJoin, KeyL, KeyR, Lhs, Rhs> mergeLeftJoin(KeyL keyL, KeyR keyR, const Lhs& lhs, const Rhs& rhs);
+
+    //! mergeSemiJoin :: (a -> k) -> (b -> k) -> [a] -> [b] -> [a]
+    template<typename KeyL, typename KeyR, typename Lhs, typename Rhs>
+    functional_impl::helpers::MergeJoin<functional_impl::helpers::SemiJoin, KeyL, KeyR, Lhs, Rhs> mergeSemiJoin(KeyL keyL, KeyR keyR, const Lhs& lhs, const Rhs& rhs);
+
+    // hash joins build a flat table over the right input when called (in parallel partitions with par),
+    // the left input is probed lazily; keys are hashed with std::hash and compared with ==
+
+    //! hashJoin :: (a -> k) -> (b -> k) -> [a] -> [b] -> [(a, b)]
+    template<typename KeyL, typename KeyR, typename Lhs, typename Rhs>
+    functional_impl::helpers::HashJoin<functional_impl::helpers::InnerJoin, KeyL, KeyR, Lhs, Rhs> hashJoin(KeyL keyL, KeyR keyR, const Lhs& lhs, const Rhs& rhs);
+
+    //! hashLeftJoin :: (a -> k) -> (b -> k) -> [a] -> [b] -> [(a, Maybe b)]
+    template<typename KeyL, typename KeyR, typename Lhs, typename Rhs>
+    functional_impl::helpers::HashJoin<functional_impl::helpers::LeftJoin, KeyL, KeyR, Lhs, Rhs> hashLeftJoin(KeyL keyL, KeyR keyR, const Lhs& lhs, const Rhs& rhs);
+
+    //! hashSemiJoin :: (a -> k) -> (b -> k) -> [a] -> [b] -> [a]
+    template<typename KeyL, typename KeyR, typename Lhs, typename Rhs>
+    functional_impl::helpers::HashJoin<functional_impl::helpers::SemiJoin, KeyL, KeyR, Lhs, Rhs> hashSemiJoin(KeyL keyL, KeyR keyR, const Lhs& lhs, const Rhs& rhs);
+
+    //! hashJoin :: Par -> (a -> k) -> (b -> k) -> [a] -> [b] -> [(a, b)]
+    template<typename KeyL, typename KeyR, typename Lhs, typename Rhs>
+    functional_impl::helpers::HashJoin<functional_impl::helpers::InnerJoin, KeyL, KeyR, Lhs, Rhs> hashJoin(const parallel_policy& policy, KeyL keyL, KeyR keyR, const Lhs& lhs, const Rhs& rhs);
+
+    //! hashLeftJoin :: Par -> (a -> k) -> (b -> k) -> [a] -> [b] -> [(a, Maybe b)]
+    template<typename KeyL, typename KeyR, typename Lhs, typename Rhs>
+    functional_impl::helpers::HashJoin<functional_impl::helpers::LeftJoin, KeyL, KeyR, Lhs, Rhs> hashLeftJoin(const parallel_policy& policy, KeyL keyL, KeyR keyR, const Lhs& lhs, const Rhs& rhs);
+
+    //! hashSemiJoin :: Par -> (a -> k) -> (b -> k) -> [a] -> [b] -> [a]
+    template<typename KeyL, typename KeyR, typename Lhs, typename Rhs>
+    functional_impl::helpers::HashJoin<functional_impl::helpers::SemiJoin, KeyL, KeyR, Lhs, Rhs> hashSemiJoin(const parallel_policy& policy, KeyL keyL, KeyR keyR, const Lhs& lhs, const Rhs& rhs);
+};
+
+namespace functional_impl
+{
+    namespace helpers
+    {
+        // what a join yields for a left element and its match, which is null only for unmatched elements of left joins
+        template<JoinKind Kind, typename LItr, typename RItr>
+        struct JoinOutput;
+
+        template<typename LItr, typename RItr>
+        struct JoinOutput<InnerJoin, LItr, RItr>
+        {
+            typedef std::pair<deref_t<LItr>, deref_t<RItr>> type;
+
+            static type make(const LItr& left, const RItr* right)
+            {
+                return type(*left, **right);
+            }
+        };
+
+        template<typename LItr, typename RItr>
+        struct JoinOutput<LeftJoin, LItr, RItr>
+        {
+            static_assert(std::is_lvalue_reference<deref_t<RItr>>::value, "The right input of a left join must hold its elements, e.g. be a container.");
+
+            typedef std::pair<deref_t<LItr>, const typename std::remove_reference<deref_t<RItr>>::type*> type;
+
+            static type make(const LItr& left, const RItr* right)
+            {
+                return type(*left, right ? &**right : nullptr);
+            }
+        };
+
+        template<typename LItr, typename RItr>
+        struct JoinOutput<SemiJoin, LItr, RItr>
+        {
+            typedef deref_t<LItr> type;
+
+            static type make(const LItr& left, const RItr*)
+            {
+                return *left;
+            }
+        };
+
+        template<JoinKind Kind, typename KeyL, typename KeyR, typename Lhs, typename Rhs>
+        class MergeJoin : public _Sequence
+        {
+            typedef decltype(std::declval<const Lhs&>().begin()) LItr;
+            typedef decltype(std::declval<const Rhs&>().begin()) RItr;
+            typedef JoinOutput<Kind, LItr, RItr> Output;
+
+        public:
+            typedef typename Output::type reference;
+            typedef reference value_type;
+
+            MergeJoin(KeyL keyL, KeyR keyR, const Lhs& lhs, const Rhs& rhs)
+                : m_keyL{ std::move(keyL) }
+                , m_keyR{ std::move(keyR) }
+                , m_lhs(lhs)
+                , m_rhs(rhs)
+            {
+            }
+
+            // the right input is walked once, except for the group of elements matching the current left key
+            class Itr
+            {
+            public:
+                bool operator!= (const Itr& other) const
+                {
+                    return m_left != other.m_left;
+                }
+
+                reference operator* () const
+                {
+                    return Output::make(m_left, m_matched ? &m_right : nullptr);
+                }
+
+                const Itr& operator++ ()
+                {
+                    if (Kind != SemiJoin && m_matched && ++m_right != m_groupEnd)
+                    {
+                        return *this;
+                    }
+                    ++m_left;
+                    settle();
+                    return *this;
+                }
+
+            private:
+                friend class MergeJoin;
+
+                Itr(const MergeJoin* owner, LItr left, LItr leftEnd, RItr right, RItr rightEnd)
+                    : m_owner(owner)
+                    , m_left(std::move(left))
+                    , m_leftEnd(std::move(leftEnd))
+                    , m_right(right)
+                    , m_groupBegin(right)
+                    , m_groupEnd(right)
+                    , m_rightEnd(std::move(rightEnd))
+                    , m_matched(false)
+                    , m_hasGroup(false)
+                {
+                    settle();
+                }
+
+                // moves on to the first left element from the current one on that yields something
+                void settle()
+                {
+                    for (; m_left != m_leftEnd; ++m_left)
+                    {
+                        m_matched = findGroup(m_owner->m_keyL(*m_left));
+                        if (m_matched || Kind == LeftJoin)
+                        {
+                            m_right = m_groupBegin;
+                            return;
+                        }
+                        if (!(m_groupEnd != m_rightEnd))
+                        {
+                            // no right element is left to match
+                            m_left = m_leftEnd;
+                            return;
+                        }
+                    }
+                }
+
+                // the group of right elements equal to key; left keys never decrease, so the previous group is either reused or left behind
+                template<typename Key>
+                bool findGroup(const Key& key)
+                {
+                    if (m_hasGroup && !(m_owner->m_keyR(*m_groupBegin) < key))
+                    {
+                        return true;
+                    }
+                    m_hasGroup = false;
+                    m_groupBegin = m_groupEnd;
+                    while (m_groupBegin != m_rightEnd && m_owner->m_keyR(*m_groupBegin) < key)
+                    {
+                        ++m_groupBegin;
+                    }
+                    m_groupEnd = m_groupBegin;
+                    while (m_groupEnd != m_rightEnd && !(key < m_owner->m_keyR(*m_groupEnd)))
+                    {
+                        ++m_groupEnd;
+                    }
+                    m_hasGroup = m_groupBegin != m_groupEnd;
+                    return m_hasGroup;
+                }
+
+                const MergeJoin* m_owner;
+                LItr m_left;
+                LItr m_leftEnd;
+                RItr m_right;
+                RItr m_groupBegin;
+                RItr m_groupEnd;
+                RItr m_rightEnd;
+                bool m_matched;
+                bool m_hasGroup;
+            };
+
+            Itr begin() const { return Itr(this, m_lhs.begin(), m_lhs.end(), m_rhs.begin(), m_rhs.end()); }
+            Itr end() const { return Itr(this, m_lhs.end(), m_lhs.end(), m_rhs.end(), m_rhs.end()); }
+
+        private:
+            const Applicator<KeyL> m_keyL;
+            const Applicator<KeyR> m_keyR;
+            stored_t<Lhs> m_lhs;
+            stored_t<Rhs> m_rhs;
+        };
+
+        // flat hash table over the positions of the right input: one array of bucket heads and one of entries
+        // chained by index, so building it allocates twice. Buckets are picked by the high bits of a
+        // multiplicative hash; the parallel build partitions the entries by the top bits of their bucket, so
+        // every partition links its own contiguous range of entries and buckets
+        template<typename Rhs, typename KeyR>
+        class JoinTable
+        {
+        public:
+            typedef decltype(std::declval<const Rhs&>().begin()) RItr;
+            typedef typename std::decay<decltype(std::declval<const Applicator<KeyR>&>()(*std::declval<const RItr&>()))>::type key_type;
+
+            static const std::uint32_t None = 0xffffffff;
+
+            JoinTable(const Rhs& rhs, KeyR keyR)
+                : m_rhs(rhs)
+                , m_key{ std::move(keyR) }
+            {
+                for (auto pos = m_rhs.begin(), end = m_rhs.end(); pos != end; ++pos)
+                {
+                    m_entries.push_back(Entry{ hashOf(m_key(*pos)), None, pos });
+                }
+                allocate(m_entries.size(), 1);
+                link(0, m_entries.size());
+            }
+
+            JoinTable(Executor& executor, const Rhs& rhs, KeyR keyR)
+                : m_rhs(rhs)
+                , m_key{ std::move(keyR) }
+            {
+                std::vector<RItr> positions;
+                for (auto pos = m_rhs.begin(), end = m_rhs.end(); pos != end; ++pos)
+                {
+                    positions.push_back(pos);
+                }
+                const std::size_t size = positions.size();
+                std::size_t partitions = 1;
+                while (partitions < executor.concurrency())
+                {
+                    partitions *= 2;
+                }
+                allocate(size, partitions);
+                unsigned partitionBits = 0;
+                while ((std::size_t(1) << partitionBits) < partitions)
+                {
+                    ++partitionBits;
+                }
+                const unsigned partitionShift = m_bits - partitionBits;
+
+                // hash the chunks and count their entries per partition, then scatter them partition by partition, chunks in order
+                const std::size_t chunks = std::max<std::size_t>(1, std::min(executor.concurrency() * 4, size / 1024));
+                std::vector<std::uint64_t> hashes(size);
+                std::vector<std::size_t> offsets(chunks * partitions, 0);
+                parallelFor(executor, chunks, [&](std::size_t chunk)
+                {
+                    for (std::size_t i = size * chunk / chunks; i < size * (chunk + 1) / chunks; ++i)
+                    {
+                        hashes[i] = hashOf(m_key(*positions[i]));
+                        ++offsets[chunk * partitions + (bucketOf(hashes[i]) >> partitionShift)];
+                    }
+                });
+                std::vector<std::size_t> partitionBegin(partitions + 1, size);
+                std::size_t offset = 0;
+                for (std::size_t partition = 0; partition < partitions; ++partition)
+                {
+                    partitionBegin[partition] = offset;
+                    for (std::size_t chunk = 0; chunk < chunks; ++chunk)
+                    {
+                        const std::size_t count = offsets[chunk * partitions + partition];
+                        offsets[chunk * partitions + partition] = offset;
+                        offset += count;
+                    }
+                }
+                m_entries.resize(size);
+                parallelFor(executor, chunks, [&](std::size_t chunk)
+                {
+                    for (std::size_t i = size * chunk / chunks; i < size * (chunk + 1) / chunks; ++i)
+                    {
+                        m_entries[offsets[chunk * partitions + (bucketOf(hashes[i]) >> partitionShift)]++] = Entry{ hashes[i], None, positions[i] };
+                    }
+                });
+                parallelFor(executor, partitions, [&](std::size_t partition) { link(partitionBegin[partition], partitionBegin[partition + 1]); });
+            }
+
+            template<typename Key>
+            static std::uint64_t hashOf(const Key& key)
+            {
+                return std::uint64_t(std::hash<key_type>()(key)) * 0x9E3779B97F4A7C15ull;
+            }
+
+            // first entry from pos on along its chain matching key, or None
+            template<typename Key>
+            std::uint32_t match(std::uint32_t pos, std::uint64_t hash, const Key& key) const
+            {
+                for (; pos != None; pos = m_entries[pos].next)
+                {
+                    if (m_entries[pos].hash == hash && m_key(*m_entries[pos].pos) == key)
+                    {
+                        return pos;
+                    }
+                }
+                return None;
+            }
+
+            template<typename Key>
+            std::uint32_t find(std::uint64_t hash, const Key& key) const
+            {
+                return match(m_buckets[bucketOf(hash)], hash, key);
+            }
+
+            template<typename Key>
+            std::uint32_t next(std::uint32_t pos, std::uint64_t hash, const Key& key) const
+            {
+                return match(m_entries[pos].next, hash, key);
+            }
+
+            const RItr& at(std::uint32_t pos) const
+            {
+                return m_entries[pos].pos;
+            }
+
+        private:
+            struct Entry
+            {
+                std::uint64_t hash;
+                std::uint32_t next;
+                RItr pos;
+            };
+
+            // at least two buckets per entry and one per partition; the parallel build sizes the table before
+            // it scatters the entries, so the entry count is passed in
+            void allocate(std::size_t entries, std::size_t partitions)
+            {
+                assert(entries < None && "too many elements for a hash join");
+                m_bits = 1;
+                while ((std::size_t(1) << m_bits) < std::max(partitions, 2 * entries))
+                {
+                    ++m_bits;
+                }
+                m_buckets.assign(std::size_t(1) << m_bits, std::uint32_t(None));
+            }
+
+            std::size_t bucketOf(std::uint64_t hash) const
+            {
+                return static_cast<std::size_t>(hash >> (64 - m_bits));
+            }
+
+            // prepends from the back, so every chain lists its entries in input order
+            void link(std::size_t first, std::size_t last)
+            {
+                for (std::size_t i = last; i-- > first;)
+                {
+                    std::uint32_t& bucket = m_buckets[bucketOf(m_entries[i].hash)];
+                    m_entries[i].next = bucket;
+                    bucket = static_cast<std::uint32_t>(i);
+                }
+            }
+
+            stored_t<Rhs> m_rhs;
+            const Applicator<KeyR> m_key;
+            std::vector<Entry> m_entries;
+            std::vector<std::uint32_t> m_buckets;
+            unsigned m_bits;
+        };
+
+        // probes the shared table with the left elements one at a time, copies of the view share the table
+        template<JoinKind Kind, typename KeyL, typename KeyR, typename Lhs, typename Rhs>
+        class HashJoin : public _Sequence
+        {
+            typedef JoinTable<Rhs, KeyR> Table;
+            typedef decltype(std::declval<const Lhs&>().begin()) LItr;
+            typedef typename Table::RItr RItr;
+            typedef typename std::decay<decltype(std::declval<const Applicator<KeyL>&>()(*std::declval<const LItr&>()))>::type LeftKey;
+            typedef JoinOutput<Kind, LItr, RItr> Output;
+
+        public:
+            typedef typename Output::type reference;
+            typedef reference value_type;
+
+            HashJoin(KeyL keyL, const Lhs& lhs, std::shared_ptr<const Table> table)
+                : m_keyL{ std::move(keyL) }
+                , m_lhs(lhs)
+                , m_table(std::move(table))
+            {
+            }
+
+            class Itr
+            {
+            public:
+                bool operator!= (const Itr& other) const
+                {
+                    return m_left != other.m_left;
+                }
+
+                reference operator* () const
+                {
+                    return Output::make(m_left, m_pos != Table::None ? &m_owner->m_table->at(m_pos) : nullptr);
+                }
+
+                const Itr& operator++ ()
+                {
+                    if (Kind != SemiJoin && m_pos != Table::None)
+                    {
+                        m_pos = m_owner->m_table->next(m_pos, m_hash, *m_key);
+                        if (m_pos != Table::None)
+                        {
+                            return *this;
+                        }
+                    }
+                    ++m_left;
+                    settle();
+                    return *this;
+                }
+
+            private:
+                friend class HashJoin;
+
+                Itr(const HashJoin* owner, LItr left, LItr leftEnd)
+                    : m_owner(owner)
+                    , m_left(std::move(left))
+                    , m_leftEnd(std::move(leftEnd))
+                    , m_hash(0)
+                    , m_pos(Table::None)
+                {
+                    settle();
+                }
+
+                void settle()
+                {
+                    for (; m_left != m_leftEnd; ++m_left)
+                    {
+                        m_key.emplace(m_owner->m_keyL(*m_left));
+                        m_hash = Table::hashOf(*m_key);
+                        m_pos = m_owner->m_table->find(m_hash, *m_key);
+                        if (m_pos != Table::None || Kind == LeftJoin)
+                        {
+                            return;
+                        }
+                    }
+                }
+
+                const HashJoin* m_owner;
+                LItr m_left;
+                LItr m_leftEnd;
+                Maybe<LeftKey> m_key;
+                std::uint64_t m_hash;
+                std::uint32_t m_pos;
+            };
+
+            Itr begin() const { return Itr(this, m_lhs.begin(), m_lhs.end()); }
+            Itr end() const { return Itr(this, m_lhs.end(), m_lhs.end()); }
+
+        private:
+            const Applicator<KeyL> m_keyL;
+            stored_t<Lhs> m_lhs;
+            std::shared_ptr<const Table> m_table;
+        };
+
+        template<JoinKind Kind, typename KeyL, typename KeyR, typename Lhs, typename Rhs>
+        inline HashJoin<Kind, KeyL, KeyR, Lhs, Rhs> hashJoin(KeyL keyL, KeyR keyR, const Lhs& lhs, const Rhs& rhs)
+        {
+            FUNCTIONAL_PROBE("hashJoin", KeyR);
+            FUNCTIONAL_PROBE_ELEMENTS(functional_impl::instrumentation::elementCount(rhs, 0));
+            return { std::move(keyL), lhs, std::make_shared<JoinTable<Rhs, KeyR>>(rhs, std::move(keyR)) };
+        }
+
+        template<JoinKind Kind, typename KeyL, typename KeyR, typename Lhs, typename Rhs>
+        inline HashJoin<Kind, KeyL, KeyR, Lhs, Rhs> hashJoin(Executor& executor, KeyL keyL, KeyR keyR, const Lhs& lhs, const Rhs& rhs)
+        {
+            FUNCTIONAL_PROBE("hashJoin", KeyR);
+            FUNCTIONAL_PROBE_ELEMENTS(functional_impl::instrumentation::elementCount(rhs, 0));
+            return { std::move(keyL), lhs, std::make_shared<JoinTable<Rhs, KeyR>>(executor, rhs, std::move(keyR)) };
+        }
+    }
+};
+
+template<typename KeyL, typename KeyR, typename Lhs, typename Rhs>
+functional_impl::helpers::MergeJoin<functional_impl::helpers::InnerJoin, KeyL, KeyR, Lhs, Rhs> functional::mergeJoin(KeyL keyL, KeyR keyR, const Lhs& lhs, const Rhs& rhs)
+{
+    return { std::move(keyL), std::move(keyR), lhs, rhs };
+}
+
+template<typename KeyL, typename KeyR, typename Lhs, typename Rhs>
+functional_impl::helpers::MergeJoin<functional_impl::helpers::LeftJoin, KeyL, KeyR, Lhs, Rhs> functional::mergeLeftJoin(KeyL keyL, KeyR keyR, const Lhs& lhs, const Rhs& rhs)
+{
+    return { std::move(keyL), std::move(keyR), lhs, rhs };
+}
+
+template<typename KeyL, typename KeyR, typename Lhs, typename Rhs>
+functional_impl::helpers::MergeJoin<functional_impl::helpers::SemiJoin, KeyL, KeyR, Lhs, Rhs> functional::mergeSemiJoin(KeyL keyL, KeyR keyR, const Lhs& lhs, const Rhs& rhs)
+{
+    return { std::move(keyL), std::move(keyR), lhs, rhs };
+}
+
+template<typename KeyL, typename KeyR, typename Lhs, typename Rhs>
+functional_impl::helpers::HashJoin<functional_impl::helpers::InnerJoin, KeyL, KeyR, Lhs, Rhs> functional::hashJoin(KeyL keyL, KeyR keyR, const Lhs& lhs, const Rhs& rhs)
+{
+    return functional_impl::helpers::hashJoin<functional_impl::helpers::InnerJoin>(std::move(keyL), std::move(keyR), lhs, rhs);
+}
+
+template<typename KeyL, typename KeyR, typename Lhs, typename Rhs>
+functional_impl::helpers::HashJoin<functional_impl::helpers::LeftJoin, KeyL, KeyR, Lhs, Rhs> functional::hashLeftJoin(KeyL keyL, KeyR keyR, const Lhs& lhs, const Rhs& rhs)
+{
+    return functional_impl::helpers::hashJoin<functional_impl::helpers::LeftJoin>(std::move(keyL), std::move(keyR), lhs, rhs);
+}
+
+template<typename KeyL, typename KeyR, typename Lhs, typename Rhs>
+functional_impl::helpers::HashJoin<functional_impl::helpers::SemiJoin, KeyL, KeyR, Lhs, Rhs> functional::hashSemiJoin(KeyL keyL, KeyR keyR, const Lhs& lhs, const Rhs& rhs)
+{
+    return functional_impl::helpers::hashJoin<functional_impl::helpers::SemiJoin>(std::move(keyL), std::move(keyR), lhs, rhs);
+}
+
+template<typename KeyL, typename KeyR, typename Lhs, typename Rhs>
+functional_impl::helpers::HashJoin<functional_impl::helpers::InnerJoin, KeyL, KeyR, Lhs, Rhs> functional::hashJoin(const parallel_policy& policy, KeyL keyL, KeyR keyR, const Lhs& lhs, const Rhs& rhs)
+{
+    return functional_impl::helpers::hashJoin<functional_impl::helpers::InnerJoin>(policy.executor(), std::move(keyL), std::move(keyR), lhs, rhs);
+}
+
+template<typename KeyL, typename KeyR, typename Lhs, typename Rhs>
+functional_impl::helpers::HashJoin<functional_impl::helpers::LeftJoin, KeyL, KeyR, Lhs, Rhs> functional::hashLeftJoin(const parallel_policy& policy, KeyL keyL, KeyR keyR, const Lhs& lhs, const Rhs& rhs)
+{
+    return functional_impl::helpers::hashJoin<functional_impl::helpers::LeftJoin>(policy.executor(), std::move(keyL), std::move(keyR), lhs, rhs);
+}
+
+template<typename KeyL, typename KeyR, typename Lhs, typename Rhs>
+functional_impl::helpers::HashJoin<functional_impl::helpers::SemiJoin, KeyL, KeyR, Lhs, Rhs> functional::hashSemiJoin(const parallel_policy& policy, KeyL keyL, KeyR keyR, const Lhs& lhs, const Rhs& rhs)
+{
+    return functional_impl::helpers::hashJoin<functional_impl::helpers::SemiJoin>(policy.executor(), std::move(keyL), std::move(keyR), lhs, rhs);
+}
+
+#endif // _JOINS_HPP_
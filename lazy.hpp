@@ -0,0 +1,197 @@
+/*
+Copyright (c) 2013 Janick Bernet
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#ifndef _LAZY_HPP_
+#define _LAZY_HPP_
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <utility>
+
+#include "functional.hpp"
+
+namespace functional_impl
+{
+    namespace helpers
+    {
+        template<typename Fun>
+        struct Lazily;
+    }
+};
+
+namespace functional
+{
+    // a value computed on first use (call by need): copies share the value, which is computed at most once
+    // even if several threads force it at the same time; once computed, forcing is a single atomic load
+    template<typename T>
+    class lazy;
+
+    //! delay :: (() -> a) -> lazy a
+    template<typename Fun>
+    auto delay(Fun fun) -> lazy<decltype(fun())>;
+
+    //! force :: lazy a -> a
+    template<typename T>
+    const T& force(const lazy<T>& value);
+
+    //! lazily :: (a -> b) -> (a -> lazy b)
+    template<typename Fun>
+    auto lazily(Fun fun) -> functional_impl::helpers::Lazily<Fun>;
+};
+
+namespace functional_impl
+{
+    namespace helpers
+    {
+        template<typename T>
+        class LazyState
+        {
+        public:
+            LazyState()
+                : m_ready(false)
+            {
+            }
+
+            virtual ~LazyState()
+            {
+            }
+
+            const T& force()
+            {
+                if (!m_ready.load(std::memory_order_acquire))
+                {
+                    std::call_once(m_once, [this]
+                    {
+                        evaluate(m_value);
+                        m_ready.store(true, std::memory_order_release);
+                    });
+                }
+                return *m_value;
+            }
+
+            bool ready() const
+            {
+                return m_ready.load(std::memory_order_acquire);
+            }
+
+        private:
+            virtual void evaluate(Maybe<T>& value) = 0;
+
+            std::atomic<bool> m_ready;
+            std::once_flag m_once;
+            Maybe<T> m_value;
+        };
+
+        // the thunk is dropped after evaluation, releasing whatever it captured
+        template<typename T, typename Fun>
+        class LazyThunk : public LazyState<T>
+        {
+        public:
+            explicit LazyThunk(Fun fun)
+                : m_fun(std::move(fun))
+            {
+            }
+
+        private:
+            virtual void evaluate(Maybe<T>& value)
+            {
+                value.emplace((*m_fun)());
+                m_fun.reset();
+            }
+
+            Maybe<Fun> m_fun;
+        };
+
+        template<typename Fun>
+        struct Lazily
+        {
+            Fun fun;
+
+            template<typename Arg>
+            auto operator() (const Arg& arg) const -> functional::lazy<typename std::decay<decltype(std::declval<const Applicator<Fun>&>()(arg))>::type>
+            {
+                typedef typename std::decay<decltype(std::declval<const Applicator<Fun>&>()(arg))>::type ResultType;
+
+                Applicator<Fun> applicator = { fun };
+                return functional::lazy<ResultType>(std::make_shared<LazyThunk<ResultType, DelayedCall<Arg>>>(DelayedCall<Arg>{ applicator, arg }));
+            }
+
+            template<typename Arg>
+            struct DelayedCall
+            {
+                Applicator<Fun> applicator;
+                Arg arg;
+
+                auto operator() () -> decltype(applicator(arg))
+                {
+                    return applicator(arg);
+                }
+            };
+        };
+    }
+};
+
+template<typename T>
+class functional::lazy
+{
+public:
+    typedef T value_type;
+
+    explicit lazy(std::shared_ptr<functional_impl::helpers::LazyState<T>> state)
+        : m_state(std::move(state))
+    {
+    }
+
+    const T& force() const { return m_state->force(); }
+
+    // lets combinators consume lazy elements as plain values, forcing exactly those they touch
+    operator const T& () const { return force(); }
+
+    //! whether the value has been computed already
+    bool forced() const { return m_state->ready(); }
+
+private:
+    std::shared_ptr<functional_impl::helpers::LazyState<T>> m_state;
+};
+
+template<typename Fun>
+auto functional::delay(Fun fun) -> lazy<decltype(fun())>
+{
+    typedef decltype(fun()) ResultType;
+
+    return lazy<ResultType>(std::make_shared<functional_impl::helpers::LazyThunk<ResultType, Fun>>(std::move(fun)));
+}
+
+template<typename T>
+const T& functional::force(const lazy<T>& value)
+{
+    return value.force();
+}
+
+template<typename Fun>
+auto functional::lazily(Fun fun) -> functional_impl::helpers::Lazily<Fun>
+{
+    return functional_impl::helpers::Lazily<Fun>{ std::move(fun) };
+}
+
+#endif // _LAZY_HPP_
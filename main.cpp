@@ -3,16 +3,43 @@
 #include <iomanip> 
 #include <vector>
 #include <list>
+#include <map>
 #include <stdint.h>
 #include <stdlib.h>
 #include <tuple>
 #include <typeinfo>
 #include <string>
 #include <sstream>
+#include <stdexcept>
 #include <functional>
 #include <array>
+#include <algorithm>
+#include <numeric>
+#include <atomic>
+#include <iterator>
+#include <chrono>
+#include <new>
+#include <future>
+#include <thread>
 
 #include "functional.hpp"
+#include "executor.hpp"
+#include "external.hpp"
+#include "joins.hpp"
+#include "lazy.hpp"
+#include "memoize.hpp"
+#include "parallel.hpp"
+#include "persistent_map.hpp"
+#include "persistent_vector.hpp"
+#include "pipeline.hpp"
+#include "process_parallel.hpp"
+#include "soa.hpp"
+#include "sketch.hpp"
+#include "sort.hpp"
+#include "strings.hpp"
+#include "transducers.hpp"
+#include "window.hpp"
+#include "perf_counters.hpp"
 
 #if defined(__GNUC__)
     #define noinline __attribute__((noinline)) 
@@ -22,6 +49,84 @@
     #define noinline 
 #endif
 
+// counting replacements of the global allocation functions, so tests can assert exact allocation counts;
+// every new/delete form is replaced so that no allocation pairs with the library's own deallocation, and
+// they stay out of line so the compiler never sees free() called on the result of operator new
+std::atomic<std::size_t> allocations(0);
+
+noinline void* operator new(std::size_t size)
+{
+    ++allocations;
+    if (void* p = malloc(size ? size : 1))
+    {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+noinline void* operator new[](std::size_t size)
+{
+    return operator new(size);
+}
+
+noinline void* operator new(std::size_t size, const std::nothrow_t&) noexcept
+{
+    ++allocations;
+    return malloc(size ? size : 1);
+}
+
+noinline void* operator new[](std::size_t size, const std::nothrow_t& tag) noexcept
+{
+    return operator new(size, tag);
+}
+
+noinline void operator delete(void* p) noexcept
+{
+    free(p);
+}
+
+noinline void operator delete[](void* p) noexcept
+{
+    free(p);
+}
+
+noinline void operator delete(void* p, const std::nothrow_t&) noexcept
+{
+    free(p);
+}
+
+noinline void operator delete[](void* p, const std::nothrow_t&) noexcept
+{
+    free(p);
+}
+
+noinline void operator delete(void* p, std::size_t) noexcept
+{
+    free(p);
+}
+
+noinline void operator delete[](void* p, std::size_t) noexcept
+{
+    free(p);
+}
+
+int failedChecks = 0;
+
+template<typename Fun>
+noinline void expectAllocations(const char* name, std::size_t expected, Fun fun)
+{
+    std::size_t before = allocations.load();
+    fun();
+    std::size_t actual = allocations.load() - before;
+    std::cout << name << ": " << actual;
+    if (actual != expected)
+    {
+        std::cout << " FAILED, expected " << expected;
+        ++failedChecks;
+    }
+    std::cout << " ";
+}
+
 template<typename T>
 T factorial(T n)
 {
@@ -73,6 +178,18 @@ void printUnCurried(std::tuple<int, int, int, int> tup)
     std::cout << std::get<0>(tup) << " " << std::get<1>(tup) << " " << std::get<2>(tup) << " " << std::get<3>(tup) << " ";
 }
 
+// no default constructor, counts how often it is constructed
+struct Heavy
+{
+    explicit Heavy(int value) : value(value) { ++constructions; }
+    Heavy(const Heavy& other) : value(other.value) { ++constructions; }
+
+    int value;
+    static int constructions;
+};
+
+int Heavy::constructions = 0;
+
 struct Printer
 {
     template<typename T>
@@ -350,6 +467,13 @@ noinline void testMapArrayFunctionPtr()
     std::cout << " : " << typeid(res).name() << std::endl;
 }
 
+noinline void testMapLargeArray()
+{
+    std::cout << "testMapLargeArray: ";
+    auto res = functional::map(&string::length, ba);
+    std::cout << functional::foldl([](std::size_t a, std::size_t b) { return a + b; }, std::size_t(0), res) << " : " << typeid(res).name() << std::endl;
+}
+
 noinline void testMapArrayLambdaExplicitSize()
 {
     std::cout << "testMapArrayLambdaExplicitSize: ";
@@ -398,6 +522,16 @@ noinline void testMapVector2ArrayLambda()
     std::cout << " : " << typeid(res).name() << std::endl;
 }
 
+noinline void testMapArrayNoDefaultConstructor()
+{
+    std::cout << "testMapArrayNoDefaultConstructor: ";
+    Heavy::constructions = 0;
+    auto res = functional::map([](int a) { return Heavy(a * 10); }, a);
+    auto sums = functional::zipWith([](const Heavy& h, const string& s) { return Heavy(h.value + s.to_int()); }, res, as);
+    functional::apply([](const Heavy& h) { std::cout << h.value << " "; }, sums);
+    std::cout << Heavy::constructions << " : " << typeid(sums).name() << std::endl;
+}
+
 noinline void testCurryFunctionPtr()
 {
     std::cout << "testCurryFunctionPtr: ";
@@ -447,10 +581,890 @@ noinline void testUnCurryMemberFnParam()
     std::cout << " : " << typeid(resFn).name() << std::endl;
 }
 
+noinline void testMapAsyncVectorTask()
+{
+    std::cout << "testMapAsyncVectorTask: ";
+    auto res = functional::mapAsync(
+        [](int a)
+        {
+            return functional::async([a] { std::this_thread::sleep_for(std::chrono::milliseconds(5 * (5 - a))); return to_string(a); });
+        },
+        v, 2);
+    functional::apply(Printer(), res);
+    std::cout << " : " << typeid(res).name() << std::endl;
+}
+
+noinline void testMapAsyncListStdFuture()
+{
+    std::cout << "testMapAsyncListStdFuture: ";
+    auto res = functional::mapAsync([](int a) { return std::async(std::launch::async, [a] { return a * a; }); }, l, 3);
+    functional::apply(Printer(), res);
+    std::cout << " : " << typeid(res).name() << std::endl;
+}
+
+noinline void testTaskThen()
+{
+    std::cout << "testTaskThen: ";
+    auto res = functional::async([] { return 20; }).then([](int a) { return a + 1; }).then([](int a) { return to_string(a * 2); });
+    std::cout << res.get() << " : " << typeid(res).name() << std::endl;
+}
+
+noinline void testTaskException()
+{
+    std::cout << "testTaskException: ";
+    auto failed = functional::async([]() -> int { throw std::runtime_error("task failed"); }).then([](int a) { return a + 1; });
+    try
+    {
+        failed.get();
+        std::cout << "no exception";
+    }
+    catch (const std::runtime_error& e)
+    {
+        std::cout << e.what();
+    }
+    // the worker that ran the failing job is still there to run the next one
+    std::cout << ", " << functional::async([] { return 42; }).get() << std::endl;
+}
+
+noinline void testTakeUnfoldFibonacci()
+{
+    std::cout << "testTakeUnfoldFibonacci: ";
+    auto fibs = functional::unfold(std::make_pair(0, 1), [](std::pair<int, int> p) { return std::make_pair(p.first, std::make_pair(p.second, p.first + p.second)); });
+    auto res = functional::map([](int a) { return to_string(a); }, functional::take(10, fibs));
+    functional::apply(Printer(), res);
+    std::cout << " : " << typeid(res).name() << std::endl;
+}
+
+noinline void testTakeWhileIterate()
+{
+    std::cout << "testTakeWhileIterate: ";
+    auto powers = functional::iterate([](uint64_t a) { return a * 2; }, uint64_t(1));
+    functional::apply(Printer(), functional::takeWhile([](uint64_t a) { return a < 1000; }, powers));
+    std::cout << ": " << functional::foldl([](uint64_t a, uint64_t b) { return a + b; }, uint64_t(0), functional::take(64, powers)) << std::endl;
+}
+
+noinline void testTakeRepeatCycle()
+{
+    std::cout << "testTakeRepeatCycle: ";
+    functional::apply(Printer(), functional::take(3, functional::repeat(string("x"))));
+    functional::apply(Printer(), functional::take(6, functional::cycle(l)));
+    functional::apply(Printer(), functional::take(7, functional::cycle(functional::range(1, 4))));
+    std::cout << std::endl;
+}
+
+noinline void testGenerator()
+{
+    std::cout << "testGenerator: ";
+    int next = 0;
+    functional::generator<int> squares([next](int& out) mutable { out = next * next; return ++next <= 5; });
+    std::cout << functional::foldl([](int a, int b) { return a + b; }, 0, squares) << " ";
+    functional::generator<int> naturals([next](int& out) mutable { out = next++; return true; });
+    auto res = functional::map([](int a) { return a * 10; }, functional::take(4, naturals));
+    functional::apply(Printer(), res);
+    std::cout << ": " << typeid(res).name() << std::endl;
+}
+
+noinline void testSoaColumnFoldl()
+{
+    std::cout << "testSoaColumnFoldl: ";
+    functional::soa<int, double, string> samples;
+    samples.reserve(4);
+    functional::apply([&](int i) { samples.push_back(i, i * 0.5, to_string(i)); }, v);
+    std::cout << functional::foldl([](double a, double b) { return a + b; }, 0.0, samples.column<1>()) << " ";
+    auto res = functional::map(functional::uncurry([](int id, double value, const string& tag) { return tag + ":" + to_string(id * value); }), samples);
+    functional::apply(Printer(), res);
+    std::cout << " : " << typeid(res).name() << std::endl;
+}
+
+noinline void testSoaColumnsZipWith()
+{
+    std::cout << "testSoaColumnsZipWith: ";
+    functional::soa<int, double, string> samples;
+    functional::apply([&](int i) { samples.push_back(std::make_tuple(i, i * 1.5, to_string(i))); }, l);
+    functional::apply(functional::uncurry([](const int& id, const double& value) { std::cout << id << "=" << value << " "; }), samples.columns<0, 1>());
+    auto res = functional::zipWith([](int id, double value) { return id + value; }, samples.column<0>(), samples.column<1>());
+    functional::apply(Printer(), res);
+    std::cout << ": " << typeid(res).name() << std::endl;
+}
+
+noinline void testUnzip()
+{
+    std::cout << "testUnzip: ";
+    auto cols = functional::unzip(functional::zip(v, vs));
+    functional::apply(Printer(), cols.column<0>());
+    functional::apply(Printer(), cols.column<1>());
+    std::cout << ": " << typeid(cols).name() << std::endl;
+}
+
+noinline void testZipVectorArrayRange()
+{
+    std::cout << "testZipVectorArrayRange: ";
+    auto zipped = functional::zip(v, as, functional::range(10, 20));
+    functional::apply(functional::uncurry([](const int& i, const string& s, int r) { std::cout << i << s << r << " "; }), zipped);
+    std::cout << ": " << zipped.size() << " " << std::get<1>(zipped[2]) << std::endl;
+}
+
+noinline void testZipWith3ListLambda()
+{
+    std::cout << "testZipWith3ListLambda: ";
+    auto res = functional::zipWith([](int a, const string& b, int c) { return to_string(a * c) + b; }, l, ls, functional::range(1, 100));
+    functional::apply(Printer(), res);
+    std::cout << " : " << typeid(res).name() << std::endl;
+}
+
+noinline void testZipWithArrayExplicitVector()
+{
+    std::cout << "testZipWithArrayExplicitVector: ";
+    auto res = functional::zipWith<std::vector<int>>([](int a, int b) { return a * b; }, a, v);
+    functional::apply(Printer(), res);
+    std::cout << ": " << typeid(res).name() << std::endl;
+}
+
+noinline void testMapSmallVector()
+{
+    std::cout << "testMapSmallVector: ";
+    auto res = functional::map<functional::_Small<8>>([](int a) { return to_string(a * a); }, v);
+    auto lengths = functional::map(&string::length, res);
+    functional::apply(Printer(), lengths);
+    std::cout << res.is_inline() << " " << lengths.is_inline() << " : " << typeid(lengths).name() << std::endl;
+}
+
+noinline void testZipWithSmallVectorSpill()
+{
+    std::cout << "testZipWithSmallVectorSpill: ";
+    functional::small_vector<int, 2> sv { 1, 2, 3, 4, 5 };
+    auto res = functional::zipWith([](int a, int b) { return a * b; }, sv, functional::range(10, 20));
+    std::cout << functional::foldl([](int a, int b) { return a + b; }, 0, res) << " " << res.is_inline() << " : " << typeid(res).name() << std::endl;
+}
+
+noinline void testSmallVectorGrowThrow()
+{
+    std::cout << "testSmallVectorGrowThrow: ";
+    struct Positive
+    {
+        explicit Positive(int a) : value(a) { if (a <= 0) { throw std::invalid_argument("not positive"); } }
+        int value;
+    };
+    // growing constructs the new element first, a throwing constructor leaves the inline elements in place
+    functional::small_vector<Positive, 2> sv;
+    sv.emplace_back(1);
+    sv.emplace_back(2);
+    try
+    {
+        sv.emplace_back(0);
+        std::cout << "no exception ";
+    }
+    catch (const std::invalid_argument& e)
+    {
+        std::cout << e.what() << " ";
+    }
+    functional::apply([](const Positive& p) { std::cout << p.value << " "; }, sv);
+    std::cout << sv.size() << " " << sv.is_inline() << std::endl;
+}
+
+noinline void testApplyBatchedMutableVector()
+{
+    std::cout << "testApplyBatchedMutableVector: ";
+    auto mv = std::vector<int>(10, 1);
+    functional::applyBatched([](const functional::Chunk<int*>& batch) { std::fill(batch.begin(), batch.end(), static_cast<int>(batch.size())); }, mv, 4);
+    functional::apply(Printer(), mv);
+    std::cout << ": " << typeid(mv).name() << std::endl;
+}
+
+noinline void testMapBatchedList()
+{
+    std::cout << "testMapBatchedList: ";
+    auto res = functional::mapBatched(
+        [](const functional::Chunk<std::list<int>::const_iterator>& batch)
+        {
+            return functional::map([&](int a) { return to_string(a) + "/" + to_string(batch.size()); }, batch);
+        },
+        l, 3);
+    functional::apply(Printer(), res);
+    std::cout << ": " << typeid(res).name() << std::endl;
+}
+
+noinline void testMapBatchedArray()
+{
+    std::cout << "testMapBatchedArray: ";
+    std::array<int, 4> input = { { 1, 2, 3, 4 } };
+    auto res = functional::mapBatched(
+        [](const functional::Chunk<const int*>& batch)
+        {
+            std::vector<int> out;
+            for (int a : batch)
+            {
+                out.push_back(a);
+                out.push_back(-a);
+            }
+            return out;
+        },
+        input, 3);
+    functional::apply(Printer(), res);
+    std::cout << "size " << res.size() << ": " << typeid(res).name() << std::endl;
+}
+
+noinline void testMapBatchedParallel()
+{
+    std::cout << "testMapBatchedParallel: ";
+    std::vector<int> input(1000);
+    std::iota(input.begin(), input.end(), 0);
+    std::atomic<int> calls(0);
+    auto res = functional::mapBatched(
+        functional::par,
+        [&](const functional::Chunk<const int*>& batch)
+        {
+            ++calls;
+            return std::vector<long long>(batch.begin(), batch.end());
+        },
+        input, 64);
+    std::cout << (res == std::vector<long long>(input.begin(), input.end()) ? "equal " : "differ ") << res.size() << " ";
+    functional::applyBatched(functional::par, [&](const functional::Chunk<int*>& batch) { ++calls; batch[0] = -1; }, input, 500);
+    std::cout << calls << " " << input[500] << ": " << typeid(res).name() << std::endl;
+}
+
+noinline void testMapBatchedParallelException()
+{
+    std::cout << "testMapBatchedParallelException: ";
+    std::vector<int> input(1000);
+    std::iota(input.begin(), input.end(), 0);
+    try
+    {
+        functional::mapBatched(
+            functional::par,
+            [](const functional::Chunk<const int*>& batch)
+            {
+                if (batch[0] == 512)
+                {
+                    throw std::runtime_error("batch 512 failed");
+                }
+                return std::vector<int>(batch.begin(), batch.end());
+            },
+            input, 64);
+        std::cout << "no exception";
+    }
+    catch (const std::runtime_error& e)
+    {
+        std::cout << e.what();
+    }
+    std::cout << std::endl;
+}
+
+noinline void testConcatMapVector()
+{
+    std::cout << "testConcatMapVector: ";
+    auto res = functional::concatMap([](int a) { return std::vector<int>(a, a); }, v);
+    functional::apply(Printer(), res);
+    std::cout << res.capacity() << " : " << typeid(res).name() << std::endl;
+}
+
+noinline void testConcatMapListSizeHint()
+{
+    std::cout << "testConcatMapListSizeHint: ";
+    auto res = functional::concatMap([](int a) { return functional::range(0, a); }, l, [](int a) { return a; });
+    functional::apply(Printer(), res);
+    std::cout << ": " << typeid(res).name() << std::endl;
+}
+
+noinline void testJoin()
+{
+    std::cout << "testJoin: ";
+    std::vector<std::vector<string>> nested { {}, { "1", "2" }, {}, {}, { "3" }, {} };
+    auto joined = functional::join(nested);
+    auto res = functional::map(&string::to_int, joined);
+    functional::apply(Printer(), res);
+    std::cout << joined.size() << " : " << typeid(res).name() << std::endl;
+}
+
+noinline void testConcatMapParallel()
+{
+    std::cout << "testConcatMapParallel: ";
+    auto fanOut = [](int a) { return std::vector<int>(a % 4, a); };
+    auto input = functional::map([](int a) { return a; }, functional::range(0, 1000));
+    auto res = functional::concatMap(functional::par, fanOut, input);
+    std::cout << (res == functional::concatMap(fanOut, input) ? "equal " : "differ ") << res.size() << " : " << typeid(res).name() << std::endl;
+}
+
+noinline void testTransduceSinks()
+{
+    std::cout << "testTransduceSinks: ";
+    auto xf = functional::xform::compose(
+        functional::xform::map([](int a) { return a * a; }),
+        functional::xform::filter([](int a) { return a % 2 == 1; }),
+        functional::xform::take(3));
+    auto sum = functional::transduce(xf, [](int acc, int a) { return acc + a; }, 0, functional::iterate([](int a) { return a + 1; }, 0));
+    auto squares = functional::transduce(xf, functional::xform::PushBack(), std::vector<int>(), l);
+    std::stringstream stream;
+    functional::transduce(xf, [](std::ostream* out, int a) { *out << a << ";"; return out; }, static_cast<std::ostream*>(&stream), v);
+    auto refSum = functional::transduce(xf, [](int& acc, int a) { return acc += a; }, 0, v);
+    std::cout << sum << " " << refSum << " " << squares.size() << " " << stream.str() << " : " << typeid(squares).name() << std::endl;
+}
+
+noinline void testWindowFoldMinSum()
+{
+    std::cout << "testWindowFoldMinSum: ";
+    auto samples = functional::map([](int i) { return (i * 7) % 11; }, functional::range(0, 20));
+    functional::window_fold<functional::monoid::Min<int>> minimum(5);
+    functional::window_fold<functional::monoid::Sum<int>> sum(5);
+    std::vector<int> minima, sums;
+    for (int sample : samples)
+    {
+        minimum.push(sample);
+        sum.push(sample);
+        if (sum.size() == 5)
+        {
+            minima.push_back(minimum.fold());
+            sums.push_back(sum.fold());
+        }
+    }
+    auto windows = functional::slidingWindow(5, 1, samples);
+    auto expectedMinima = functional::map([](const functional::Chunk<const int*>& w) { return functional::foldl([](int a, int b) { return std::min(a, b); }, w[0], w); }, windows);
+    auto expectedSums = functional::map([](const functional::Chunk<const int*>& w) { return functional::foldl([](int a, int b) { return a + b; }, 0, w); }, windows);
+    functional::apply(Printer(), sums);
+    std::cout << (minima == expectedMinima && sums == expectedSums ? "equal " : "differ ") << windows.size() << " : " << typeid(minimum).name() << std::endl;
+}
+
+noinline void testSlidingWindowListStep()
+{
+    std::cout << "testSlidingWindowListStep: ";
+    std::list<int> samples { 1, 2, 3, 4, 5, 6, 7, 8 };
+    functional::apply([](const functional::Chunk<std::list<int>::const_iterator>& w) { std::cout << "[" << functional::foldl([](int a, int b) { return a * 10 + b; }, 0, w) << "] "; }, functional::slidingWindow(3, 2, samples));
+    std::cout << functional::slidingWindow(3, 2, samples).size() << std::endl;
+}
+
+noinline void testLazyForcedOnTouch()
+{
+    std::cout << "testLazyForcedOnTouch: ";
+    static std::atomic<int> evaluated(0);
+    auto settings = functional::map(functional::lazily([](int key) { ++evaluated; return key * 100; }), functional::range(0, 10));
+    int first = evaluated;
+    auto prefix = functional::foldl([](int acc, int value) { return acc + value; }, 0, functional::take(3, settings));
+    int touched = evaluated;
+    functional::foldl([](int acc, int value) { return acc + value; }, 0, settings);
+    functional::foldl([](int acc, int value) { return acc + value; }, 0, settings);
+    std::cout << first << " " << prefix << " " << touched << " " << evaluated << " " << settings[4].forced() << " " << functional::force(settings[9]) << " : " << typeid(settings).name() << std::endl;
+}
+
+noinline void testLazySharedAcrossThreads()
+{
+    std::cout << "testLazySharedAcrossThreads: ";
+    static std::atomic<int> evaluated(0);
+    auto answer = functional::delay([] { ++evaluated; std::this_thread::sleep_for(std::chrono::milliseconds(5)); return string("42"); });
+    auto copies = functional::map([=](int) { return answer; }, functional::range(0, 64));
+    auto sum = functional::foldl([](int acc, int value) { return acc + value; }, 0,
+        functional::mapBatched(functional::par, [](const functional::Chunk<const functional::lazy<string>*>& batch) { return functional::map([](const functional::lazy<string>& s) { return s.force().to_int(); }, batch); }, copies, 4));
+    std::cout << evaluated << " " << sum << " " << answer.forced() << std::endl;
+}
+
+noinline void testPersistentVectorSharing()
+{
+    std::cout << "testPersistentVectorSharing: ";
+    auto builder = functional::persistent_vector<int>().transient();
+    for (int i = 0; i < 2000; ++i)
+    {
+        builder.push_back(i);
+    }
+    auto pv = builder.persistent();
+    auto updated = pv.updated(500, -1).appended(2000);
+    builder.set(0, -1);
+    auto popped = pv;
+    while (popped.size() > 31)
+    {
+        popped = popped.popped();
+    }
+    auto sum = [](int a, int b) { return a + b; };
+    std::cout << pv[0] << " " << pv[500] << " " << updated[500] << " " << updated.back() << " " << builder[0] << " "
+        << functional::foldl(sum, 0, pv) << " " << functional::foldl(sum, 0, updated) << " " << functional::foldl(sum, 0, popped) << " " << popped.size() << " ";
+    auto doubled = functional::map([](int a) { return a * 2; }, pv);
+    std::cout << (std::vector<int>(doubled.begin(), doubled.end()) == functional::map([](int a) { return a * 2; }, functional::range(0, 2000)) ? "equal " : "differ ") << doubled.size() << " : " << typeid(doubled).name() << std::endl;
+}
+
+noinline void testPersistentMapSharing()
+{
+    std::cout << "testPersistentMapSharing: ";
+    auto builder = functional::persistent_map<int, int>().transient();
+    for (int i = 0; i < 5000; ++i)
+    {
+        builder.insert(i, i * 2);
+    }
+    auto snapshot = builder.persistent();
+    auto refreshed = snapshot.inserted(5000, 10000).inserted(7, -1).erased(0);
+    auto odd = functional::foldl([](functional::persistent_map<int, int> m, const std::pair<int, int>& e) { return e.first % 2 ? m : m.erased(e.first); }, refreshed, refreshed);
+    bool found = functional::foldl([&](bool all, int i) { return all && snapshot.find(i) && *snapshot.find(i) == i * 2; }, true, functional::range(0, 4999));
+    auto sum = [](long acc, const std::pair<int, int>& e) { return acc + e.second; };
+    auto halves = functional::map([](int value) { return value / 2.0; }, refreshed);
+    std::cout << found << " " << snapshot.size() << " " << refreshed.size() << " " << odd.size() << " " << (refreshed.find(0) == nullptr) << " " << *refreshed.find(7) << " " << *snapshot.find(7) << " "
+        << functional::foldl(sum, 0L, snapshot) << " " << functional::foldl(sum, 0L, refreshed) << " " << *halves.find(4999) << " : " << typeid(halves).name() << std::endl;
+}
+
+noinline void testPersistentMapCollisions()
+{
+    std::cout << "testPersistentMapCollisions: ";
+    struct ConstantHash { std::size_t operator()(int) const { return 42; } };
+    functional::persistent_map<int, string, ConstantHash> colliding { { 1, string("1") }, { 2, string("2") }, { 3, string("3") } };
+    auto fewer = colliding.erased(2).inserted(4, string("4")).inserted(1, string("11"));
+    functional::apply([](const std::pair<int, string>& e) { std::cout << e.first << "=" << e.second.to_int() << " "; }, fewer);
+    std::cout << colliding.size() << " " << fewer.size() << " " << (fewer.find(2) == nullptr) << " " << colliding.find(1)->to_int() << std::endl;
+}
+
+noinline void testSortOnStable()
+{
+    std::cout << "testSortOnStable: ";
+    auto records = functional::map([](int i) { return std::make_pair((i * 37) % 11 - 5, i); }, functional::range(0, 200));
+    auto byKey = functional::sortOn([](const std::pair<int, int>& r) { return r.first; }, records);
+    auto expected = records;
+    std::stable_sort(expected.begin(), expected.end(), [](const std::pair<int, int>& a, const std::pair<int, int>& b) { return a.first < b.first; });
+    auto temperatures = functional::sortOn([](double t) { return t; }, std::list<double> { 3.5, -0.25, -12.0, 0.0, 7.0, -3.5 });
+    auto names = functional::sortBy([](const string& a, const string& b) { return a.size() < b.size(); }, std::list<string> { string("ccc"), string("a"), string("bb"), string("d") });
+    auto descending = functional::unstableSortOn([](int a) { return -a; }, functional::map([](int a) { return a; }, functional::range(0, 10)));
+    // small trivially copyable elements travel with their radix keys, other elements are permuted in place
+    struct Reading { int sensor; int seq; };
+    auto readings = functional::sortOn([](const Reading& r) { return r.sensor; }, functional::map([](int i) { return Reading{ (i * 7) % 5, i }; }, functional::range(0, 100)));
+    const bool readingsStable = std::is_sorted(readings.begin(), readings.end(), [](const Reading& a, const Reading& b) { return a.sensor < b.sensor || (a.sensor == b.sensor && a.seq < b.seq); });
+    std::vector<std::string> words { "ccc", "a", "bb", "dddd", "ee" };
+    const std::string* storage = words.data();
+    auto bySize = functional::sortOn([](const std::string& w) { return w.size(); }, std::move(words));
+    functional::apply([](double t) { std::cout << t << " "; }, temperatures);
+    functional::apply(&string::print, names);
+    functional::apply([](const std::string& w) { std::cout << w << " "; }, bySize);
+    std::cout << (byKey == expected ? "equal " : "differ ") << readingsStable << " " << (bySize.data() == storage) << " " << descending.front() << " : " << typeid(names).name() << std::endl;
+}
+
+noinline void testSortParallel()
+{
+    std::cout << "testSortParallel: ";
+    auto keys = functional::map([](int i) { return static_cast<std::int64_t>((i * 2654435761u) % 1000003) - 500000; }, functional::range(0, 200000));
+    auto expected = keys;
+    std::stable_sort(expected.begin(), expected.end());
+    auto radix = functional::sortOn(functional::par, [](std::int64_t k) { return k; }, keys);
+    auto merged = functional::sortBy(functional::par, [](std::int64_t a, std::int64_t b) { return a > b; }, std::move(keys));
+    auto words = functional::sortOn(functional::par, [](std::int64_t k) { return std::to_string(k % 1000); }, expected);
+    std::cout << (radix == expected ? "equal " : "differ ") << (std::equal(merged.rbegin(), merged.rend(), expected.begin()) ? "equal " : "differ ")
+        << std::is_sorted(words.begin(), words.end(), [](std::int64_t a, std::int64_t b) { return std::to_string(a % 1000) < std::to_string(b % 1000); }) << " " << keys.size() << std::endl;
+}
+
+struct SpillRecord
+{
+    int key;
+    int id;
+
+    bool operator== (const SpillRecord& other) const { return key == other.key && id == other.id; }
+};
+
+noinline void testExternalSortSpills()
+{
+    std::cout << "testExternalSortSpills: ";
+    // a 4KB budget spills runs of 512 records, and budgets under three read blocks merge them pairwise
+    auto records = functional::map([](int i) { return SpillRecord{ static_cast<int>((i * 2654435761u) % 1000), i }; }, functional::range(0, 100000));
+    auto expected = records;
+    std::stable_sort(expected.begin(), expected.end(), [](const SpillRecord& a, const SpillRecord& b) { return a.key < b.key; });
+    auto sorted = functional::map([](const SpillRecord& r) { return r; }, functional::externalSortOn([](const SpillRecord& r) { return r.key; }, 4096, records));
+    auto descending = functional::externalSortBy([](int a, int b) { return a > b; }, 1 << 20, functional::range(0, 10));
+    functional::apply([](int a) { std::cout << a << " "; }, descending);
+    std::cout << (sorted == expected ? "equal" : "differ") << std::endl;
+}
+
+noinline void testExternalSortMergePasses()
+{
+    std::cout << "testExternalSortMergePasses: ";
+    auto records = functional::map([](int i) { return SpillRecord{ static_cast<int>((i * 2654435761u) % 100003), i }; }, functional::range(0, 200000));
+    auto expected = records;
+    std::stable_sort(expected.begin(), expected.end(), [](const SpillRecord& a, const SpillRecord& b) { return a.key < b.key; });
+    // three blocks of budget merge two runs at a time, so the 9 runs take three passes before the final merge
+    const std::size_t threeBlocks = 3 * functional_impl::helpers::externalBlockBytes;
+    auto fewRuns = functional::map([](const SpillRecord& r) { return r; }, functional::externalSortOn([](const SpillRecord& r) { return r.key; }, threeBlocks, records));
+    // 256 bytes make thousands of runs, more than a process may have files open, but every pass shares one file
+    auto manyRuns = functional::map([](const SpillRecord& r) { return r; }, functional::externalSortOn([](const SpillRecord& r) { return r.key; }, 256, records));
+    std::cout << (fewRuns == expected ? "equal " : "differ ") << (manyRuns == expected ? "equal" : "differ") << std::endl;
+}
+
+noinline void testExternalFoldFromFile()
+{
+    std::cout << "testExternalFoldFromFile: ";
+    const std::string path = "external_fold.bin";
+    const std::size_t written = functional::writeBinary(path, functional::map([](int i) { return (i * 7919) % 100003; }, functional::range(0, 50000)));
+    auto sums = functional::externalFoldOn([](int a) { return a % 5; }, [](long long sum, int a) { return sum + a; }, 0LL, 1024, functional::readBinary<int>(path));
+    long long expected = 0;
+    functional::apply([&](int i) { expected += (i * 7919) % 100003; }, functional::range(0, 50000));
+    const long long total = functional::foldl([](long long total, const std::pair<int, long long>& group) { std::cout << group.first << " "; return total + group.second; }, 0LL, sums);
+    std::remove(path.c_str());
+    try
+    {
+        functional::readBinary<int>(path);
+    }
+    catch (const std::runtime_error& e)
+    {
+        std::cout << e.what() << " ";
+    }
+    std::cout << written << " " << (total == expected ? "equal" : "differ") << std::endl;
+}
+
+noinline void testMergeJoinSorted()
+{
+    std::cout << "testMergeJoinSorted: ";
+    // customers and orders sorted by customer id, with duplicate ids on both sides
+    std::vector<std::pair<int, string>> customers = { { 1, string("ann") }, { 2, string("bob") }, { 2, string("bea") }, { 4, string("cid") }, { 7, string("dan") } };
+    std::vector<std::pair<int, int>> orders = { { 2, 10 }, { 2, 11 }, { 3, 12 }, { 4, 13 }, { 8, 14 } };
+    auto byId = [](const std::pair<int, string>& c) { return c.first; };
+    auto byCustomer = [](const std::pair<int, int>& o) { return o.first; };
+    functional::apply([](const std::pair<const std::pair<int, string>&, const std::pair<int, int>&>& match) { std::cout << match.first.second << match.second.second << " "; }, functional::mergeJoin(byId, byCustomer, customers, orders));
+    functional::apply([](const std::pair<const std::pair<int, string>&, const std::pair<int, int>*>& match) { std::cout << (match.second ? match.second->second : 0) << " "; }, functional::mergeLeftJoin(byId, byCustomer, customers, orders));
+    functional::apply([](const std::pair<int, string>& c) { std::cout << c.second << " "; }, functional::mergeSemiJoin(byId, byCustomer, customers, orders));
+    auto evens = functional::mergeJoin([](int i) { return i; }, [](int i) { return 2 * i; }, functional::range(0, 10), functional::range(0, 100));
+    std::cout << functional::map([](const std::pair<int, int>& p) { return p.second; }, evens).size() << std::endl;
+}
+
+noinline void testHashJoinPartitioned()
+{
+    std::cout << "testHashJoinPartitioned: ";
+    auto facts = functional::map([](int i) { return std::make_pair(static_cast<int>((i * 2654435761u) % 40000), i); }, functional::range(0, 100000));
+    auto dimension = functional::map([](int i) { return std::make_pair(i * 2, i); }, functional::range(0, 30000));
+    auto factKey = [](const std::pair<int, int>& f) { return f.first; };
+    auto dimensionKey = [](const std::pair<int, int>& d) { return d.first; };
+    auto sumMatches = [](long long sum, const std::pair<const std::pair<int, int>&, const std::pair<int, int>&>& match) { return sum + match.first.second + match.second.second; };
+    const long long serial = functional::foldl(sumMatches, 0LL, functional::hashJoin(factKey, dimensionKey, facts, dimension));
+    const long long parallel = functional::foldl(sumMatches, 0LL, functional::hashJoin(functional::par, factKey, dimensionKey, facts, dimension));
+    const long long merged = functional::foldl(sumMatches, 0LL, functional::mergeJoin(factKey, dimensionKey, functional::sortOn(factKey, facts), dimension));
+    auto unmatched = functional::foldl([](int count, const std::pair<const std::pair<int, int>&, const std::pair<int, int>*>& match) { return count + (match.second ? 0 : 1); }, 0, functional::hashLeftJoin(functional::par, factKey, dimensionKey, facts, dimension));
+    auto duplicated = dimension;
+    duplicated.insert(duplicated.end(), dimension.begin(), dimension.end());
+    auto semi = functional::map([](const std::pair<int, int>& f) { return f.second; }, functional::hashSemiJoin(factKey, dimensionKey, facts, duplicated));
+    std::cout << (serial == parallel && serial == merged ? "equal " : "differ ") << unmatched + semi.size() << " " << std::is_sorted(semi.begin(), semi.end()) << std::endl;
+}
+
+noinline void testSketchFoldl()
+{
+    std::cout << "testSketchFoldl: ";
+    // every id twice, and value v of the skewed stream appears about 1000 / (v + 1) times
+    auto ids = functional::map([](int i) { return (i % 100000) * 7; }, functional::range(0, 200000));
+    auto skewed = functional::map([](int i) { return static_cast<int>(1000.0 / (1 + i % 1000)) % 50; }, functional::range(0, 100000));
+    auto distinct = functional::foldl(functional::sketch::insert, functional::hyperloglog(14), ids);
+    auto latencies = functional::foldl(functional::sketch::insert, functional::tdigest(100), functional::map([](int i) { return static_cast<double>((i * 7919) % 10000); }, functional::range(0, 100000)));
+    auto frequencies = functional::foldl(functional::sketch::insert, functional::count_min(1024, 4), skewed);
+    auto heavy = functional::foldl(functional::sketch::insert, functional::top_k<int>(5), skewed);
+    const std::size_t exactOnes = std::count(skewed.begin(), skewed.end(), 1);
+    std::cout << (std::abs(distinct.estimate() - 100000) < 2000 ? "close " : "far ") << (std::abs(latencies.quantile(0.5) - 5000) < 100 && std::abs(latencies.quantile(0.99) - 9900) < 30 ? "close " : "far ")
+        << (frequencies.estimate(1) >= exactOnes && frequencies.estimate(1) < exactOnes + 200 ? "close " : "far ") << heavy.top().front().value << " " << latencies.size() << " ";
+    // queries don't modify the digest, so threads may read it at once even with values still buffered
+    latencies.insert(5000.0);
+    const functional::tdigest& shared = latencies;
+    auto concurrentMedian = functional::async([&] { return shared.quantile(0.5); });
+    const double median = shared.quantile(0.5);
+    std::cout << (concurrentMedian.get() == median ? "same" : "differ") << std::endl;
+}
+
+noinline void testFoldReferenceStep()
+{
+    std::cout << "testFoldReferenceStep: ";
+    // the accumulator is moved into steps taking it by value, steps taking a non-const reference get it as is
+    const int sum = functional::foldl([](int& acc, int x) { acc += x; return acc; }, 0, v);
+    const std::string digits = functional::foldr([](int x, std::string& acc) -> std::string& { return acc += std::to_string(x); }, std::string(), v);
+    const long parallelSum = functional::foldl(functional::par, [](long& acc, int x) { return acc += x; }, [](long& lhs, long rhs) { return lhs + rhs; }, 0L, v);
+    std::cout << sum << " " << digits << " " << parallelSum << std::endl;
+}
+
+noinline void testSketchParallelMerge()
+{
+    std::cout << "testSketchParallelMerge: ";
+    auto events = functional::map([](int i) { return static_cast<int>((i * 2654435761u) % 50000); }, functional::range(0, 400000));
+    auto serial = functional::foldl(functional::sketch::insert, functional::hyperloglog(12), events);
+    auto parallel = functional::foldl(functional::par, functional::sketch::insert, functional::sketch::merge, functional::hyperloglog(12), events);
+    auto parallelDigest = functional::foldl(functional::par, functional::sketch::insert, functional::sketch::merge, functional::tdigest(), events);
+    auto parallelCounts = functional::foldl(functional::par, functional::sketch::insert, functional::sketch::merge, functional::count_min(), events);
+    auto serialCounts = functional::foldl(functional::sketch::insert, functional::count_min(), events);
+    functional::window_fold<functional::monoid::Sketch<functional::hyperloglog>> recent(4, functional::monoid::Sketch<functional::hyperloglog>(functional::hyperloglog(10)));
+    functional::apply([&](int i) { functional::hyperloglog day(10); functional::apply([&](int j) { day.insert(i * 100 + j); }, functional::range(0, 100)); recent.push(day); }, functional::range(0, 10));
+    std::cout << (serial.estimate() == parallel.estimate() ? "equal " : "differ ") << (serialCounts.estimate(42) == parallelCounts.estimate(42) ? "equal " : "differ ")
+        << (std::abs(parallelDigest.quantile(0.25) - 12500) < 250 ? "close " : "far ") << (std::abs(recent.fold().estimate() - 400) < 20 ? "close" : "far") << std::endl;
+}
+
+noinline void testSplitLinesFields()
+{
+    std::cout << "testSplitLinesFields: ";
+    const std::string log = "GET /a 200 12\r\nPOST  /b 404 7\n\nGET /c 200 30\n";
+    auto toInt = [](functional::string_ref token) { return functional::foldl([](int a, char c) { return a * 10 + (c - '0'); }, 0, token); };
+    auto bytes = functional::map([&](functional::string_ref line) { auto columns = functional::map([](functional::string_ref f) { return f; }, functional::fields(line, ' ')); return columns.empty() ? 0 : toInt(columns.back()); }, functional::lines(log));
+    functional::apply([](functional::string_ref line) { std::cout << "[" << line << "] "; }, functional::lines(log));
+    functional::apply([](functional::string_ref token) { std::cout << "<" << token << "> "; }, functional::split(",a,,b,", ','));
+    const int total = functional::foldl([&](int sum, functional::string_ref token) { return sum + toInt(token); }, 0, functional::fields(" 1  22 333 ", ' '));
+    const std::size_t tokenCount = functional::foldl([](std::size_t n, functional::string_ref) { return n + 1; }, std::size_t(0), functional::split("", ','));
+    std::cout << functional::foldl([](int a, int b) { return a + b; }, 0, bytes) << " " << total << " " << tokenCount << " " << (functional::string_ref(log).substr(4, 2) == "/a") << " : " << typeid(bytes).name() << std::endl;
+}
+
+noinline void testPipelineOrderedStages()
+{
+    std::cout << "testPipelineOrderedStages: ";
+    auto parse = [](int a) { return string(std::to_string(a)); };
+    auto enrich = [](const string& s) { return s.to_int() * 3; };
+    auto input = functional::map([](int a) { return a; }, functional::range(0, 10000));
+    auto staged = functional::pipeline(input, 64, 4).stage(parse, 2).stage(enrich, 3).ordered().collect();
+    auto expected = functional::map(enrich, functional::map(parse, input));
+    auto sum = functional::pipeline(functional::range(0, 10000), 100).stage([](int a) { return static_cast<long>(a) * 2; }, 4).foldl([](long acc, long a) { return acc + a; }, 0L);
+    auto refSum = functional::pipeline(functional::range(0, 10000), 100).foldl([](long& acc, int a) { return acc += a; }, 0L);
+    auto numbers = functional::pipeline(vs).stage(&string::to_int).collect();
+    std::cout << (staged == expected ? "equal " : "differ ") << staged.size() << " " << sum << " " << refSum << " " << numbers.size() << " : " << typeid(staged).name() << std::endl;
+}
+
+noinline void testPipelineException()
+{
+    std::cout << "testPipelineException: ";
+    auto input = functional::map([](int a) { return a; }, functional::range(0, 10000));
+    auto failingStage = [](int a) -> int
+    {
+        if (a == 5000)
+        {
+            throw std::runtime_error("stage failed");
+        }
+        return a;
+    };
+    try
+    {
+        functional::pipeline(input, 64, 4).stage(failingStage, 3).stage([](int a) { return a + 1; }, 2).ordered().collect();
+        std::cout << "no exception";
+    }
+    catch (const std::runtime_error& e)
+    {
+        std::cout << e.what();
+    }
+    try
+    {
+        functional::pipeline(input, 64, 4).stage([](int a) { return a * 2; }, 2).foldl([](long acc, int a) -> long
+        {
+            if (a > 10000)
+            {
+                throw std::runtime_error("sink failed");
+            }
+            return acc + a;
+        }, 0L);
+        std::cout << " no exception";
+    }
+    catch (const std::runtime_error& e)
+    {
+        std::cout << ", " << e.what();
+    }
+    std::cout << std::endl;
+}
+
+noinline void testProcessParallelMap()
+{
+    std::cout << "testProcessParallelMap: ";
+    auto input = functional::map([](int a) { return a; }, functional::range(0, 5000));
+    auto squares = functional::map(functional::proc_par.workers(3), [](int a) { return static_cast<double>(a) * a; }, input);
+    std::list<int> values(input.begin(), input.end());
+    functional::apply(functional::proc_par.workers(2).batch(100), [](int& a) { a = -a; }, values);
+    std::cout << (squares == functional::map([](int a) { return static_cast<double>(a) * a; }, input) ? "equal " : "differ ") << squares.size() << " "
+        << functional::foldl([](int acc, int a) { return acc + a; }, 0, values) << " : " << typeid(squares).name() << std::endl;
+}
+
+noinline void testProcessParallelRestart()
+{
+    std::cout << "testProcessParallelRestart: ";
+#if defined(__unix__) || defined(__APPLE__)
+    // the first worker to see 500 dies, its replacement redoes the chunk
+    static functional_impl::helpers::SharedArray<std::atomic<int>> crashes(1);
+    auto input = functional::map([](int a) { return a; }, functional::range(0, 2000));
+    auto doubled = functional::map(functional::proc_par.workers(4).batch(64), [](int a) { if (a == 500 && crashes[0]++ == 0) { std::abort(); } return a * 2; }, input);
+    std::cout << (doubled == functional::map([](int a) { return a * 2; }, input) ? "equal " : "differ ") << crashes[0] << " ";
+    // a worker that throws dies like one that crashes, and a chunk failing every retry fails the map
+    try
+    {
+        functional::map(functional::proc_par.workers(2).batch(64).retries(1), [](int a) { if (a == 1000) { throw std::runtime_error("bad input"); } return a; }, input);
+        std::cout << "no exception";
+    }
+    catch (const functional::process_failure& e)
+    {
+        std::cout << e.what();
+    }
+    // apply copies back the chunks that succeeded before it throws for the ones that didn't
+    auto inout = input;
+    try
+    {
+        functional::apply(functional::proc_par.workers(2).batch(64).retries(1), [](int& a) { if (a == 1000) { throw std::runtime_error("bad input"); } a = -a; }, inout);
+        std::cout << " no exception";
+    }
+    catch (const functional::process_failure& e)
+    {
+        std::cout << " " << e.what() << " " << inout[959] << " " << inout[1000] << " " << inout[1024];
+    }
+    std::cout << std::endl;
+#else
+    std::cout << "no fork" << std::endl;
+#endif
+}
+
+noinline void testMemoizeRepeatedInputs()
+{
+    std::cout << "testMemoizeRepeatedInputs: ";
+    static std::atomic<int> computed(0);
+    auto slowSquare = functional::memoize([](int a) { ++computed; return a * a; }, 16);
+    auto repeated = functional::map([](int i) { return i % 10; }, functional::range(0, 99));
+    auto squares = functional::map(slowSquare, repeated);
+    auto parsed = functional::memoize([](const std::string& s) { return atoi(s.c_str()); }, 4);
+    functional::apply([&](const string& s) { parsed(s); }, vs);
+    functional::apply([&](const string& s) { parsed(s); }, vs);
+    auto stats = slowSquare.stats();
+    std::cout << computed << " " << stats.hits << " " << stats.misses << " " << stats.evictions << " " << functional::foldl([](int a, int b) { return a + b; }, 0, squares) << " "
+        << parsed.stats().hits << " " << parsed.size() << " ";
+    try
+    {
+        functional::memoize([](int a) { return a; }, 0);
+    }
+    catch (const std::invalid_argument& e)
+    {
+        std::cout << e.what();
+    }
+    std::cout << " : " << typeid(squares).name() << std::endl;
+}
+
+noinline void testMemoizeEvictionParallel()
+{
+    std::cout << "testMemoizeEvictionParallel: ";
+    auto cube = functional::memoize([](int a) { return static_cast<long long>(a) * a * a; }, 1024);
+    auto input = functional::map([](int i) { return (i * 7919) % 3000; }, functional::range(0, 19999));
+    auto cubes = functional::mapBatched(functional::par, [=](const functional::Chunk<const int*>& batch) { return functional::map(cube, batch); }, input, 512);
+    auto stats = cube.stats();
+    std::cout << (cubes == functional::map([](int a) { return static_cast<long long>(a) * a * a; }, input) ? "equal " : "differ ") << (stats.hits + stats.misses) << " " << (stats.evictions > 0) << " " << (cube.size() <= 1024) << std::endl;
+}
+
+noinline void testInstrumentation()
+{
+    std::cout << "testInstrumentation: ";
+    functional::instrumentation::reset();
+    auto res = functional::map([](int a) { return a * 2; }, v);
+    functional::foldl([](int a, int b) { return a + b; }, 0, res);
+    for (const auto& stats : functional::instrumentation::snapshot())
+    {
+        if (stats.calls > 0 && stats.combinator != "worker")
+        {
+            std::cout << stats.combinator << " calls=" << stats.calls << " elements=" << stats.elements << " bytes=" << stats.bytesAllocated << " ";
+        }
+    }
+    std::cout << ": " << functional::instrumentation::snapshot().size() << " sites" << std::endl;
+}
+
+noinline void testChromeTrace()
+{
+    std::cout << "testChromeTrace: ";
+    functional::trace::clear();
+    functional::mapAsync([](int a) { return functional::async([a] { return a; }); }, v, 2);
+    std::stringstream json;
+    functional::trace::writeChromeTrace(json);
+    std::cout << std::count(std::istreambuf_iterator<char>(json), std::istreambuf_iterator<char>(), '\n') << " lines" << std::endl;
+}
+
+volatile std::size_t benchmarkSink;
+
+// runs fun repeatedly and reports time and, where the kernel permits, hardware counters per element
+template<typename Fun>
+noinline void benchmark(const char* name, std::size_t elements, Fun fun)
+{
+    const int repetitions = 10;
+    functional::PerfCounters counters;
+    fun();
+    auto start = std::chrono::steady_clock::now();
+    counters.start();
+    for (int i = 0; i < repetitions; ++i)
+    {
+        fun();
+    }
+    counters.stop();
+    auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+    const double perElement = 1.0 / (double(repetitions) * elements);
+
+    std::cout << std::left << std::setw(28) << name << std::right << std::fixed << std::setprecision(2) << std::setw(10) << elapsed * perElement << " ns";
+    for (int counter = 0; counter < functional::PerfCounters::CounterCount; ++counter)
+    {
+        auto c = static_cast<functional::PerfCounters::Counter>(counter);
+        std::cout << std::setw(16) << functional::PerfCounters::name(c) << " ";
+        if (counters.available(c))
+        {
+            std::cout << std::setw(8) << counters[c] * perElement;
+        }
+        else
+        {
+            std::cout << std::setw(8) << "n/a";
+        }
+    }
+    std::cout << std::endl;
+}
+
+noinline void runBenchmarks()
+{
+    const std::size_t n = 1 << 20;
+    std::vector<int> bv(n, 1);
+    std::list<int> bl(bv.begin(), bv.end());
+    std::vector<string> bvs(n / 16, string("12"));
+    std::list<string> bls(bvs.begin(), bvs.end());
+
+    std::cout << "per element, counters " << (functional::PerfCounters().available() ? "enabled" : "unavailable (perf_event_open not permitted or not supported)") << std::endl;
+    benchmark("map vector lambda", n, [&] { benchmarkSink = functional::map([](int a) { return a + 1; }, bv).size(); });
+    benchmark("map list lambda", n, [&] { benchmarkSink = functional::map([](int a) { return a + 1; }, bl).size(); });
+    benchmark("map vector memberFn", n / 16, [&] { benchmarkSink = functional::map(&string::to_int, bvs).size(); });
+    benchmark("map list memberFn", n / 16, [&] { benchmarkSink = functional::map(&string::to_int, bls).size(); });
+    benchmark("foldl vector lambda", n, [&] { benchmarkSink = functional::foldl([](int a, int b) { return a + b; }, 0, bv); });
+    benchmark("foldl list lambda", n, [&] { benchmarkSink = functional::foldl([](int a, int b) { return a + b; }, 0, bl); });
+    benchmark("apply vector lambda", n, [&] { functional::apply([](int& a) { ++a; }, bv); });
+    benchmark("apply list lambda", n, [&] { functional::apply([](int& a) { ++a; }, bl); });
+    functional::persistent_vector<int> bpv(bv.begin(), bv.end());
+    benchmark("foldl persistent lambda", n, [&] { benchmarkSink = functional::foldl([](int a, int b) { return a + b; }, 0, bpv); });
+    benchmark("map persistent lambda", n, [&] { benchmarkSink = functional::map([](int a) { return a + 1; }, bpv).size(); });
+    std::vector<int> unsorted = functional::map([](int i) { return static_cast<int>((i * 2654435761u) >> 8); }, functional::range(0, static_cast<int>(n)));
+    benchmark("std::sort vector", n, [&] { auto copy = unsorted; std::sort(copy.begin(), copy.end()); benchmarkSink = copy[0]; });
+    benchmark("sortOn vector radix", n, [&] { benchmarkSink = functional::sortOn([](int a) { return a; }, unsorted)[0]; });
+    benchmark("sortOn par vector", n, [&] { benchmarkSink = functional::sortOn(functional::par, [](int a) { return a; }, unsorted)[0]; });
+    std::vector<int> keys = functional::map([](int i) { return i; }, functional::range(0, static_cast<int>(n)));
+    auto countMatches = [](int count, const std::pair<const int&, const int&>&) { return count + 1; };
+    benchmark("std::map join vector", n, [&] { std::map<int, int> index; for (int k : keys) { index.emplace(k, k); } int count = 0; for (int k : unsorted) { count += static_cast<int>(index.count(k)); } benchmarkSink = count; });
+    benchmark("hashJoin vector vector", n, [&] { benchmarkSink = functional::foldl(countMatches, 0, functional::hashJoin([](int a) { return a; }, [](int a) { return a; }, unsorted, keys)); });
+    benchmark("hashJoin par vector vector", n, [&] { benchmarkSink = functional::foldl(countMatches, 0, functional::hashJoin(functional::par, [](int a) { return a; }, [](int a) { return a; }, unsorted, keys)); });
+    benchmark("mergeJoin vector vector", n, [&] { benchmarkSink = functional::foldl(countMatches, 0, functional::mergeJoin([](int a) { return a; }, [](int a) { return a; }, keys, keys)); });
+    benchmark("foldl hyperloglog vector", n, [&] { benchmarkSink = static_cast<int>(functional::foldl(functional::sketch::insert, functional::hyperloglog(14), unsorted).estimate()); });
+    benchmark("foldl par hyperloglog vector", n, [&] { benchmarkSink = static_cast<int>(functional::foldl(functional::par, functional::sketch::insert, functional::sketch::merge, functional::hyperloglog(14), unsorted).estimate()); });
+    std::string logText;
+    functional::apply([&](int i) { logText += "GET /index.html 200 " + std::to_string(i) + "\n"; }, functional::range(0, static_cast<int>(n / 16)));
+    benchmark("getline tokens per line", n / 16, [&] { std::istringstream in(logText); std::string line, token; int count = 0; while (std::getline(in, line)) { std::istringstream fieldsIn(line); while (fieldsIn >> token) { ++count; } } benchmarkSink = count; });
+    benchmark("lines fields per line", n / 16, [&] { benchmarkSink = functional::foldl([](int count, functional::string_ref line) { return functional::foldl([](int c, functional::string_ref) { return c + 1; }, count, functional::fields(line, ' ')); }, 0, functional::lines(logText)); });
+    benchmark("zipWith vector vector", n, [&] { benchmarkSink = functional::zipWith([](int a, int b) { return a * b; }, bv, bv).size(); });
+}
+
+noinline void testAllocations()
+{
+    std::cout << "testAllocations: ";
+    static functional::window_fold<functional::monoid::Max<int>> window(3);
+    static const functional::persistent_vector<int> persistent(functional::range(0, 1000).begin(), functional::range(0, 1000).end());
+    static const functional::persistent_map<int, int> persistentMap { { 1, 1 }, { 2, 2 }, { 3, 3 } };
+    expectAllocations("mapVector", 1, [] { functional::map([](int a) { return a + 1; }, v); });
+    expectAllocations("mapList", 4, [] { functional::map([](int a) { return a + 1; }, l); });
+    expectAllocations("mapArray", 0, [] { functional::map([](int a) { return a + 1; }, a); });
+    expectAllocations("mapSmall", 0, [] { functional::map<functional::_Small<8>>([](int a) { return a + 1; }, v); });
+    expectAllocations("mapRange", 1, [] { functional::map([](int a) { return a + 1; }, functional::range(0, 100)); });
+    expectAllocations("zipWith", 1, [] { functional::zipWith([](int a, int b) { return a + b; }, v, v); });
+    expectAllocations("concatMapHint", 1, [] { functional::concatMap([](int a) { return functional::range(0, a); }, v, [](int a) { return a; }); });
+    expectAllocations("zip", 0, [] { functional::zip(v, vs, a); });
+    expectAllocations("foldl", 0, [] { benchmarkSink = functional::foldl([](int a, int b) { return a + b; }, 0, v); });
+    expectAllocations("foldlFields", 0, [] { benchmarkSink = functional::foldl([](int n, functional::string_ref field) { return n + static_cast<int>(field.size()); }, 0, functional::fields("GET /index.html 200 5120", ' ')); });
+    expectAllocations("foldlTake", 0, [] { benchmarkSink = functional::foldl([](int a, int b) { return a + b; }, 0, functional::take(10, functional::iterate([](int a) { return a + 1; }, 0))); });
+    expectAllocations("transduce", 0, [] { benchmarkSink = functional::transduce(functional::xform::compose(functional::xform::map([](int a) { return a * 2; }), functional::xform::take(3)), [](int acc, int a) { return acc + a; }, 0, v); });
+    expectAllocations("windowFold", 0, [] { for (int i = 0; i < 100; ++i) { window.push(i % 7); benchmarkSink = window.fold(); } });
+    expectAllocations("persistentMapFind", 0, [] { benchmarkSink = *persistentMap.find(2); });
+    expectAllocations("persistentUpdate", 4, [] { benchmarkSink = persistent.updated(500, -1)[500]; });
+    expectAllocations("apply", 0, [] { functional::apply([](int a) { benchmarkSink = a; }, v); });
+    expectAllocations("applyBatched", 0, [] { functional::applyBatched([](const functional::Chunk<int*>& batch) { benchmarkSink = batch.size(); }, v, 3); });
+    expectAllocations("curry", 0, [] { functional::curry([](std::tuple<int, int, int, int> tup) { benchmarkSink = std::get<3>(tup); })(1, 2, 3, 4); });
+    expectAllocations("uncurry", 0, [] { functional::uncurry([](int, int, int, int i4) { benchmarkSink = i4; })(t); });
+    std::cout << std::endl;
+}
+
 int main(const int argc, const char* argv[])
 {
     ba.fill(string("-"));
 
+    if (argc > 1 && std::string(argv[1]) == "--bench")
+    {
+        runBenchmarks();
+        return 0;
+    }
+
     testApplyVectorLambda();
     testApplyVectorMemberFn();
     testApplyVectorFunctionPtr();
@@ -493,6 +1507,7 @@ int main(const int argc, const char* argv[])
     testMapArrayLambda();
     testMapArrayMemberFn();
     testMapArrayFunctionPtr();
+    testMapLargeArray();
     testMapArrayLambdaExplicitSize();
 
     testMapVector2ListLambda();
@@ -500,6 +1515,7 @@ int main(const int argc, const char* argv[])
     testMapArray2VectorLambda();
     testMapArray2ListLambda();
     testMapVector2ArrayLambda();
+    testMapArrayNoDefaultConstructor();
 
     testCurryFunctionPtr();
     testCurryLambda();
@@ -509,6 +1525,83 @@ int main(const int argc, const char* argv[])
     testUnCurryMemberFnNoParam();
     testUnCurryMemberFnParam();
 
+    testMapAsyncVectorTask();
+    testMapAsyncListStdFuture();
+    testTaskThen();
+    testTaskException();
+
+    testTakeUnfoldFibonacci();
+    testTakeWhileIterate();
+    testTakeRepeatCycle();
+    testGenerator();
+
+    testSoaColumnFoldl();
+    testSoaColumnsZipWith();
+    testUnzip();
+
+    testZipVectorArrayRange();
+    testZipWith3ListLambda();
+    testZipWithArrayExplicitVector();
+
+    testMapSmallVector();
+    testZipWithSmallVectorSpill();
+    testSmallVectorGrowThrow();
+
+    testApplyBatchedMutableVector();
+    testMapBatchedList();
+    testMapBatchedArray();
+    testMapBatchedParallel();
+    testMapBatchedParallelException();
+
+    testConcatMapVector();
+    testConcatMapListSizeHint();
+    testJoin();
+    testConcatMapParallel();
+
+    testTransduceSinks();
+
+    testWindowFoldMinSum();
+    testSlidingWindowListStep();
+
+    testSortOnStable();
+    testSortParallel();
+
+    testExternalSortSpills();
+    testExternalSortMergePasses();
+    testExternalFoldFromFile();
+
+    testMergeJoinSorted();
+    testHashJoinPartitioned();
+
+    testSketchFoldl();
+    testFoldReferenceStep();
+    testSketchParallelMerge();
+
+    testSplitLinesFields();
+
+    testPipelineOrderedStages();
+    testPipelineException();
+    testProcessParallelMap();
+    testProcessParallelRestart();
+
+    testMemoizeRepeatedInputs();
+    testMemoizeEvictionParallel();
+
+    testLazyForcedOnTouch();
+    testLazySharedAcrossThreads();
+
+    testPersistentVectorSharing();
+    testPersistentMapSharing();
+    testPersistentMapCollisions();
+
+    testInstrumentation();
+    testChromeTrace();
+
+    // the probes allocate their records on first use, which would skew the counts
+#if !defined(FUNCTIONAL_INSTRUMENTATION) && !defined(FUNCTIONAL_TRACE)
+    testAllocations();
+#endif
+
     auto sum1 = functional::foldr([] (int a, int b) { return a + b; }, 0, v);
     auto sum2 = functional::foldl([] (int a, int b) { return a + b; }, 0, v);
     auto sum3 = functional::foldl([] (int a, int b) { return a + b; }, 0, l);
@@ -548,5 +1641,5 @@ int main(const int argc, const char* argv[])
     auto v12 = functional::zip(v, v);
     auto v1and2 = functional::zipWith([](int a, int b) { return a + b; }, v, v);
 
-    return 0;
+    return failedChecks == 0 ? 0 : 1;
 }
@@ -0,0 +1,346 @@
+/*
+Copyright (c) 2013 Janick Bernet
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#ifndef _MEMOIZE_HPP_
+#define _MEMOIZE_HPP_
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "functional.hpp"
+
+namespace functional_impl
+{
+    namespace helpers
+    {
+        template<typename Key, typename Fun>
+        struct memo_key_t;
+    }
+};
+
+namespace functional
+{
+    struct memo_stats
+    {
+        std::uint64_t hits;
+        std::uint64_t misses;
+        std::uint64_t evictions;
+    };
+
+    // a callable remembering the results of fun for up to capacity arguments; copies share the cache,
+    // which is split into independently locked shards so concurrent callers rarely contend
+    template<typename Key, typename Fun, typename Hash = std::hash<Key>>
+    class memoized;
+
+    // throws std::invalid_argument for a capacity of 0
+    //! memoize :: (a -> b) -> Int -> (a -> b)
+    template<typename Key = _Derived, typename Fun>
+    auto memoize(Fun fun, std::size_t capacity) -> memoized<typename functional_impl::helpers::memo_key_t<Key, Fun>::type, Fun>;
+};
+
+namespace functional_impl
+{
+    namespace helpers
+    {
+        // the parameter of a unary callable, or the object for member functions without parameters
+        template<typename Fun>
+        struct argument_of : argument_of<decltype(&Fun::operator())> {};
+
+        template<typename ReturnType, typename Arg>
+        struct argument_of<ReturnType(*)(Arg)> { typedef Arg type; };
+
+        template<typename ReturnType, typename Arg>
+        struct argument_of<ReturnType(Arg)> { typedef Arg type; };
+
+        template<typename ReturnType, typename ValueType, typename Arg>
+        struct argument_of<ReturnType(ValueType::*)(Arg)> { typedef Arg type; };
+
+        template<typename ReturnType, typename ValueType, typename Arg>
+        struct argument_of<ReturnType(ValueType::*)(Arg) const> { typedef Arg type; };
+
+        template<typename ReturnType, typename ValueType>
+        struct argument_of<ReturnType(ValueType::*)()> { typedef ValueType type; };
+
+        template<typename ReturnType, typename ValueType>
+        struct argument_of<ReturnType(ValueType::*)() const> { typedef ValueType type; };
+
+        // the cache key: the explicitly given type or the decayed parameter of fun
+        template<typename Key, typename Fun>
+        struct memo_key_t
+        {
+            typedef Key type;
+        };
+
+        template<typename Fun>
+        struct memo_key_t<functional::_Derived, Fun>
+        {
+            typedef typename std::decay<typename argument_of<Fun>::type>::type type;
+        };
+
+        // per shard open hashing with chains through the entries and CLOCK eviction: a hit only sets the
+        // entry's reference bit, the hand evicts the first entry not referenced since it last passed
+        template<typename Key, typename Value>
+        class MemoShard
+        {
+            static const std::uint32_t None = ~std::uint32_t(0);
+
+            struct Entry
+            {
+                Key key;
+                Value value;
+                std::size_t hash;
+                std::uint32_t next;
+                bool referenced;
+            };
+
+        public:
+            std::mutex mutex;
+
+            void init(std::size_t capacity)
+            {
+                std::size_t buckets = 1;
+                while (buckets < capacity)
+                {
+                    buckets *= 2;
+                }
+                m_capacity = capacity;
+                m_buckets.assign(buckets, std::uint32_t(None));
+                m_entries.reserve(capacity);
+                m_hand = 0;
+            }
+
+            std::size_t size() const { return m_entries.size(); }
+
+            template<typename Arg>
+            const Value* find(std::size_t hash, const Arg& arg)
+            {
+                for (std::uint32_t pos = m_buckets[hash & (m_buckets.size() - 1)]; pos != None; pos = m_entries[pos].next)
+                {
+                    Entry& entry = m_entries[pos];
+                    if (entry.hash == hash && entry.key == arg)
+                    {
+                        entry.referenced = true;
+                        return &entry.value;
+                    }
+                }
+                return nullptr;
+            }
+
+            // returns whether an entry was evicted, keeps the present entry if another caller was faster
+            bool insert(std::size_t hash, Key key, const Value& value)
+            {
+                if (find(hash, key))
+                {
+                    return false;
+                }
+                std::uint32_t& bucket = m_buckets[hash & (m_buckets.size() - 1)];
+                if (m_entries.size() < m_capacity)
+                {
+                    m_entries.push_back(Entry{ std::move(key), value, hash, bucket, false });
+                    bucket = static_cast<std::uint32_t>(m_entries.size() - 1);
+                    return false;
+                }
+
+                while (m_entries[m_hand].referenced)
+                {
+                    m_entries[m_hand].referenced = false;
+                    m_hand = (m_hand + 1) % m_capacity;
+                }
+                const std::uint32_t victim = static_cast<std::uint32_t>(m_hand);
+                m_hand = (m_hand + 1) % m_capacity;
+                unlink(victim);
+                m_entries[victim] = Entry{ std::move(key), value, hash, bucket, false };
+                bucket = victim;
+                return true;
+            }
+
+            void clear()
+            {
+                m_entries.clear();
+                std::fill(m_buckets.begin(), m_buckets.end(), std::uint32_t(None));
+                m_hand = 0;
+            }
+
+        private:
+            void unlink(std::uint32_t victim)
+            {
+                std::uint32_t* link = &m_buckets[m_entries[victim].hash & (m_buckets.size() - 1)];
+                while (*link != victim)
+                {
+                    link = &m_entries[*link].next;
+                }
+                *link = m_entries[victim].next;
+            }
+
+            std::size_t m_capacity;
+            std::size_t m_hand;
+            std::vector<std::uint32_t> m_buckets;
+            std::vector<Entry> m_entries;
+        };
+
+        template<typename Key, typename Value, typename Fun, typename Hash>
+        class MemoCache
+        {
+        public:
+            MemoCache(Fun fun, std::size_t capacity, Hash hash)
+                : m_fun{ std::move(fun) }
+                , m_hash(std::move(hash))
+                , m_shardCount(shardCount(capacity))
+                , m_shards(new MemoShard<Key, Value>[m_shardCount])
+                , m_hits(0)
+                , m_misses(0)
+                , m_evictions(0)
+            {
+                if (capacity == 0)
+                {
+                    throw std::invalid_argument("memoize: capacity must be positive");
+                }
+                for (std::size_t i = 0; i < m_shardCount; ++i)
+                {
+                    m_shards[i].init((capacity + m_shardCount - 1) / m_shardCount);
+                }
+            }
+
+            // fun runs outside the shard lock, so a slow miss doesn't block hits on the same shard
+            template<typename Arg>
+            Value get(const Arg& arg)
+            {
+                const std::size_t hash = m_hash(arg);
+                auto& shard = m_shards[shardOf(hash)];
+                {
+                    std::lock_guard<std::mutex> lock(shard.mutex);
+                    if (const Value* value = shard.find(hash, arg))
+                    {
+                        m_hits.fetch_add(1, std::memory_order_relaxed);
+                        return *value;
+                    }
+                }
+                m_misses.fetch_add(1, std::memory_order_relaxed);
+
+                Key key(arg);
+                Value value(m_fun(key));
+                std::lock_guard<std::mutex> lock(shard.mutex);
+                if (shard.insert(hash, std::move(key), value))
+                {
+                    m_evictions.fetch_add(1, std::memory_order_relaxed);
+                }
+                return value;
+            }
+
+            functional::memo_stats stats() const
+            {
+                return functional::memo_stats{ m_hits.load(), m_misses.load(), m_evictions.load() };
+            }
+
+            std::size_t size()
+            {
+                std::size_t size = 0;
+                for (std::size_t i = 0; i < m_shardCount; ++i)
+                {
+                    std::lock_guard<std::mutex> lock(m_shards[i].mutex);
+                    size += m_shards[i].size();
+                }
+                return size;
+            }
+
+            void clear()
+            {
+                for (std::size_t i = 0; i < m_shardCount; ++i)
+                {
+                    std::lock_guard<std::mutex> lock(m_shards[i].mutex);
+                    m_shards[i].clear();
+                }
+            }
+
+        private:
+            // up to 64 shards of at least 128 entries each, so small caches stay close to a global CLOCK
+            static std::size_t shardCount(std::size_t capacity)
+            {
+                std::size_t shards = 1;
+                while (shards < 64 && shards * 128 <= capacity)
+                {
+                    shards *= 2;
+                }
+                return shards;
+            }
+
+            // the high bits of a multiplicative hash, independent of the low bits picking the bucket
+            std::size_t shardOf(std::size_t hash) const
+            {
+                return static_cast<std::size_t>((std::uint64_t(hash) * 0x9E3779B97F4A7C15ull) >> 58) & (m_shardCount - 1);
+            }
+
+            const Applicator<Fun> m_fun;
+            const Hash m_hash;
+            const std::size_t m_shardCount;
+            std::unique_ptr<MemoShard<Key, Value>[]> m_shards;
+            std::atomic<std::uint64_t> m_hits;
+            std::atomic<std::uint64_t> m_misses;
+            std::atomic<std::uint64_t> m_evictions;
+        };
+    }
+};
+
+template<typename Key, typename Fun, typename Hash>
+class functional::memoized
+{
+public:
+    typedef Key key_type;
+    typedef typename std::decay<decltype(std::declval<const functional_impl::helpers::Applicator<Fun>&>()(std::declval<Key&>()))>::type value_type;
+
+    memoized(Fun fun, std::size_t capacity, Hash hash = Hash())
+        : m_cache(std::make_shared<functional_impl::helpers::MemoCache<Key, value_type, Fun, Hash>>(std::move(fun), capacity, std::move(hash)))
+    {
+    }
+
+    // arguments are hashed and compared as they are, a Key is only constructed to store a new result
+    // (so a Hash accepting other types than Key allows lookups without conversion)
+    template<typename Arg>
+    value_type operator() (const Arg& arg) const
+    {
+        return m_cache->get(arg);
+    }
+
+    memo_stats stats() const { return m_cache->stats(); }
+    std::size_t size() const { return m_cache->size(); }
+    void clear() const { m_cache->clear(); }
+
+private:
+    std::shared_ptr<functional_impl::helpers::MemoCache<Key, value_type, Fun, Hash>> m_cache;
+};
+
+template<typename Key, typename Fun>
+auto functional::memoize(Fun fun, std::size_t capacity) -> memoized<typename functional_impl::helpers::memo_key_t<Key, Fun>::type, Fun>
+{
+    return memoized<typename functional_impl::helpers::memo_key_t<Key, Fun>::type, Fun>(std::move(fun), capacity);
+}
+
+#endif // _MEMOIZE_HPP_
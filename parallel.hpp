@@ -0,0 +1,366 @@
+/*
+Copyright (c) 2013 Janick Bernet
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#ifndef _PARALLEL_HPP_
+#define _PARALLEL_HPP_
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <mutex>
+#include <numeric>
+#include <vector>
+
+#include "executor.hpp"
+
+namespace functional_impl
+{
+    namespace helpers
+    {
+        // the parallel concatMap fills its output by index, so it collects into a vector unless given explicitly
+        template<typename ResultContainerExplicit, typename InputContainer, typename Fun>
+        struct parallel_concat_t
+        {
+            typedef typename concat_map_t<ResultContainerExplicit, InputContainer, Fun>::result_type result_type;
+            typedef typename derive_container<ResultContainerExplicit, std::vector<result_type>, result_type>::type type;
+        };
+    }
+};
+
+namespace functional
+{
+    // execution policy running a combinator on an executor (the default one unless set with on());
+    // combinators called with it must not be called from a job of that same executor
+    class parallel_policy;
+
+    //! applyBatched :: Par -> ([a] -> ()) -> [a] -> Int -> ()
+    template<typename Fun, typename Iteratable>
+    void applyBatched(const parallel_policy& policy, Fun fun, Iteratable&& inout, std::size_t batchSize);
+
+    //! mapBatched :: Par -> ([a] -> [b]) -> [a] -> Int -> [b]
+    template<typename ResultContainer = _Derived, typename Fun, typename Container>
+    auto mapBatched(const parallel_policy& policy, Fun fun, const Container& input, std::size_t batchSize) -> decltype(functional_impl::mapBatched<ResultContainer>(fun, input, batchSize));
+
+    //! concatMap :: Par -> (a -> [b]) -> [a] -> [b]
+    template<typename ResultContainer = _Derived, typename Fun, typename Container>
+    auto concatMap(const parallel_policy& policy, Fun fun, const Container& input) -> typename functional_impl::helpers::parallel_concat_t<ResultContainer, Container, Fun>::type;
+
+    //! foldl :: Par -> (b -> a -> b) -> (b -> b -> b) -> b -> [a] -> b
+    template<typename Fun, typename Combine, typename ResultType, typename Container>
+    ResultType foldl(const parallel_policy& policy, Fun fun, Combine combine, ResultType neutralValue, const Container& input);
+};
+
+class functional::parallel_policy
+{
+public:
+    explicit parallel_policy(Executor* executor = nullptr)
+        : m_executor(executor)
+    {
+    }
+
+    parallel_policy on(Executor& executor) const
+    {
+        return parallel_policy(&executor);
+    }
+
+    Executor& executor() const
+    {
+        return m_executor ? *m_executor : defaultExecutor();
+    }
+
+private:
+    Executor* m_executor;
+};
+
+namespace functional
+{
+    static const parallel_policy par;
+};
+
+namespace functional_impl
+{
+    namespace helpers
+    {
+        // counts finished jobs down to zero, waking the thread that waits for all of them
+        class Latch
+        {
+        public:
+            explicit Latch(std::size_t count)
+                : m_count(count)
+            {
+            }
+
+            void countDown()
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                if (--m_count == 0)
+                {
+                    m_done.notify_all();
+                }
+            }
+
+            void wait()
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_done.wait(lock, [this] { return m_count == 0; });
+            }
+
+        private:
+            std::mutex m_mutex;
+            std::condition_variable m_done;
+            std::size_t m_count;
+        };
+
+        // calls body(i) for every i in [0, count) on the executor and returns once all calls are done;
+        // consecutive indices are grouped into a few jobs per worker to keep the queue short.
+        // A job stops at the first exception its body throws; the first one of all jobs is rethrown here
+        template<typename Body>
+        inline void parallelFor(Executor& executor, std::size_t count, const Body& body)
+        {
+            if (count == 0)
+            {
+                return;
+            }
+            const std::size_t jobs = std::min(count, executor.concurrency() * 4);
+            Latch latch(jobs);
+            std::mutex errorMutex;
+            std::exception_ptr error;
+            for (std::size_t job = 0; job < jobs; ++job)
+            {
+                const std::size_t first = count * job / jobs;
+                const std::size_t last = count * (job + 1) / jobs;
+                executor.submit([&body, &latch, &errorMutex, &error, first, last]
+                {
+                    try
+                    {
+                        for (std::size_t i = first; i < last; ++i)
+                        {
+                            FUNCTIONAL_TRACE_SCOPE("batch");
+                            body(i);
+                        }
+                    }
+                    catch (...)
+                    {
+                        std::lock_guard<std::mutex> lock(errorMutex);
+                        if (!error)
+                        {
+                            error = std::current_exception();
+                        }
+                    }
+                    latch.countDown();
+                });
+            }
+            latch.wait();
+            if (error)
+            {
+                std::rethrow_exception(error);
+            }
+        }
+
+        template<typename Chunks, typename Container>
+        inline auto reserveChunks(Chunks& chunks, const Container& container, std::size_t batchSize, int) -> decltype(chunks.reserve(container.size()))
+        {
+            chunks.reserve((container.size() + batchSize - 1) / batchSize);
+        }
+
+        template<typename Chunks, typename Container>
+        inline void reserveChunks(Chunks&, const Container&, std::size_t, long)
+        {
+        }
+
+        // the chunks of a container, cut up front so the workers can pick them by index
+        template<typename Container>
+        inline std::vector<typename chunk_t<Container>::type> chunks(Container& container, std::size_t batchSize)
+        {
+            typedef typename chunk_t<Container>::type ChunkType;
+
+            assert(batchSize > 0);
+            batchSize = batchSize > 0 ? batchSize : 1;
+            std::vector<ChunkType> result;
+            reserveChunks(result, container, batchSize, 0);
+            forEachChunk(container, batchSize, [&](const ChunkType& chunk) { result.push_back(chunk); });
+            return result;
+        }
+    }
+
+    namespace helpers
+    {
+        // batch size giving a few batches per worker, for combinators that don't take one
+        template<typename Container>
+        inline std::size_t defaultBatchSize(const Executor& executor, const Container& container)
+        {
+            const std::size_t batches = executor.concurrency() * 4;
+            return std::max<std::size_t>(1, (iteratableSize(container, 0) + batches - 1) / batches);
+        }
+    }
+
+    template<typename Fun, typename Iteratable>
+    inline void applyBatched(const parallel_policy& policy, Fun fun, Iteratable& inout, std::size_t batchSize)
+    {
+        const auto chunks = helpers::chunks(inout, batchSize);
+        const helpers::Applicator<Fun> f{ fun };
+        helpers::parallelFor(policy.executor(), chunks.size(), [&](std::size_t i) { f(chunks[i]); });
+    }
+
+    // every worker maps whole batches, the returned batches are concatenated in input order at the end;
+    // they are kept until then, so they have to own their results rather than view a buffer of the callable
+    template<
+        typename ResultContainerTypeExplicit,
+        typename InputContainerType,
+        typename Fun,
+        typename ResultHelperT = helpers::batched_result_t<ResultContainerTypeExplicit, InputContainerType, Fun>,
+        typename BatchType = typename ResultHelperT::batch_type,
+        typename ResultContainer = typename ResultHelperT::container_type>
+    inline ResultContainer mapBatched(const parallel_policy& policy, Fun fun, const InputContainerType& input, std::size_t batchSize)
+    {
+        FUNCTIONAL_PROBE("mapBatched", Fun);
+        FUNCTIONAL_PROBE_ELEMENTS(functional_impl::instrumentation::elementCount(input, 0));
+        const auto chunks = helpers::chunks(input, batchSize);
+        const helpers::Applicator<Fun> f{ fun };
+        std::vector<helpers::Maybe<BatchType>> batches(chunks.size());
+        helpers::parallelFor(policy.executor(), chunks.size(), [&](std::size_t i) { batches[i].emplace(f(chunks[i])); });
+
+        FUNCTIONAL_TRACE_SCOPE("merge");
+        helpers::Accumulator<ResultContainer> accumulator;
+        accumulator.reserve(input);
+        for (const auto& batch : batches)
+        {
+            for (auto&& result : *batch)
+            {
+                accumulator.accumulate(result);
+            }
+        }
+        FUNCTIONAL_PROBE_ALLOCATED(accumulator.container);
+        return std::move(accumulator.container);
+    }
+
+    // the workers map their batches and sum up the sizes of the inner results, a scan over these sums gives
+    // every batch its offset into the output, which is allocated once and filled in parallel again;
+    // an explicitly given container needs a size constructor and operator[]
+    template<
+        typename ResultContainerTypeExplicit,
+        typename InputContainerType,
+        typename Fun,
+        typename InnerType = typename helpers::concat_map_t<ResultContainerTypeExplicit, InputContainerType, Fun>::inner_type,
+        typename ResultContainer = typename helpers::parallel_concat_t<ResultContainerTypeExplicit, InputContainerType, Fun>::type>
+    inline ResultContainer concatMap(const parallel_policy& policy, Fun fun, const InputContainerType& input)
+    {
+        FUNCTIONAL_PROBE("concatMap", Fun);
+        FUNCTIONAL_PROBE_ELEMENTS(functional_impl::instrumentation::elementCount(input, 0));
+        Executor& executor = policy.executor();
+        const auto chunks = helpers::chunks(input, helpers::defaultBatchSize(executor, input));
+        const helpers::Applicator<Fun> f{ fun };
+
+        std::vector<std::vector<InnerType>> inners(chunks.size());
+        std::vector<std::size_t> offsets(chunks.size() + 1, 0);
+        helpers::parallelFor(executor, chunks.size(), [&](std::size_t i)
+        {
+            auto& local = inners[i];
+            local.reserve(chunks[i].size());
+            for (auto&& value : chunks[i])
+            {
+                local.push_back(f(value));
+                offsets[i + 1] += helpers::iteratableSize(local.back(), 0);
+            }
+        });
+
+        FUNCTIONAL_TRACE_BEGIN("scan");
+        std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+        ResultContainer result(offsets.back());
+        FUNCTIONAL_TRACE_END("scan");
+
+        helpers::parallelFor(executor, chunks.size(), [&](std::size_t i)
+        {
+            std::size_t pos = offsets[i];
+            for (auto& inner : inners[i])
+            {
+                for (auto&& value : inner)
+                {
+                    result[pos++] = std::move(value);
+                }
+            }
+        });
+        FUNCTIONAL_PROBE_ALLOCATED(result);
+        return result;
+    }
+
+    // every batch is folded on its own, starting from a copy of the neutral value; the partial results are then
+    // combined in input order, so combine has to be associative with the neutral value as its identity
+    template<typename Fun, typename Combine, typename ResultType, typename InputContainerType>
+    inline ResultType foldl(const parallel_policy& policy, Fun fun, Combine combine, ResultType neutralValue, const InputContainerType& input)
+    {
+        FUNCTIONAL_PROBE("foldl", Fun);
+        FUNCTIONAL_PROBE_ELEMENTS(functional_impl::instrumentation::elementCount(input, 0));
+        Executor& executor = policy.executor();
+        const auto chunks = helpers::chunks(input, helpers::defaultBatchSize(executor, input));
+        const helpers::Applicator<Fun> f{ fun };
+        const helpers::Applicator<Combine> c{ combine };
+
+        std::vector<helpers::Maybe<ResultType>> partials(chunks.size());
+        helpers::parallelFor(executor, chunks.size(), [&](std::size_t i)
+        {
+            ResultType res = neutralValue;
+            for (auto&& value : chunks[i])
+            {
+                res = helpers::foldStep(f, res, value, 0);
+            }
+            partials[i].emplace(std::move(res));
+        });
+
+        FUNCTIONAL_TRACE_SCOPE("merge");
+        ResultType res = std::move(neutralValue);
+        for (auto& partial : partials)
+        {
+            res = helpers::foldStep(c, res, *partial, 0);
+        }
+        return res;
+    }
+};
+
+template<typename Fun, typename Iteratable>
+void functional::applyBatched(const parallel_policy& policy, Fun fun, Iteratable&& inout, std::size_t batchSize)
+{
+    FUNCTIONAL_PROBE("applyBatched", Fun);
+    FUNCTIONAL_PROBE_ELEMENTS(functional_impl::instrumentation::elementCount(inout, 0));
+    return functional_impl::applyBatched(policy, fun, inout, batchSize);
+}
+
+template<typename ResultContainer, typename Fun, typename Container>
+auto functional::mapBatched(const parallel_policy& policy, Fun fun, const Container& input, std::size_t batchSize) -> decltype(functional_impl::mapBatched<ResultContainer>(fun, input, batchSize))
+{
+    return functional_impl::mapBatched<ResultContainer>(policy, fun, input, batchSize);
+}
+
+template<typename ResultContainer, typename Fun, typename Container>
+auto functional::concatMap(const parallel_policy& policy, Fun fun, const Container& input) -> typename functional_impl::helpers::parallel_concat_t<ResultContainer, Container, Fun>::type
+{
+    return functional_impl::concatMap<ResultContainer>(policy, fun, input);
+}
+
+template<typename Fun, typename Combine, typename ResultType, typename Container>
+ResultType functional::foldl(const parallel_policy& policy, Fun fun, Combine combine, ResultType neutralValue, const Container& input)
+{
+    return functional_impl::foldl(policy, fun, combine, std::move(neutralValue), input);
+}
+
+#endif // _PARALLEL_HPP_
@@ -0,0 +1,153 @@
+/*
+Copyright (c) 2013 Janick Bernet
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#ifndef _PERF_COUNTERS_HPP_
+#define _PERF_COUNTERS_HPP_
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__linux__)
+    #include <linux/perf_event.h>
+    #include <sys/ioctl.h>
+    #include <sys/syscall.h>
+    #include <unistd.h>
+#endif
+
+namespace functional
+{
+    // hardware counters of the calling thread via perf_event_open on linux; counters the kernel
+    // refuses (other platforms, perf_event_paranoid, containers, VMs) stay unavailable and read 0
+    class PerfCounters;
+};
+
+class functional::PerfCounters
+{
+public:
+    enum Counter { Cycles, Instructions, CacheMisses, BranchMisses, CounterCount };
+
+    PerfCounters()
+    {
+        m_fds.fill(-1);
+        m_values.fill(0);
+#if defined(__linux__)
+        static const std::uint64_t configs[CounterCount] =
+        {
+            PERF_COUNT_HW_CPU_CYCLES,
+            PERF_COUNT_HW_INSTRUCTIONS,
+            PERF_COUNT_HW_CACHE_MISSES,
+            PERF_COUNT_HW_BRANCH_MISSES
+        };
+        for (int i = 0; i < CounterCount; ++i)
+        {
+            perf_event_attr attr;
+            std::memset(&attr, 0, sizeof(attr));
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.size = sizeof(attr);
+            attr.config = configs[i];
+            attr.disabled = 1;
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            m_fds[i] = static_cast<int>(syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0));
+        }
+#endif
+    }
+
+    PerfCounters(const PerfCounters&) = delete;
+    PerfCounters& operator= (const PerfCounters&) = delete;
+
+    ~PerfCounters()
+    {
+#if defined(__linux__)
+        for (int fd : m_fds)
+        {
+            if (fd >= 0)
+            {
+                close(fd);
+            }
+        }
+#endif
+    }
+
+    bool available(Counter counter) const { return m_fds[counter] >= 0; }
+
+    bool available() const
+    {
+        for (int fd : m_fds)
+        {
+            if (fd >= 0)
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void start()
+    {
+#if defined(__linux__)
+        for (int fd : m_fds)
+        {
+            if (fd >= 0)
+            {
+                ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+                ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+            }
+        }
+#endif
+    }
+
+    void stop()
+    {
+#if defined(__linux__)
+        for (int i = 0; i < CounterCount; ++i)
+        {
+            m_values[i] = 0;
+            if (m_fds[i] >= 0)
+            {
+                ioctl(m_fds[i], PERF_EVENT_IOC_DISABLE, 0);
+                std::uint64_t value = 0;
+                if (read(m_fds[i], &value, sizeof(value)) == sizeof(value))
+                {
+                    m_values[i] = value;
+                }
+            }
+        }
+#endif
+    }
+
+    // value between the last start() and stop()
+    std::uint64_t operator[] (Counter counter) const { return m_values[counter]; }
+
+    static const char* name(Counter counter)
+    {
+        static const char* names[CounterCount] = { "cycles", "instructions", "cache-misses", "branch-misses" };
+        return names[counter];
+    }
+
+private:
+    std::array<int, CounterCount> m_fds;
+    std::array<std::uint64_t, CounterCount> m_values;
+};
+
+#endif // _PERF_COUNTERS_HPP_
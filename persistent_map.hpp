@@ -0,0 +1,646 @@
+/*
+Copyright (c) 2013 Janick Bernet
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#ifndef _PERSISTENT_MAP_HPP_
+#define _PERSISTENT_MAP_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <initializer_list>
+#include <iterator>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#if defined(_MSC_VER)
+    #include <intrin.h>
+#endif
+
+#include "functional.hpp"
+#include "persistent_vector.hpp"
+
+namespace functional
+{
+    // immutable hash map sharing structure between versions: a hash array mapped trie branching on 5 hash
+    // bits per level, where updates copy the O(log32 n) nodes on the path to the key and leave the rest shared
+    template<typename K, typename V, typename Hash = std::hash<K>, typename Eq = std::equal_to<K>>
+    class persistent_map;
+
+    // mutable builder of a persistent_map, editing the nodes it created in place
+    template<typename K, typename V, typename Hash = std::hash<K>, typename Eq = std::equal_to<K>>
+    class transient_map;
+
+    //! map :: (v -> w) -> Map k v -> Map k w
+    template<typename Fun, typename K, typename V, typename Hash, typename Eq>
+    auto map(Fun fun, const persistent_map<K, V, Hash, Eq>& input) -> persistent_map<K, decltype(fun(std::declval<const V&>())), Hash, Eq>;
+};
+
+namespace functional_impl
+{
+    namespace helpers
+    {
+        inline unsigned bitCount(std::uint32_t bits)
+        {
+#if defined(_MSC_VER)
+            return __popcnt(bits);
+#else
+            return __builtin_popcount(bits);
+#endif
+        }
+
+        // entries and subtrees are kept in two dense arrays indexed through bitmaps of the 32 branches, so the
+        // entries of a node are contiguous; nodes below the last hash bits hold colliding keys without bitmaps
+        template<typename K, typename V>
+        struct HamtNode
+        {
+            explicit HamtNode(std::size_t owner)
+                : owner(owner)
+                , datamap(0)
+                , nodemap(0)
+            {
+            }
+
+            std::size_t owner;
+            std::uint32_t datamap;
+            std::uint32_t nodemap;
+            std::vector<std::pair<K, V>> entries;
+            std::vector<std::shared_ptr<HamtNode>> children;
+        };
+
+        // the trie algorithms shared by persistent_map and transient_map, with the same edit id scheme as Trie
+        template<typename K, typename V, typename Hash, typename Eq>
+        class Hamt
+        {
+        public:
+            typedef HamtNode<K, V> Node;
+            typedef std::shared_ptr<Node> NodePtr;
+
+            static const unsigned Bits = 5;
+            static const unsigned HashBits = sizeof(std::size_t) * 8;
+
+            Hamt()
+                : m_size(0)
+            {
+            }
+
+            std::size_t size() const { return m_size; }
+            const Node* root() const { return m_root.get(); }
+
+            const V* find(const K& key) const
+            {
+                const std::size_t hash = m_hash(key);
+                const Node* node = m_root.get();
+                for (unsigned shift = 0; node; shift += Bits)
+                {
+                    if (shift >= HashBits)
+                    {
+                        for (const auto& entry : node->entries)
+                        {
+                            if (m_eq(entry.first, key))
+                            {
+                                return &entry.second;
+                            }
+                        }
+                        return nullptr;
+                    }
+                    const std::uint32_t bit = branch(hash, shift);
+                    if (node->datamap & bit)
+                    {
+                        const auto& entry = node->entries[index(node->datamap, bit)];
+                        return m_eq(entry.first, key) ? &entry.second : nullptr;
+                    }
+                    if (!(node->nodemap & bit))
+                    {
+                        return nullptr;
+                    }
+                    node = node->children[index(node->nodemap, bit)].get();
+                }
+                return nullptr;
+            }
+
+            void insert(std::size_t edit, K key, V value)
+            {
+                bool added = false;
+                const std::size_t hash = m_hash(key);
+                m_root = insert(m_root, 0, hash, key, value, edit, added);
+                if (added)
+                {
+                    ++m_size;
+                }
+            }
+
+            void erase(std::size_t edit, const K& key)
+            {
+                bool removed = false;
+                m_root = erase(m_root, 0, m_hash(key), key, edit, removed);
+                if (removed)
+                {
+                    --m_size;
+                }
+            }
+
+            // the same trie shape with every value replaced, no key is hashed again
+            template<typename Fun, typename W>
+            static std::shared_ptr<HamtNode<K, W>> mapValues(Fun& fun, const Node* node, std::size_t edit)
+            {
+                if (!node)
+                {
+                    return nullptr;
+                }
+                auto mapped = std::make_shared<HamtNode<K, W>>(edit);
+                mapped->datamap = node->datamap;
+                mapped->nodemap = node->nodemap;
+                mapped->entries.reserve(node->entries.size());
+                for (const auto& entry : node->entries)
+                {
+                    mapped->entries.emplace_back(entry.first, fun(entry.second));
+                }
+                mapped->children.reserve(node->children.size());
+                for (const auto& child : node->children)
+                {
+                    mapped->children.push_back(mapValues<Fun, W>(fun, child.get(), edit));
+                }
+                return mapped;
+            }
+
+            static Hamt fromRoot(NodePtr root, std::size_t size)
+            {
+                Hamt result;
+                result.m_root = std::move(root);
+                result.m_size = size;
+                return result;
+            }
+
+        private:
+            static std::uint32_t branch(std::size_t hash, unsigned shift)
+            {
+                return std::uint32_t(1) << ((hash >> shift) & 31);
+            }
+
+            static std::size_t index(std::uint32_t map, std::uint32_t bit)
+            {
+                return bitCount(map & (bit - 1));
+            }
+
+            static NodePtr editNode(const NodePtr& node, std::size_t edit)
+            {
+                if (node && edit != 0 && node->owner == edit)
+                {
+                    return node;
+                }
+                NodePtr copy = std::make_shared<Node>(edit);
+                if (node)
+                {
+                    copy->datamap = node->datamap;
+                    copy->nodemap = node->nodemap;
+                    copy->entries.reserve(node->entries.size() + 1);
+                    copy->entries.assign(node->entries.begin(), node->entries.end());
+                    copy->children = node->children;
+                }
+                return copy;
+            }
+
+            // a subtree holding two entries whose hashes agree below shift
+            NodePtr subtree(unsigned shift, std::pair<K, V> first, std::size_t firstHash, std::pair<K, V> second, std::size_t secondHash, std::size_t edit)
+            {
+                NodePtr node = std::make_shared<Node>(edit);
+                if (shift >= HashBits)
+                {
+                    node->entries.reserve(2);
+                    node->entries.push_back(std::move(first));
+                    node->entries.push_back(std::move(second));
+                    return node;
+                }
+                const std::uint32_t firstBit = branch(firstHash, shift);
+                const std::uint32_t secondBit = branch(secondHash, shift);
+                if (firstBit == secondBit)
+                {
+                    node->nodemap = firstBit;
+                    node->children.push_back(subtree(shift + Bits, std::move(first), firstHash, std::move(second), secondHash, edit));
+                    return node;
+                }
+                node->datamap = firstBit | secondBit;
+                node->entries.reserve(2);
+                if (firstBit < secondBit)
+                {
+                    node->entries.push_back(std::move(first));
+                    node->entries.push_back(std::move(second));
+                }
+                else
+                {
+                    node->entries.push_back(std::move(second));
+                    node->entries.push_back(std::move(first));
+                }
+                return node;
+            }
+
+            NodePtr insert(const NodePtr& node, unsigned shift, std::size_t hash, K& key, V& value, std::size_t edit, bool& added)
+            {
+                if (shift >= HashBits)
+                {
+                    NodePtr result = editNode(node, edit);
+                    for (auto& entry : result->entries)
+                    {
+                        if (m_eq(entry.first, key))
+                        {
+                            entry.second = std::move(value);
+                            return result;
+                        }
+                    }
+                    result->entries.emplace_back(std::move(key), std::move(value));
+                    added = true;
+                    return result;
+                }
+
+                const std::uint32_t bit = branch(hash, shift);
+                if (node && (node->datamap & bit))
+                {
+                    const std::size_t pos = index(node->datamap, bit);
+                    NodePtr result = editNode(node, edit);
+                    if (m_eq(node->entries[pos].first, key))
+                    {
+                        result->entries[pos].second = std::move(value);
+                        return result;
+                    }
+                    // two keys on one branch, the existing entry moves down into a new subtree
+                    std::pair<K, V> existing(std::move(result->entries[pos]));
+                    const std::size_t existingHash = m_hash(existing.first);
+                    NodePtr child = subtree(shift + Bits, std::move(existing), existingHash, std::pair<K, V>(std::move(key), std::move(value)), hash, edit);
+                    result->entries.erase(result->entries.begin() + pos);
+                    result->datamap ^= bit;
+                    result->nodemap |= bit;
+                    result->children.insert(result->children.begin() + index(result->nodemap, bit), std::move(child));
+                    added = true;
+                    return result;
+                }
+                if (node && (node->nodemap & bit))
+                {
+                    const std::size_t pos = index(node->nodemap, bit);
+                    NodePtr child = insert(node->children[pos], shift + Bits, hash, key, value, edit, added);
+                    NodePtr result = editNode(node, edit);
+                    result->children[pos] = std::move(child);
+                    return result;
+                }
+                NodePtr result = editNode(node, edit);
+                result->datamap |= bit;
+                result->entries.emplace(result->entries.begin() + index(result->datamap, bit), std::move(key), std::move(value));
+                added = true;
+                return result;
+            }
+
+            // returns null for subtrees that end up empty, and keeps single entries out of subtrees so every
+            // version of the same set of keys has the same shape
+            NodePtr erase(const NodePtr& node, unsigned shift, std::size_t hash, const K& key, std::size_t edit, bool& removed)
+            {
+                if (!node)
+                {
+                    return node;
+                }
+                if (shift >= HashBits)
+                {
+                    for (std::size_t pos = 0; pos < node->entries.size(); ++pos)
+                    {
+                        if (m_eq(node->entries[pos].first, key))
+                        {
+                            removed = true;
+                            if (node->entries.size() == 1)
+                            {
+                                return nullptr;
+                            }
+                            NodePtr result = editNode(node, edit);
+                            result->entries.erase(result->entries.begin() + pos);
+                            return result;
+                        }
+                    }
+                    return node;
+                }
+
+                const std::uint32_t bit = branch(hash, shift);
+                if (node->datamap & bit)
+                {
+                    const std::size_t pos = index(node->datamap, bit);
+                    if (!m_eq(node->entries[pos].first, key))
+                    {
+                        return node;
+                    }
+                    removed = true;
+                    if (node->entries.size() == 1 && node->children.empty())
+                    {
+                        return nullptr;
+                    }
+                    NodePtr result = editNode(node, edit);
+                    result->entries.erase(result->entries.begin() + pos);
+                    result->datamap ^= bit;
+                    return result;
+                }
+                if (node->nodemap & bit)
+                {
+                    const std::size_t pos = index(node->nodemap, bit);
+                    NodePtr child = erase(node->children[pos], shift + Bits, hash, key, edit, removed);
+                    if (!removed)
+                    {
+                        return node;
+                    }
+                    if (!child && node->entries.empty() && node->children.size() == 1)
+                    {
+                        return nullptr;
+                    }
+                    NodePtr result = editNode(node, edit);
+                    if (child && (!child->children.empty() || child->entries.size() > 1))
+                    {
+                        result->children[pos] = std::move(child);
+                        return result;
+                    }
+                    result->children.erase(result->children.begin() + pos);
+                    result->nodemap ^= bit;
+                    if (child)
+                    {
+                        result->datamap |= bit;
+                        result->entries.insert(result->entries.begin() + index(result->datamap, bit), child->entries.front());
+                    }
+                    return result;
+                }
+                return node;
+            }
+
+            std::size_t m_size;
+            NodePtr m_root;
+            Hash m_hash;
+            Eq m_eq;
+        };
+
+        template<typename K, typename V, typename Hash, typename Eq>
+        struct maps_itself<functional::persistent_map<K, V, Hash, Eq>> : std::true_type {};
+
+        // walks the trie depth first, yielding the contiguous entries of each node in turn
+        template<typename K, typename V>
+        class HamtItr
+        {
+            typedef HamtNode<K, V> Node;
+            // the deepest path: one level per 5 hash bits plus the collision level
+            static const unsigned MaxDepth = sizeof(std::size_t) * 8 / 5 + 2;
+
+        public:
+            typedef std::forward_iterator_tag iterator_category;
+            typedef std::pair<K, V> value_type;
+            typedef std::ptrdiff_t difference_type;
+            typedef const value_type* pointer;
+            typedef const value_type& reference;
+
+            explicit HamtItr(const Node* root)
+                : m_depth(0)
+                , m_node(root)
+                , m_entry(0)
+            {
+                if (root)
+                {
+                    m_stack[0] = Frame{ root, 0 };
+                    m_depth = 1;
+                    settle();
+                }
+            }
+
+            bool operator== (const HamtItr& other) const
+            {
+                return m_node == other.m_node && m_entry == other.m_entry;
+            }
+
+            bool operator!= (const HamtItr& other) const
+            {
+                return !(*this == other);
+            }
+
+            const value_type& operator* () const
+            {
+                return m_node->entries[m_entry];
+            }
+
+            const value_type* operator-> () const
+            {
+                return &m_node->entries[m_entry];
+            }
+
+            const HamtItr& operator++ ()
+            {
+                ++m_entry;
+                settle();
+                return *this;
+            }
+
+            HamtItr operator++ (int)
+            {
+                HamtItr previous(*this);
+                ++*this;
+                return previous;
+            }
+
+        private:
+            struct Frame
+            {
+                const Node* node;
+                std::size_t child;
+            };
+
+            void settle()
+            {
+                while (m_node && m_entry == m_node->entries.size())
+                {
+                    m_node = nextNode();
+                    m_entry = 0;
+                }
+            }
+
+            const Node* nextNode()
+            {
+                while (m_depth > 0)
+                {
+                    Frame& top = m_stack[m_depth - 1];
+                    if (top.child < top.node->children.size())
+                    {
+                        const Node* child = top.node->children[top.child++].get();
+                        m_stack[m_depth++] = Frame{ child, 0 };
+                        return child;
+                    }
+                    --m_depth;
+                }
+                return nullptr;
+            }
+
+            Frame m_stack[MaxDepth];
+            unsigned m_depth;
+            const Node* m_node;
+            std::size_t m_entry;
+        };
+    }
+};
+
+template<typename K, typename V, typename Hash, typename Eq>
+class functional::persistent_map
+{
+public:
+    typedef K key_type;
+    typedef V mapped_type;
+    typedef std::pair<K, V> value_type;
+    typedef std::size_t size_type;
+    typedef const value_type& const_reference;
+    typedef functional_impl::helpers::HamtItr<K, V> const_iterator;
+    typedef const_iterator iterator;
+
+    persistent_map()
+    {
+    }
+
+    persistent_map(std::initializer_list<value_type> values)
+    {
+        const std::size_t edit = functional_impl::helpers::nextEditId();
+        for (const auto& value : values)
+        {
+            m_hamt.insert(edit, value.first, value.second);
+        }
+    }
+
+    template<typename Itr>
+    persistent_map(Itr first, Itr last)
+    {
+        const std::size_t edit = functional_impl::helpers::nextEditId();
+        for (; first != last; ++first)
+        {
+            m_hamt.insert(edit, first->first, first->second);
+        }
+    }
+
+    std::size_t size() const { return m_hamt.size(); }
+    bool empty() const { return size() == 0; }
+
+    //! the value of key, nullptr if there is none
+    const V* find(const K& key) const { return m_hamt.find(key); }
+    std::size_t count(const K& key) const { return find(key) ? 1 : 0; }
+
+    const_iterator begin() const { return const_iterator(m_hamt.root()); }
+    const_iterator end() const { return const_iterator(nullptr); }
+
+    //! a new version with key mapped to value
+    persistent_map inserted(K key, V value) const
+    {
+        persistent_map result(*this);
+        result.m_hamt.insert(0, std::move(key), std::move(value));
+        return result;
+    }
+
+    //! a new version without key
+    persistent_map erased(const K& key) const
+    {
+        persistent_map result(*this);
+        result.m_hamt.erase(0, key);
+        return result;
+    }
+
+    //! the same keys with fun applied to every value, reusing the trie shape instead of hashing again
+    template<typename Fun>
+    auto mapValues(Fun fun) const -> persistent_map<K, decltype(fun(std::declval<const V&>())), Hash, Eq>
+    {
+        typedef decltype(fun(std::declval<const V&>())) ResultType;
+        typedef functional_impl::helpers::Hamt<K, ResultType, Hash, Eq> ResultHamt;
+
+        auto root = functional_impl::helpers::Hamt<K, V, Hash, Eq>::template mapValues<Fun, ResultType>(fun, m_hamt.root(), 0);
+        return persistent_map<K, ResultType, Hash, Eq>(ResultHamt::fromRoot(std::move(root), size()));
+    }
+
+    //! a builder starting from this version, for batches of edits
+    transient_map<K, V, Hash, Eq> transient() const
+    {
+        return transient_map<K, V, Hash, Eq>(m_hamt);
+    }
+
+private:
+    template<typename, typename, typename, typename>
+    friend class persistent_map;
+    friend class transient_map<K, V, Hash, Eq>;
+
+    explicit persistent_map(const functional_impl::helpers::Hamt<K, V, Hash, Eq>& hamt)
+        : m_hamt(hamt)
+    {
+    }
+
+    functional_impl::helpers::Hamt<K, V, Hash, Eq> m_hamt;
+};
+
+// nodes created by a transient are modified in place until persistent() hands them out, after which
+// it continues with a new edit id, so the handed out version is never changed
+template<typename K, typename V, typename Hash, typename Eq>
+class functional::transient_map
+{
+public:
+    typedef K key_type;
+    typedef V mapped_type;
+    typedef std::pair<K, V> value_type;
+    typedef std::size_t size_type;
+    typedef functional_impl::helpers::HamtItr<K, V> const_iterator;
+    typedef const_iterator iterator;
+
+    transient_map()
+        : m_edit(functional_impl::helpers::nextEditId())
+    {
+    }
+
+    std::size_t size() const { return m_hamt.size(); }
+    bool empty() const { return size() == 0; }
+
+    const V* find(const K& key) const { return m_hamt.find(key); }
+    std::size_t count(const K& key) const { return find(key) ? 1 : 0; }
+
+    const_iterator begin() const { return const_iterator(m_hamt.root()); }
+    const_iterator end() const { return const_iterator(nullptr); }
+
+    void insert(K key, V value) { m_hamt.insert(m_edit, std::move(key), std::move(value)); }
+    void insert(const value_type& value) { m_hamt.insert(m_edit, value.first, value.second); }
+    void erase(const K& key) { m_hamt.erase(m_edit, key); }
+
+    persistent_map<K, V, Hash, Eq> persistent()
+    {
+        m_edit = functional_impl::helpers::nextEditId();
+        return persistent_map<K, V, Hash, Eq>(m_hamt);
+    }
+
+private:
+    friend class persistent_map<K, V, Hash, Eq>;
+
+    explicit transient_map(const functional_impl::helpers::Hamt<K, V, Hash, Eq>& hamt)
+        : m_edit(functional_impl::helpers::nextEditId())
+        , m_hamt(hamt)
+    {
+    }
+
+    std::size_t m_edit;
+    functional_impl::helpers::Hamt<K, V, Hash, Eq> m_hamt;
+};
+
+template<typename Fun, typename K, typename V, typename Hash, typename Eq>
+auto functional::map(Fun fun, const persistent_map<K, V, Hash, Eq>& input) -> persistent_map<K, decltype(fun(std::declval<const V&>())), Hash, Eq>
+{
+    FUNCTIONAL_PROBE("map", Fun);
+    FUNCTIONAL_PROBE_ELEMENTS(input.size());
+    return input.mapValues(fun);
+}
+
+#endif // _PERSISTENT_MAP_HPP_
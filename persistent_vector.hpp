@@ -0,0 +1,560 @@
+/*
+Copyright (c) 2013 Janick Bernet
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#ifndef _PERSISTENT_VECTOR_HPP_
+#define _PERSISTENT_VECTOR_HPP_
+
+#include <atomic>
+#include <cstddef>
+#include <initializer_list>
+#include <iterator>
+#include <memory>
+#include <utility>
+#include <vector>
+#include <assert.h>
+
+#include "functional.hpp"
+
+namespace functional
+{
+    // immutable vector sharing structure between versions: a 32-way trie of leaves plus a separate tail
+    // leaf for appends, so updates copy one path of at most log32(n) nodes instead of all elements
+    template<typename T>
+    class persistent_vector;
+
+    // mutable builder of a persistent_vector, editing the nodes it created in place
+    template<typename T>
+    class transient_vector;
+};
+
+namespace functional_impl
+{
+    namespace helpers
+    {
+        template<typename T>
+        struct TrieNode
+        {
+            explicit TrieNode(std::size_t owner)
+                : owner(owner)
+            {
+            }
+
+            // the transient that may still modify this node in place, 0 once it is (possibly) shared
+            std::size_t owner;
+            std::vector<std::shared_ptr<TrieNode>> children;
+            std::vector<T> values;
+        };
+
+        // edit ids of transients, never 0
+        inline std::size_t nextEditId()
+        {
+            static std::atomic<std::size_t> ids(0);
+            return ++ids;
+        }
+
+        // the trie algorithms shared by persistent_vector and transient_vector: nodes owned by the given edit id
+        // are modified in place, all others are copied first (always the case for edit id 0)
+        template<typename T>
+        class Trie
+        {
+            typedef TrieNode<T> Node;
+            typedef std::shared_ptr<Node> NodePtr;
+
+            static const unsigned Bits = 5;
+            static const std::size_t Width = std::size_t(1) << Bits;
+            static const std::size_t Mask = Width - 1;
+
+        public:
+            Trie()
+                : m_size(0)
+                , m_shift(Bits)
+            {
+            }
+
+            std::size_t size() const { return m_size; }
+
+            // the leaf holding element pos, iterators fetch it once per 32 elements
+            const T* leafFor(std::size_t pos) const
+            {
+                if (pos >= tailOffset())
+                {
+                    return m_tail->values.data();
+                }
+                const Node* node = m_root.get();
+                for (unsigned level = m_shift; level > 0; level -= Bits)
+                {
+                    node = node->children[(pos >> level) & Mask].get();
+                }
+                return node->values.data();
+            }
+
+            const T& at(std::size_t pos) const
+            {
+                assert(pos < m_size);
+                return leafFor(pos)[pos & Mask];
+            }
+
+            template<typename V>
+            void push_back(std::size_t edit, V&& value)
+            {
+                if (m_size - tailOffset() < Width)
+                {
+                    editInPlace(m_tail, edit).values.push_back(std::forward<V>(value));
+                    ++m_size;
+                    return;
+                }
+
+                // the full tail moves into the trie, growing it by a level when the root is full
+                if ((m_size >> Bits) > (std::size_t(1) << m_shift))
+                {
+                    NodePtr root = std::make_shared<Node>(edit);
+                    root->children.reserve(Width);
+                    root->children.push_back(m_root);
+                    root->children.push_back(newPath(m_shift, m_tail, edit));
+                    m_root = root;
+                    m_shift += Bits;
+                }
+                else
+                {
+                    m_root = pushTail(m_shift, m_root, m_tail, edit);
+                }
+                m_tail = editLeaf(NodePtr(), edit);
+                m_tail->values.push_back(std::forward<V>(value));
+                ++m_size;
+            }
+
+            template<typename V>
+            void set(std::size_t edit, std::size_t pos, V&& value)
+            {
+                assert(pos < m_size);
+                if (pos >= tailOffset())
+                {
+                    editInPlace(m_tail, edit).values[pos & Mask] = std::forward<V>(value);
+                }
+                else
+                {
+                    m_root = doSet(m_shift, m_root, pos, std::forward<V>(value), edit);
+                }
+            }
+
+            void pop_back(std::size_t edit)
+            {
+                assert(m_size > 0);
+                if (m_size == 1)
+                {
+                    *this = Trie();
+                    return;
+                }
+                if (m_size - tailOffset() > 1)
+                {
+                    editInPlace(m_tail, edit).values.pop_back();
+                    --m_size;
+                    return;
+                }
+
+                // the tail runs empty, the last leaf of the trie becomes the new tail
+                NodePtr tail = leafNode(m_size - 2);
+                NodePtr root = popTail(m_shift, m_root, edit);
+                if (m_shift > Bits && root && root->children.size() == 1)
+                {
+                    root = root->children[0];
+                    m_shift -= Bits;
+                }
+                m_root = root;
+                m_tail = tail;
+                --m_size;
+            }
+
+        private:
+            std::size_t tailOffset() const
+            {
+                return m_size < Width ? 0 : ((m_size - 1) >> Bits) << Bits;
+            }
+
+            static NodePtr editLeaf(const NodePtr& node, std::size_t edit)
+            {
+                if (node && edit != 0 && node->owner == edit)
+                {
+                    return node;
+                }
+                NodePtr copy = std::make_shared<Node>(edit);
+                copy->values.reserve(Width);
+                if (node)
+                {
+                    copy->values.assign(node->values.begin(), node->values.end());
+                }
+                return copy;
+            }
+
+            // like editLeaf, without touching the reference count when the leaf is already owned
+            static Node& editInPlace(NodePtr& leaf, std::size_t edit)
+            {
+                if (!leaf || edit == 0 || leaf->owner != edit)
+                {
+                    leaf = editLeaf(leaf, edit);
+                }
+                return *leaf;
+            }
+
+            static NodePtr editBranch(const NodePtr& node, std::size_t edit)
+            {
+                if (node && edit != 0 && node->owner == edit)
+                {
+                    return node;
+                }
+                NodePtr copy = std::make_shared<Node>(edit);
+                copy->children.reserve(Width);
+                if (node)
+                {
+                    copy->children.assign(node->children.begin(), node->children.end());
+                }
+                return copy;
+            }
+
+            static NodePtr newPath(unsigned level, const NodePtr& leaf, std::size_t edit)
+            {
+                if (level == 0)
+                {
+                    return leaf;
+                }
+                NodePtr node = editBranch(NodePtr(), edit);
+                node->children.push_back(newPath(level - Bits, leaf, edit));
+                return node;
+            }
+
+            NodePtr pushTail(unsigned level, const NodePtr& parent, const NodePtr& tail, std::size_t edit)
+            {
+                NodePtr node = editBranch(parent, edit);
+                const std::size_t child = ((m_size - 1) >> level) & Mask;
+                NodePtr insert;
+                if (level == Bits)
+                {
+                    insert = tail;
+                }
+                else if (child < node->children.size())
+                {
+                    insert = pushTail(level - Bits, node->children[child], tail, edit);
+                }
+                else
+                {
+                    insert = newPath(level - Bits, tail, edit);
+                }
+
+                if (child < node->children.size())
+                {
+                    node->children[child] = insert;
+                }
+                else
+                {
+                    node->children.push_back(insert);
+                }
+                return node;
+            }
+
+            template<typename V>
+            NodePtr doSet(unsigned level, const NodePtr& node, std::size_t pos, V&& value, std::size_t edit)
+            {
+                if (level == 0)
+                {
+                    NodePtr leaf = editLeaf(node, edit);
+                    leaf->values[pos & Mask] = std::forward<V>(value);
+                    return leaf;
+                }
+                NodePtr branch = editBranch(node, edit);
+                const std::size_t child = (pos >> level) & Mask;
+                branch->children[child] = doSet(level - Bits, branch->children[child], pos, std::forward<V>(value), edit);
+                return branch;
+            }
+
+            // removes the last leaf of the trie, returns null for subtrees that end up empty
+            NodePtr popTail(unsigned level, const NodePtr& node, std::size_t edit)
+            {
+                const std::size_t child = ((m_size - 2) >> level) & Mask;
+                if (level > Bits)
+                {
+                    NodePtr newChild = popTail(level - Bits, node->children[child], edit);
+                    if (!newChild && child == 0)
+                    {
+                        return NodePtr();
+                    }
+                    NodePtr branch = editBranch(node, edit);
+                    if (newChild)
+                    {
+                        branch->children[child] = newChild;
+                    }
+                    else
+                    {
+                        branch->children.pop_back();
+                    }
+                    return branch;
+                }
+                if (child == 0)
+                {
+                    return NodePtr();
+                }
+                NodePtr branch = editBranch(node, edit);
+                branch->children.pop_back();
+                return branch;
+            }
+
+            NodePtr leafNode(std::size_t pos) const
+            {
+                NodePtr node = m_root;
+                for (unsigned level = m_shift; level > 0; level -= Bits)
+                {
+                    node = node->children[(pos >> level) & Mask];
+                }
+                return node;
+            }
+
+            std::size_t m_size;
+            unsigned m_shift;
+            NodePtr m_root;
+            NodePtr m_tail;
+        };
+
+        // iterates leaf by leaf, walking down the trie only once per 32 elements
+        template<typename T>
+        class TrieItr
+        {
+        public:
+            typedef std::forward_iterator_tag iterator_category;
+            typedef T value_type;
+            typedef std::ptrdiff_t difference_type;
+            typedef const T* pointer;
+            typedef const T& reference;
+
+            TrieItr(const Trie<T>* trie, std::size_t pos)
+                : m_trie(trie)
+                , m_pos(pos)
+                , m_leaf(pos < trie->size() ? trie->leafFor(pos) : nullptr)
+            {
+            }
+
+            bool operator== (const TrieItr& other) const
+            {
+                return m_pos == other.m_pos;
+            }
+
+            bool operator!= (const TrieItr& other) const
+            {
+                return m_pos != other.m_pos;
+            }
+
+            const T& operator* () const
+            {
+                return m_leaf[m_pos & 31];
+            }
+
+            const T* operator-> () const
+            {
+                return &m_leaf[m_pos & 31];
+            }
+
+            const TrieItr& operator++ ()
+            {
+                if ((++m_pos & 31) == 0 && m_pos < m_trie->size())
+                {
+                    m_leaf = m_trie->leafFor(m_pos);
+                }
+                return *this;
+            }
+
+            TrieItr operator++ (int)
+            {
+                TrieItr previous(*this);
+                ++*this;
+                return previous;
+            }
+
+        private:
+            const Trie<T>* m_trie;
+            std::size_t m_pos;
+            const T* m_leaf;
+        };
+    }
+};
+
+template<typename T>
+class functional::persistent_vector
+{
+public:
+    typedef T value_type;
+    typedef std::size_t size_type;
+    typedef const T& const_reference;
+    typedef functional_impl::helpers::TrieItr<T> const_iterator;
+    typedef const_iterator iterator;
+
+    persistent_vector()
+    {
+    }
+
+    persistent_vector(std::initializer_list<T> values)
+    {
+        const std::size_t edit = functional_impl::helpers::nextEditId();
+        for (const auto& value : values)
+        {
+            m_trie.push_back(edit, value);
+        }
+    }
+
+    template<typename Itr>
+    persistent_vector(Itr first, Itr last)
+    {
+        const std::size_t edit = functional_impl::helpers::nextEditId();
+        for (; first != last; ++first)
+        {
+            m_trie.push_back(edit, *first);
+        }
+    }
+
+    std::size_t size() const { return m_trie.size(); }
+    bool empty() const { return size() == 0; }
+
+    const T& operator[] (std::size_t pos) const { return m_trie.at(pos); }
+    const T& front() const { return m_trie.at(0); }
+    const T& back() const { return m_trie.at(size() - 1); }
+
+    const_iterator begin() const { return const_iterator(&m_trie, 0); }
+    const_iterator end() const { return const_iterator(&m_trie, size()); }
+
+    //! a new version with value appended
+    persistent_vector appended(T value) const
+    {
+        persistent_vector result(*this);
+        result.m_trie.push_back(0, std::move(value));
+        return result;
+    }
+
+    //! a new version with element pos replaced by value
+    persistent_vector updated(std::size_t pos, T value) const
+    {
+        persistent_vector result(*this);
+        result.m_trie.set(0, pos, std::move(value));
+        return result;
+    }
+
+    //! a new version without the last element
+    persistent_vector popped() const
+    {
+        persistent_vector result(*this);
+        result.m_trie.pop_back(0);
+        return result;
+    }
+
+    //! a builder starting from this version, for batches of edits
+    transient_vector<T> transient() const
+    {
+        return transient_vector<T>(m_trie);
+    }
+
+private:
+    friend class transient_vector<T>;
+    friend struct functional_impl::helpers::Accumulator<persistent_vector<T>>;
+
+    explicit persistent_vector(const functional_impl::helpers::Trie<T>& trie)
+        : m_trie(trie)
+    {
+    }
+
+    functional_impl::helpers::Trie<T> m_trie;
+};
+
+// nodes created by a transient are modified in place until persistent() hands them out, after which
+// it continues with a new edit id, so the handed out version is never changed
+template<typename T>
+class functional::transient_vector
+{
+public:
+    typedef T value_type;
+    typedef std::size_t size_type;
+    typedef const T& const_reference;
+    typedef functional_impl::helpers::TrieItr<T> const_iterator;
+    typedef const_iterator iterator;
+
+    transient_vector()
+        : m_edit(functional_impl::helpers::nextEditId())
+    {
+    }
+
+    std::size_t size() const { return m_trie.size(); }
+    bool empty() const { return size() == 0; }
+
+    const T& operator[] (std::size_t pos) const { return m_trie.at(pos); }
+
+    const_iterator begin() const { return const_iterator(&m_trie, 0); }
+    const_iterator end() const { return const_iterator(&m_trie, size()); }
+
+    void push_back(const T& value) { m_trie.push_back(m_edit, value); }
+    void push_back(T&& value) { m_trie.push_back(m_edit, std::move(value)); }
+    void set(std::size_t pos, T value) { m_trie.set(m_edit, pos, std::move(value)); }
+    void pop_back() { m_trie.pop_back(m_edit); }
+
+    persistent_vector<T> persistent()
+    {
+        m_edit = functional_impl::helpers::nextEditId();
+        return persistent_vector<T>(m_trie);
+    }
+
+private:
+    friend class persistent_vector<T>;
+
+    explicit transient_vector(const functional_impl::helpers::Trie<T>& trie)
+        : m_edit(functional_impl::helpers::nextEditId())
+        , m_trie(trie)
+    {
+    }
+
+    std::size_t m_edit;
+    functional_impl::helpers::Trie<T> m_trie;
+};
+
+namespace functional_impl
+{
+    namespace helpers
+    {
+        // combinators build their persistent_vector results like a transient, nobody else sees them before they return
+        template<typename T>
+        struct Accumulator<persistent_vector<T>>
+        {
+            persistent_vector<T> container;
+            std::size_t edit = { nextEditId() };
+
+            template<typename CIn>
+            void reserve(const CIn&)
+            {
+            }
+
+            void reserveCount(std::size_t)
+            {
+            }
+
+            template<typename V>
+            void accumulate(V&& value)
+            {
+                container.m_trie.push_back(edit, std::forward<V>(value));
+            }
+        };
+    }
+};
+
+#endif // _PERSISTENT_VECTOR_HPP_
@@ -0,0 +1,500 @@
+/*
+Copyright (c) 2013 Janick Bernet
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#ifndef _PIPELINE_HPP_
+#define _PIPELINE_HPP_
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "functional.hpp"
+
+namespace functional_impl
+{
+    namespace helpers
+    {
+        template<typename Fun>
+        struct PipelineStage
+        {
+            Fun fun;
+            std::size_t workers;
+        };
+    }
+};
+
+namespace functional
+{
+    // a chain of map stages where every stage runs on threads of its own and hands batches to the next one
+    // through a bounded queue, so stages of different cost overlap and throughput follows the slowest stage
+    template<typename Source, typename... Stages>
+    class Pipeline;
+
+    //! pipeline :: [a] -> Int -> Pipeline a
+    template<typename Source>
+    Pipeline<Source> pipeline(Source&& source, std::size_t batchSize = 256, std::size_t queueCapacity = 8);
+};
+
+namespace functional_impl
+{
+    namespace helpers
+    {
+        // shared by all threads of a running pipeline: the first exception any of them threw, and how many
+        // batches the ordered sink has delivered so far
+        struct PipelineState
+        {
+            PipelineState()
+                : failed(false)
+                , delivered(0)
+            {
+            }
+
+            void fail(std::exception_ptr exception)
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (!error)
+                {
+                    error = std::move(exception);
+                }
+                failed.store(true, std::memory_order_release);
+            }
+
+            std::atomic<bool> failed;
+            std::atomic<std::size_t> delivered;
+            std::mutex mutex;
+            std::exception_ptr error;
+        };
+
+        // bounded multi producer multi consumer ring buffer (D. Vyukov's design): every cell carries a sequence
+        // number telling producers and consumers whose turn it is, so both sides only CAS their own position.
+        // Blocking push and pop yield while the queue is full or empty, which is what throttles fast stages;
+        // both give up once the pipeline has failed, so no thread stays blocked on a peer that is gone
+        template<typename T>
+        class BoundedQueue
+        {
+            struct Cell
+            {
+                std::atomic<std::size_t> sequence;
+                Maybe<T> value;
+            };
+
+        public:
+            BoundedQueue(std::size_t capacity, std::size_t producers, const std::atomic<bool>& aborted)
+                : m_mask(roundUp(capacity) - 1)
+                , m_cells(new Cell[m_mask + 1])
+                , m_enqueue(0)
+                , m_dequeue(0)
+                , m_producers(producers)
+                , m_closed(producers == 0)
+                , m_aborted(aborted)
+            {
+                for (std::size_t i = 0; i <= m_mask; ++i)
+                {
+                    m_cells[i].sequence.store(i, std::memory_order_relaxed);
+                }
+            }
+
+            // moves value in only on success
+            bool tryPush(T& value)
+            {
+                Cell* cell;
+                std::size_t pos = m_enqueue.load(std::memory_order_relaxed);
+                for (;;)
+                {
+                    cell = &m_cells[pos & m_mask];
+                    const std::size_t sequence = cell->sequence.load(std::memory_order_acquire);
+                    const std::intptr_t diff = static_cast<std::intptr_t>(sequence) - static_cast<std::intptr_t>(pos);
+                    if (diff == 0)
+                    {
+                        if (m_enqueue.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                        {
+                            break;
+                        }
+                    }
+                    else if (diff < 0)
+                    {
+                        return false;
+                    }
+                    else
+                    {
+                        pos = m_enqueue.load(std::memory_order_relaxed);
+                    }
+                }
+                cell->value.emplace(std::move(value));
+                cell->sequence.store(pos + 1, std::memory_order_release);
+                return true;
+            }
+
+            bool tryPop(T& value)
+            {
+                Cell* cell;
+                std::size_t pos = m_dequeue.load(std::memory_order_relaxed);
+                for (;;)
+                {
+                    cell = &m_cells[pos & m_mask];
+                    const std::size_t sequence = cell->sequence.load(std::memory_order_acquire);
+                    const std::intptr_t diff = static_cast<std::intptr_t>(sequence) - static_cast<std::intptr_t>(pos + 1);
+                    if (diff == 0)
+                    {
+                        if (m_dequeue.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                        {
+                            break;
+                        }
+                    }
+                    else if (diff < 0)
+                    {
+                        return false;
+                    }
+                    else
+                    {
+                        pos = m_dequeue.load(std::memory_order_relaxed);
+                    }
+                }
+                value = std::move(*cell->value);
+                cell->value.reset();
+                cell->sequence.store(pos + m_mask + 1, std::memory_order_release);
+                return true;
+            }
+
+            // false if the pipeline failed before there was room
+            bool push(T value)
+            {
+                while (!tryPush(value))
+                {
+                    if (m_aborted.load(std::memory_order_acquire))
+                    {
+                        return false;
+                    }
+                    std::this_thread::yield();
+                }
+                return true;
+            }
+
+            // false once all producers are done and the queue is drained, or once the pipeline failed
+            bool pop(T& value)
+            {
+                for (;;)
+                {
+                    if (m_aborted.load(std::memory_order_acquire))
+                    {
+                        return false;
+                    }
+                    if (tryPop(value))
+                    {
+                        return true;
+                    }
+                    if (m_closed.load(std::memory_order_acquire))
+                    {
+                        // everything pushed before closing is visible now
+                        return tryPop(value);
+                    }
+                    std::this_thread::yield();
+                }
+            }
+
+            void producerDone()
+            {
+                if (m_producers.fetch_sub(1, std::memory_order_acq_rel) == 1)
+                {
+                    m_closed.store(true, std::memory_order_release);
+                }
+            }
+
+        private:
+            static std::size_t roundUp(std::size_t capacity)
+            {
+                std::size_t size = 2;
+                while (size < capacity)
+                {
+                    size *= 2;
+                }
+                return size;
+            }
+
+            const std::size_t m_mask;
+            std::unique_ptr<Cell[]> m_cells;
+            // producers and consumers on separate cache lines
+            char m_pad0[64];
+            std::atomic<std::size_t> m_enqueue;
+            char m_pad1[64];
+            std::atomic<std::size_t> m_dequeue;
+            char m_pad2[64];
+            std::atomic<std::size_t> m_producers;
+            std::atomic<bool> m_closed;
+            const std::atomic<bool>& m_aborted;
+        };
+
+        // consecutive elements travelling together, numbered by the source for ordered output
+        template<typename T>
+        struct PipelineBatch
+        {
+            std::size_t seq;
+            std::vector<T> values;
+        };
+
+        // element type after running through the given stages
+        template<typename In, typename... Stages>
+        struct pipeline_value
+        {
+            typedef In type;
+        };
+
+        template<typename In, typename Fun, typename... Stages>
+        struct pipeline_value<In, PipelineStage<Fun>, Stages...>
+            : pipeline_value<typename std::decay<decltype(std::declval<const Applicator<Fun>&>()(std::declval<In&>()))>::type, Stages...>
+        {
+        };
+    }
+};
+
+template<typename Source, typename... Stages>
+class functional::Pipeline
+{
+    typedef typename std::decay<decltype(*std::declval<const typename std::decay<Source>::type&>().begin())>::type source_type;
+
+public:
+    typedef typename functional_impl::helpers::pipeline_value<source_type, Stages...>::type value_type;
+
+    Pipeline(Source&& source, std::tuple<Stages...> stages, std::size_t batchSize, std::size_t queueCapacity, bool ordered)
+        : m_source(std::forward<Source>(source))
+        , m_stages(std::move(stages))
+        , m_batchSize(batchSize)
+        , m_queueCapacity(queueCapacity)
+        , m_ordered(ordered)
+    {
+    }
+
+    //! adds a stage applying fun to every element on the given number of threads (consumes the builder)
+    template<typename Fun>
+    Pipeline<Source, Stages..., functional_impl::helpers::PipelineStage<Fun>> stage(Fun fun, std::size_t workers = 1)
+    {
+        return Pipeline<Source, Stages..., functional_impl::helpers::PipelineStage<Fun>>(std::forward<Source>(m_source),
+            std::tuple_cat(std::move(m_stages), std::make_tuple(functional_impl::helpers::PipelineStage<Fun>{ fun, workers })),
+            m_batchSize, m_queueCapacity, m_ordered);
+    }
+
+    //! delivers the results to the final fold in source order rather than in order of completion; the source
+    //! stays at most as many batches as the queues hold ahead of the sink, which bounds the reorder buffer
+    Pipeline ordered()
+    {
+        m_ordered = true;
+        return std::move(*this);
+    }
+
+    //! runs the pipeline, folding the results on the calling thread; the first exception thrown by the source,
+    //! a stage or fun stops all threads and is rethrown here
+    template<typename Fun, typename T>
+    T foldl(Fun fun, T init)
+    {
+        const functional_impl::helpers::Applicator<Fun> f{ fun };
+        T acc(std::move(init));
+        run([&](value_type& value) { acc = functional_impl::helpers::foldStep(f, acc, value, 0); });
+        return acc;
+    }
+
+    //! runs the pipeline, collecting the results into a vector
+    std::vector<value_type> collect()
+    {
+        std::vector<value_type> result;
+        run([&](value_type& value) { result.push_back(std::move(value)); });
+        return result;
+    }
+
+private:
+    template<typename Sink>
+    void run(Sink sink)
+    {
+        typedef functional_impl::helpers::PipelineBatch<source_type> Batch;
+
+        functional_impl::helpers::PipelineState state;
+        std::vector<std::thread> threads;
+        try
+        {
+            const std::size_t window = m_ordered ? m_queueCapacity * (sizeof...(Stages) + 1) : 0;
+            auto first = std::make_shared<functional_impl::helpers::BoundedQueue<Batch>>(m_queueCapacity, 1, state.failed);
+            threads.emplace_back([this, first, &state, window]
+            {
+                try
+                {
+                    Batch batch = { 0, std::vector<source_type>() };
+                    batch.values.reserve(m_batchSize);
+                    for (const auto& value : m_source)
+                    {
+                        batch.values.push_back(value);
+                        if (batch.values.size() == m_batchSize)
+                        {
+                            const std::size_t next = batch.seq + 1;
+                            if (!admit(state, batch.seq, window) || !first->push(std::move(batch)))
+                            {
+                                break;
+                            }
+                            batch = Batch{ next, std::vector<source_type>() };
+                            batch.values.reserve(m_batchSize);
+                        }
+                    }
+                    if (!batch.values.empty() && admit(state, batch.seq, window))
+                    {
+                        first->push(std::move(batch));
+                    }
+                }
+                catch (...)
+                {
+                    state.fail(std::current_exception());
+                }
+                first->producerDone();
+            });
+
+            launch<0>(first, threads, state, sink, std::integral_constant<bool, sizeof...(Stages) == 0>());
+        }
+        catch (...)
+        {
+            state.fail(std::current_exception());
+        }
+        for (auto& thread : threads)
+        {
+            thread.join();
+        }
+        if (state.error)
+        {
+            std::rethrow_exception(state.error);
+        }
+    }
+
+    // waits until the ordered sink is within window batches of seq; a window of 0 means unordered
+    static bool admit(const functional_impl::helpers::PipelineState& state, std::size_t seq, std::size_t window)
+    {
+        while (window != 0 && seq >= state.delivered.load(std::memory_order_acquire) + window)
+        {
+            if (state.failed.load(std::memory_order_acquire))
+            {
+                return false;
+            }
+            std::this_thread::yield();
+        }
+        return true;
+    }
+
+    template<std::size_t I, typename In, typename Sink>
+    void launch(const std::shared_ptr<functional_impl::helpers::BoundedQueue<functional_impl::helpers::PipelineBatch<In>>>& in, std::vector<std::thread>& threads, functional_impl::helpers::PipelineState& state, Sink& sink, std::false_type)
+    {
+        typedef typename std::tuple_element<I, std::tuple<Stages...>>::type Stage;
+        typedef typename functional_impl::helpers::pipeline_value<In, Stage>::type Out;
+        typedef functional_impl::helpers::PipelineBatch<In> InBatch;
+        typedef functional_impl::helpers::PipelineBatch<Out> OutBatch;
+
+        const Stage& stage = std::get<I>(m_stages);
+        const std::size_t workers = std::max<std::size_t>(1, stage.workers);
+        auto out = std::make_shared<functional_impl::helpers::BoundedQueue<OutBatch>>(m_queueCapacity, workers, state.failed);
+        for (std::size_t i = 0; i < workers; ++i)
+        {
+            threads.emplace_back([in, out, &stage, &state]
+            {
+                try
+                {
+                    const functional_impl::helpers::Applicator<decltype(stage.fun)> f{ stage.fun };
+                    InBatch batch;
+                    while (in->pop(batch))
+                    {
+                        FUNCTIONAL_TRACE_SCOPE("stage");
+                        OutBatch mapped = { batch.seq, std::vector<Out>() };
+                        mapped.values.reserve(batch.values.size());
+                        for (auto& value : batch.values)
+                        {
+                            mapped.values.push_back(f(value));
+                        }
+                        if (!out->push(std::move(mapped)))
+                        {
+                            break;
+                        }
+                    }
+                }
+                catch (...)
+                {
+                    state.fail(std::current_exception());
+                }
+                out->producerDone();
+            });
+        }
+        launch<I + 1>(out, threads, state, sink, std::integral_constant<bool, I + 1 == sizeof...(Stages)>());
+    }
+
+    template<std::size_t I, typename In, typename Sink>
+    void launch(const std::shared_ptr<functional_impl::helpers::BoundedQueue<functional_impl::helpers::PipelineBatch<In>>>& in, std::vector<std::thread>&, functional_impl::helpers::PipelineState& state, Sink& sink, std::true_type)
+    {
+        functional_impl::helpers::PipelineBatch<In> batch;
+        if (!m_ordered)
+        {
+            while (in->pop(batch))
+            {
+                FUNCTIONAL_TRACE_SCOPE("sink");
+                for (auto& value : batch.values)
+                {
+                    sink(value);
+                }
+            }
+            return;
+        }
+
+        // batches overtaking each other in stages with several workers wait here for their predecessors;
+        // the source never runs more than the window ahead of next, so this stays bounded
+        std::map<std::size_t, std::vector<In>> pending;
+        std::size_t next = 0;
+        while (in->pop(batch))
+        {
+            FUNCTIONAL_TRACE_SCOPE("sink");
+            pending.insert(std::make_pair(batch.seq, std::move(batch.values)));
+            while (!pending.empty() && pending.begin()->first == next)
+            {
+                for (auto& value : pending.begin()->second)
+                {
+                    sink(value);
+                }
+                pending.erase(pending.begin());
+                state.delivered.store(++next, std::memory_order_release);
+            }
+        }
+    }
+
+    Source m_source;
+    std::tuple<Stages...> m_stages;
+    std::size_t m_batchSize;
+    std::size_t m_queueCapacity;
+    bool m_ordered;
+};
+
+template<typename Source>
+functional::Pipeline<Source> functional::pipeline(Source&& source, std::size_t batchSize, std::size_t queueCapacity)
+{
+    return Pipeline<Source>(std::forward<Source>(source), std::tuple<>(), std::max<std::size_t>(1, batchSize), queueCapacity, false);
+}
+
+#endif // _PIPELINE_HPP_
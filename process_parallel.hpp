@@ -0,0 +1,445 @@
+/*
+Copyright (c) 2013 Janick Bernet
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#ifndef _PROCESS_PARALLEL_HPP_
+#define _PROCESS_PARALLEL_HPP_
+
+// Process based parallelism for callables that must not run on threads (not thread-safe, leaking, or
+// crashing now and then): map and apply with proc_par fork a pool of worker processes that pick chunks
+// of the input by index and write their results into shared memory, so nothing is serialized. The input
+// reaches the workers through fork, results must be trivially copyable. Workers that die are replaced,
+// and the chunk they were working on is retried up to retries() times; a worker that throws counts as
+// dead. Both throw process_failure for chunks that never succeeded. On platforms without fork both run
+// serially in the calling process.
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <exception>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+#include <assert.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+    #include <chrono>
+    #include <new>
+    #include <sys/mman.h>
+    #include <sys/types.h>
+    #include <sys/wait.h>
+    #include <unistd.h>
+#endif
+
+#include "parallel.hpp"
+
+namespace functional
+{
+    class process_policy;
+
+    // thrown by the process parallel map and apply for the chunks whose workers kept dying
+    class process_failure;
+
+    //! map :: ProcPar -> (a -> b) -> [a] -> [b]
+    // throws process_failure if chunks still fail after all retries
+    template<typename Fun, typename Container>
+    auto map(const process_policy& policy, Fun fun, const Container& input) -> std::vector<typename std::decay<decltype(std::declval<const functional_impl::helpers::Applicator<Fun>&>()(*input.begin()))>::type>;
+
+    //! apply :: ProcPar -> (a -> ()) -> [a] -> ()
+    // the workers modify copies of the elements, which are copied back into inout; throws process_failure
+    // if chunks still fail after all retries, after the chunks that succeeded have been copied back
+    template<typename Fun, typename Container>
+    void apply(const process_policy& policy, Fun fun, Container& inout);
+};
+
+class functional::process_policy
+{
+public:
+    process_policy()
+        : m_workers(0)
+        , m_retries(2)
+        , m_batchSize(0)
+    {
+    }
+
+    //! number of worker processes, the hardware concurrency by default
+    process_policy workers(std::size_t workers) const
+    {
+        process_policy policy(*this);
+        policy.m_workers = workers;
+        return policy;
+    }
+
+    //! how often a chunk is retried after the worker processing it died
+    process_policy retries(std::size_t retries) const
+    {
+        process_policy policy(*this);
+        policy.m_retries = retries;
+        return policy;
+    }
+
+    //! elements per chunk, by default a few chunks per worker
+    process_policy batch(std::size_t batchSize) const
+    {
+        process_policy policy(*this);
+        policy.m_batchSize = batchSize;
+        return policy;
+    }
+
+    std::size_t workers() const
+    {
+        return m_workers > 0 ? m_workers : std::max<std::size_t>(1, std::thread::hardware_concurrency());
+    }
+
+    std::size_t retries() const { return m_retries; }
+
+    std::size_t batchSize(std::size_t elements) const
+    {
+        return m_batchSize > 0 ? m_batchSize : std::max<std::size_t>(1, (elements + workers() * 4 - 1) / (workers() * 4));
+    }
+
+private:
+    std::size_t m_workers;
+    std::size_t m_retries;
+    std::size_t m_batchSize;
+};
+
+namespace functional
+{
+    static const process_policy proc_par;
+};
+
+class functional::process_failure : public std::runtime_error
+{
+public:
+    explicit process_failure(std::vector<std::size_t> chunks)
+        : std::runtime_error(describe(chunks))
+        , m_chunks(std::move(chunks))
+    {
+    }
+
+    //! indices of the chunks given up on after all retries
+    const std::vector<std::size_t>& chunks() const { return m_chunks; }
+
+private:
+    static std::string describe(const std::vector<std::size_t>& chunks)
+    {
+        std::string message = "process parallel workers failed on chunk";
+        message += chunks.size() == 1 ? " " : "s ";
+        for (std::size_t i = 0; i < chunks.size(); ++i)
+        {
+            message += (i == 0 ? "" : ", ") + std::to_string(chunks[i]);
+        }
+        return message;
+    }
+
+    std::vector<std::size_t> m_chunks;
+};
+
+namespace functional_impl
+{
+    namespace helpers
+    {
+#if defined(__unix__) || defined(__APPLE__)
+        // anonymous shared mapping, zero filled and inherited by forked children
+        template<typename T>
+        class SharedArray
+        {
+        public:
+            explicit SharedArray(std::size_t size)
+                : m_bytes(std::max<std::size_t>(1, size * sizeof(T)))
+            {
+                void* memory = mmap(nullptr, m_bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+                if (memory == MAP_FAILED)
+                {
+                    throw std::bad_alloc();
+                }
+                m_data = static_cast<T*>(memory);
+            }
+
+            SharedArray(const SharedArray&) = delete;
+            SharedArray& operator= (const SharedArray&) = delete;
+
+            ~SharedArray()
+            {
+                munmap(m_data, m_bytes);
+            }
+
+            T* data() const { return m_data; }
+            T& operator[] (std::size_t pos) const { return m_data[pos]; }
+
+        private:
+            std::size_t m_bytes;
+            T* m_data;
+        };
+
+        // runs process(chunk) for every chunk in worker processes, returns the chunks given up on.
+        // The chunk table in shared memory says which worker (slot + 1) is working on which chunk, so the
+        // parent knows what to hand the replacement of a worker that died
+        template<typename Process>
+        inline std::vector<std::size_t> runInProcesses(const functional::process_policy& policy, std::size_t chunkCount, const Process& process)
+        {
+            static const int Done = -1;
+
+            SharedArray<std::atomic<std::size_t>> next(1);
+            new (&next[0]) std::atomic<std::size_t>(0);
+            SharedArray<std::atomic<int>> states(chunkCount);
+            for (std::size_t i = 0; i < chunkCount; ++i)
+            {
+                new (&states[i]) std::atomic<int>(0);
+            }
+            assert(next[0].is_lock_free() && (chunkCount == 0 || states[0].is_lock_free()));
+
+            auto work = [&](std::size_t slot, const std::vector<std::size_t>& redo)
+            {
+                auto run = [&](std::size_t chunk)
+                {
+                    states[chunk].store(static_cast<int>(slot + 1));
+                    process(chunk);
+                    states[chunk].store(Done);
+                };
+                for (std::size_t chunk : redo)
+                {
+                    run(chunk);
+                }
+                for (std::size_t chunk = next[0]++; chunk < chunkCount; chunk = next[0]++)
+                {
+                    run(chunk);
+                }
+            };
+
+            const std::size_t workers = std::min(policy.workers(), chunkCount);
+            std::vector<pid_t> pids(workers, -1);
+            std::exception_ptr parentError;
+            // without a worker process (fork refused) the parent does the work itself. An exception must never
+            // unwind a child into the caller's code, so it ends the child like a crash would
+            auto spawn = [&](std::size_t slot, const std::vector<std::size_t>& redo)
+            {
+                const pid_t pid = fork();
+                if (pid == 0)
+                {
+                    try
+                    {
+                        work(slot, redo);
+                    }
+                    catch (...)
+                    {
+                        _exit(1);
+                    }
+                    _exit(0);
+                }
+                if (pid < 0)
+                {
+                    try
+                    {
+                        work(slot, redo);
+                    }
+                    catch (...)
+                    {
+                        // rethrown once the running workers are reaped
+                        if (!parentError)
+                        {
+                            parentError = std::current_exception();
+                        }
+                    }
+                }
+                pids[slot] = pid;
+            };
+
+            for (std::size_t slot = 0; slot < workers; ++slot)
+            {
+                spawn(slot, std::vector<std::size_t>());
+            }
+
+            std::vector<std::size_t> attempts(chunkCount, 0);
+            std::vector<std::size_t> failed;
+            for (;;)
+            {
+                bool alive = false;
+                for (std::size_t slot = 0; slot < workers; ++slot)
+                {
+                    if (pids[slot] <= 0)
+                    {
+                        continue;
+                    }
+                    int status = 0;
+                    const pid_t pid = waitpid(pids[slot], &status, WNOHANG);
+                    if (pid == 0)
+                    {
+                        alive = true;
+                        continue;
+                    }
+                    pids[slot] = -1;
+                    if (pid < 0 || (WIFEXITED(status) && WEXITSTATUS(status) == 0))
+                    {
+                        continue;
+                    }
+
+                    std::vector<std::size_t> redo;
+                    for (std::size_t chunk = 0; chunk < chunkCount; ++chunk)
+                    {
+                        if (states[chunk].load() != static_cast<int>(slot + 1))
+                        {
+                            continue;
+                        }
+                        if (++attempts[chunk] > policy.retries())
+                        {
+                            states[chunk].store(Done);
+                            failed.push_back(chunk);
+                        }
+                        else
+                        {
+                            states[chunk].store(0);
+                            redo.push_back(chunk);
+                        }
+                    }
+                    if (!redo.empty() || next[0].load() < chunkCount)
+                    {
+                        spawn(slot, redo);
+                        alive = alive || pids[slot] > 0;
+                    }
+                }
+                if (!alive)
+                {
+                    break;
+                }
+                std::this_thread::sleep_for(std::chrono::microseconds(100));
+            }
+            if (parentError)
+            {
+                std::rethrow_exception(parentError);
+            }
+            return failed;
+        }
+#endif
+
+        // first element of every chunk in a dense output
+        template<typename Chunks>
+        inline std::vector<std::size_t> chunkOffsets(const Chunks& chunks)
+        {
+            std::vector<std::size_t> offsets(chunks.size() + 1, 0);
+            for (std::size_t i = 0; i < chunks.size(); ++i)
+            {
+                offsets[i + 1] = offsets[i] + chunks[i].size();
+            }
+            return offsets;
+        }
+    }
+};
+
+template<typename Fun, typename Container>
+auto functional::map(const process_policy& policy, Fun fun, const Container& input) -> std::vector<typename std::decay<decltype(std::declval<const functional_impl::helpers::Applicator<Fun>&>()(*input.begin()))>::type>
+{
+    typedef typename std::decay<decltype(std::declval<const functional_impl::helpers::Applicator<Fun>&>()(*input.begin()))>::type ResultType;
+    static_assert(std::is_trivially_copyable<ResultType>::value, "Results of process parallel map must be trivially copyable.");
+
+    FUNCTIONAL_PROBE("map", Fun);
+    const functional_impl::helpers::Applicator<Fun> f{ fun };
+#if defined(__unix__) || defined(__APPLE__)
+    const auto chunks = functional_impl::helpers::chunks(input, policy.batchSize(functional_impl::helpers::iteratableSize(input, 0)));
+    const auto offsets = functional_impl::helpers::chunkOffsets(chunks);
+    FUNCTIONAL_PROBE_ELEMENTS(offsets.back());
+
+    functional_impl::helpers::SharedArray<ResultType> results(offsets.back());
+    const auto failed = functional_impl::helpers::runInProcesses(policy, chunks.size(), [&](std::size_t chunk)
+    {
+        ResultType* target = results.data() + offsets[chunk];
+        for (const auto& value : chunks[chunk])
+        {
+            *target++ = f(value);
+        }
+    });
+    if (!failed.empty())
+    {
+        throw process_failure(failed);
+    }
+    return std::vector<ResultType>(results.data(), results.data() + offsets.back());
+#else
+    (void)policy;
+    std::vector<ResultType> results;
+    for (const auto& value : input)
+    {
+        results.push_back(f(value));
+    }
+    return results;
+#endif
+}
+
+template<typename Fun, typename Container>
+void functional::apply(const process_policy& policy, Fun fun, Container& inout)
+{
+    typedef typename std::decay<decltype(*inout.begin())>::type ValueType;
+    static_assert(std::is_trivially_copyable<ValueType>::value, "Elements of process parallel apply must be trivially copyable.");
+
+    FUNCTIONAL_PROBE("apply", Fun);
+    const functional_impl::helpers::Applicator<Fun> f{ fun };
+#if defined(__unix__) || defined(__APPLE__)
+    const auto chunks = functional_impl::helpers::chunks(inout, policy.batchSize(functional_impl::helpers::iteratableSize(inout, 0)));
+    const auto offsets = functional_impl::helpers::chunkOffsets(chunks);
+    FUNCTIONAL_PROBE_ELEMENTS(offsets.back());
+
+    functional_impl::helpers::SharedArray<ValueType> copies(offsets.back());
+    const auto failed = functional_impl::helpers::runInProcesses(policy, chunks.size(), [&](std::size_t chunk)
+    {
+        ValueType* target = copies.data() + offsets[chunk];
+        for (const auto& value : chunks[chunk])
+        {
+            ValueType copy(value);
+            f(copy);
+            *target++ = copy;
+        }
+    });
+    // elements of chunks that kept crashing their workers stay unchanged, the others are copied back first
+    std::vector<char> keep(chunks.size(), 0);
+    for (std::size_t chunk : failed)
+    {
+        keep[chunk] = 1;
+    }
+    std::size_t chunk = 0;
+    std::size_t pos = 0;
+    for (auto& value : inout)
+    {
+        while (pos == offsets[chunk + 1])
+        {
+            ++chunk;
+        }
+        if (!keep[chunk])
+        {
+            value = copies[pos];
+        }
+        ++pos;
+    }
+    if (!failed.empty())
+    {
+        throw process_failure(failed);
+    }
+#else
+    (void)policy;
+    for (auto& value : inout)
+    {
+        f(value);
+    }
+#endif
+}
+
+#endif // _PROCESS_PARALLEL_HPP_
@@ -0,0 +1,546 @@
+/*
+Copyright (c) 2013 Janick Bernet
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#ifndef _SKETCH_HPP_
+#define _SKETCH_HPP_
+
+// Fixed size approximate summaries of a stream: distinct counts (hyperloglog), quantiles (tdigest),
+// frequencies (count_min) and heavy hitters (top_k). Every sketch takes values with insert() and absorbs
+// another sketch of the same shape with merge(), which is associative, so a stream can be summarized in
+// parts (per thread, per file, per window) and the parts merged in any grouping. sketch::insert and
+// sketch::merge adapt them to foldl and the parallel foldl, monoid::Sketch to window_fold.
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include <assert.h>
+
+#if defined(_MSC_VER)
+    #include <intrin.h>
+#endif
+
+namespace functional
+{
+    // distinct count estimate from 2^precision one byte registers, with a standard error of about 1.04 / sqrt(2^precision)
+    class hyperloglog;
+
+    // quantile estimate from weighted centroids, which are smaller towards the tails, so extreme quantiles stay accurate
+    class tdigest;
+
+    // frequency estimate from depth rows of width counters, overestimating by at most 2 / width of the total
+    // with probability 1 - 2^-depth
+    class count_min;
+
+    // the k most frequent values, each with a count overestimating the true one by at most its error
+    template<typename T, typename Hash = std::hash<T>>
+    class top_k;
+
+    namespace sketch
+    {
+        // foldl step inserting a value into a sketch
+        struct Insert
+        {
+            template<typename Sketch, typename T>
+            Sketch operator() (Sketch sketch, const T& value) const
+            {
+                sketch.insert(value);
+                return sketch;
+            }
+        };
+
+        // parallel foldl combine merging two sketches
+        struct Merge
+        {
+            template<typename Sketch>
+            Sketch operator() (Sketch lhs, const Sketch& rhs) const
+            {
+                lhs.merge(rhs);
+                return lhs;
+            }
+        };
+
+        static const Insert insert;
+        static const Merge merge;
+    }
+
+    namespace monoid
+    {
+        // a sketch as a window_fold monoid, empty() being a copy of the given (empty) sketch of the wanted shape
+        template<typename S>
+        struct Sketch
+        {
+            typedef S value_type;
+
+            explicit Sketch(S prototype = S())
+                : prototype(std::move(prototype))
+            {
+            }
+
+            S empty() const { return prototype; }
+            S combine(S lhs, const S& rhs) const { lhs.merge(rhs); return lhs; }
+
+            S prototype;
+        };
+    }
+};
+
+namespace functional_impl
+{
+    namespace helpers
+    {
+        // std::hash is the identity for integers on common implementations, so its bits are mixed before use (murmur3's finalizer)
+        template<typename T, typename Hash = std::hash<T>>
+        inline std::uint64_t sketchHash(const T& value, const Hash& hash = Hash())
+        {
+            std::uint64_t h = static_cast<std::uint64_t>(hash(value));
+            h ^= h >> 33;
+            h *= 0xff51afd7ed558ccdull;
+            h ^= h >> 33;
+            h *= 0xc4ceb9fe1a85ec53ull;
+            h ^= h >> 33;
+            return h;
+        }
+
+        inline unsigned leadingZeros(std::uint64_t bits)
+        {
+            if (bits == 0)
+            {
+                return 64;
+            }
+#if defined(_MSC_VER)
+            unsigned long index;
+            _BitScanReverse64(&index, bits);
+            return 63 - static_cast<unsigned>(index);
+#else
+            return static_cast<unsigned>(__builtin_clzll(bits));
+#endif
+        }
+
+        struct Centroid
+        {
+            double mean;
+            double weight;
+
+            bool operator< (const Centroid& other) const { return mean < other.mean; }
+        };
+    }
+};
+
+class functional::hyperloglog
+{
+public:
+    explicit hyperloglog(unsigned precision = 14)
+        : m_precision(precision)
+        , m_registers(std::size_t(1) << precision, 0)
+    {
+        assert(precision >= 4 && precision <= 18 && "hyperloglog precision must be within [4, 18]");
+    }
+
+    // the leading bits of the hash pick the register, which keeps the longest run of zeros seen in the remaining bits
+    template<typename T>
+    void insert(const T& value)
+    {
+        const std::uint64_t hash = functional_impl::helpers::sketchHash(value);
+        const std::size_t index = static_cast<std::size_t>(hash >> (64 - m_precision));
+        const std::uint8_t rank = static_cast<std::uint8_t>(functional_impl::helpers::leadingZeros((hash << m_precision) | (std::uint64_t(1) << (m_precision - 1))) + 1);
+        m_registers[index] = std::max(m_registers[index], rank);
+    }
+
+    void merge(const hyperloglog& other)
+    {
+        assert(m_precision == other.m_precision && "merged hyperloglogs must have the same precision");
+        for (std::size_t i = 0; i < m_registers.size(); ++i)
+        {
+            m_registers[i] = std::max(m_registers[i], other.m_registers[i]);
+        }
+    }
+
+    // harmonic mean of the registers, by linear counting while registers are still empty and the estimate is small
+    double estimate() const
+    {
+        const double m = static_cast<double>(m_registers.size());
+        double sum = 0;
+        std::size_t zeros = 0;
+        for (std::uint8_t rank : m_registers)
+        {
+            sum += std::ldexp(1.0, -static_cast<int>(rank));
+            zeros += rank == 0;
+        }
+        const double alpha = m_registers.size() == 16 ? 0.673 : m_registers.size() == 32 ? 0.697 : m_registers.size() == 64 ? 0.709 : 0.7213 / (1 + 1.079 / m);
+        const double raw = alpha * m * m / sum;
+        return raw <= 2.5 * m && zeros > 0 ? m * std::log(m / static_cast<double>(zeros)) : raw;
+    }
+
+    unsigned precision() const { return m_precision; }
+
+private:
+    unsigned m_precision;
+    std::vector<std::uint8_t> m_registers;
+};
+
+// merging t-digest: inserted values are buffered, and the buffer is merged into the centroids once it is full, on
+// merge and on compress(). Queries never modify the digest, so concurrent readers are safe; with values still
+// buffered they work on a compressed copy. Neighbouring centroids are merged while they span at most one unit of the arcsine scale
+// k(q) = compression / 2pi * asin(2q - 1), which keeps at most about compression centroids
+class functional::tdigest
+{
+public:
+    explicit tdigest(double compression = 100)
+        : m_compression(compression)
+        , m_total(0)
+        , m_min(std::numeric_limits<double>::infinity())
+        , m_max(-std::numeric_limits<double>::infinity())
+    {
+        assert(compression >= 10 && "tdigest compression must be at least 10");
+    }
+
+    void insert(double value, double weight = 1)
+    {
+        m_buffer.push_back(functional_impl::helpers::Centroid{ value, weight });
+        m_total += weight;
+        m_min = std::min(m_min, value);
+        m_max = std::max(m_max, value);
+        if (m_buffer.size() >= bufferSize())
+        {
+            compress();
+        }
+    }
+
+    void merge(const tdigest& other)
+    {
+        m_buffer.insert(m_buffer.end(), other.m_centroids.begin(), other.m_centroids.end());
+        m_buffer.insert(m_buffer.end(), other.m_buffer.begin(), other.m_buffer.end());
+        m_total += other.m_total;
+        m_min = std::min(m_min, other.m_min);
+        m_max = std::max(m_max, other.m_max);
+        compress();
+    }
+
+    //! merges the buffered values into the centroids, so that queries don't have to compress a copy
+    void compress()
+    {
+        if (m_buffer.empty())
+        {
+            return;
+        }
+        m_buffer.insert(m_buffer.end(), m_centroids.begin(), m_centroids.end());
+        std::sort(m_buffer.begin(), m_buffer.end());
+        m_centroids.clear();
+
+        functional_impl::helpers::Centroid current = m_buffer.front();
+        double before = 0;
+        double limit = scale(0) + 1;
+        for (std::size_t i = 1; i < m_buffer.size(); ++i)
+        {
+            const auto& next = m_buffer[i];
+            if (scale((before + current.weight + next.weight) / m_total) <= limit)
+            {
+                current.weight += next.weight;
+                current.mean += (next.mean - current.mean) * next.weight / current.weight;
+            }
+            else
+            {
+                m_centroids.push_back(current);
+                before += current.weight;
+                limit = scale(before / m_total) + 1;
+                current = next;
+            }
+        }
+        m_centroids.push_back(current);
+        m_buffer.clear();
+    }
+
+    // interpolates between the centers of the centroids around the rank q * count(), and between the outer ones and min/max
+    double quantile(double q) const
+    {
+        if (!m_buffer.empty())
+        {
+            tdigest compressed(*this);
+            compressed.compress();
+            return compressed.quantile(q);
+        }
+        if (m_centroids.empty())
+        {
+            return std::numeric_limits<double>::quiet_NaN();
+        }
+        const double target = std::min(std::max(q, 0.0), 1.0) * m_total;
+        double left = 0;
+        double leftValue = m_min;
+        double cumulative = 0;
+        for (const auto& centroid : m_centroids)
+        {
+            const double center = cumulative + centroid.weight / 2;
+            if (target <= center)
+            {
+                return center > left ? leftValue + (target - left) / (center - left) * (centroid.mean - leftValue) : centroid.mean;
+            }
+            left = center;
+            leftValue = centroid.mean;
+            cumulative += centroid.weight;
+        }
+        return m_total > left ? leftValue + (target - left) / (m_total - left) * (m_max - leftValue) : m_max;
+    }
+
+    double count() const { return m_total; }
+    double min() const { return m_min; }
+    double max() const { return m_max; }
+
+    // the number of centroids after merging the buffer
+    std::size_t size() const
+    {
+        if (!m_buffer.empty())
+        {
+            tdigest compressed(*this);
+            compressed.compress();
+            return compressed.size();
+        }
+        return m_centroids.size();
+    }
+
+private:
+    std::size_t bufferSize() const
+    {
+        return static_cast<std::size_t>(5 * m_compression);
+    }
+
+    double scale(double q) const
+    {
+        return m_compression / (2 * std::acos(-1.0)) * std::asin(2 * std::min(std::max(q, 0.0), 1.0) - 1);
+    }
+
+    double m_compression;
+    double m_total;
+    double m_min;
+    double m_max;
+    std::vector<functional_impl::helpers::Centroid> m_centroids;
+    std::vector<functional_impl::helpers::Centroid> m_buffer;
+};
+
+// every row hashes a value to one of its counters; the rows' hashes are derived from one 64 bit hash as h1 + row * h2
+class functional::count_min
+{
+public:
+    explicit count_min(std::size_t width = 2048, std::size_t depth = 5)
+        : m_width(width)
+        , m_depth(depth)
+        , m_total(0)
+        , m_counters(width * depth, 0)
+    {
+        assert(width > 0 && depth > 0 && "count_min needs at least one counter per row and one row");
+    }
+
+    template<typename T>
+    void insert(const T& value, std::uint64_t count = 1)
+    {
+        const std::uint64_t hash = functional_impl::helpers::sketchHash(value);
+        for (std::size_t row = 0; row < m_depth; ++row)
+        {
+            m_counters[row * m_width + column(hash, row)] += count;
+        }
+        m_total += count;
+    }
+
+    void merge(const count_min& other)
+    {
+        assert(m_width == other.m_width && m_depth == other.m_depth && "merged count_min sketches must have the same shape");
+        for (std::size_t i = 0; i < m_counters.size(); ++i)
+        {
+            m_counters[i] += other.m_counters[i];
+        }
+        m_total += other.m_total;
+    }
+
+    // the smallest counter of the value over all rows, never less than its true count
+    template<typename T>
+    std::uint64_t estimate(const T& value) const
+    {
+        const std::uint64_t hash = functional_impl::helpers::sketchHash(value);
+        std::uint64_t result = std::numeric_limits<std::uint64_t>::max();
+        for (std::size_t row = 0; row < m_depth; ++row)
+        {
+            result = std::min(result, m_counters[row * m_width + column(hash, row)]);
+        }
+        return result;
+    }
+
+    std::uint64_t total() const { return m_total; }
+
+private:
+    std::size_t column(std::uint64_t hash, std::size_t row) const
+    {
+        const std::uint64_t h1 = hash & 0xffffffffu;
+        const std::uint64_t h2 = (hash >> 32) | 1;
+        return static_cast<std::size_t>((h1 + row * h2) % m_width);
+    }
+
+    std::size_t m_width;
+    std::size_t m_depth;
+    std::uint64_t m_total;
+    std::vector<std::uint64_t> m_counters;
+};
+
+// space saving: at most k monitored values in a min heap on their counts, a value that isn't monitored takes over
+// the smallest count (plus one) when the heap is full, remembering it as its error. The index keeps every value's
+// position in the heap, so counting a monitored value is a lookup and a sift down
+template<typename T, typename Hash>
+class functional::top_k
+{
+public:
+    struct entry
+    {
+        T value;
+        std::uint64_t count;
+        std::uint64_t error;
+    };
+
+    explicit top_k(std::size_t k = 100)
+        : m_k(k)
+    {
+        assert(k > 0 && "top_k needs room for at least one value");
+        m_heap.reserve(k);
+        m_index.reserve(k);
+    }
+
+    void insert(const T& value, std::uint64_t count = 1)
+    {
+        auto found = m_index.find(value);
+        if (found != m_index.end())
+        {
+            m_heap[found->second].count += count;
+            siftDown(found->second);
+        }
+        else if (m_heap.size() < m_k)
+        {
+            m_index.emplace(value, m_heap.size());
+            m_heap.push_back(entry{ value, count, 0 });
+            siftUp(m_heap.size() - 1);
+        }
+        else
+        {
+            entry& smallest = m_heap.front();
+            m_index.erase(smallest.value);
+            m_index.emplace(value, 0);
+            smallest.error = smallest.count;
+            smallest.count += count;
+            smallest.value = value;
+            siftDown(0);
+        }
+    }
+
+    // counts of values monitored by only one side are raised by the other side's smallest count, which bounds what
+    // it may have missed; the k largest of the union are kept
+    void merge(const top_k& other)
+    {
+        const std::uint64_t missedHere = m_heap.size() < m_k ? 0 : m_heap.front().count;
+        const std::uint64_t missedThere = other.m_heap.size() < other.m_k ? 0 : other.m_heap.front().count;
+
+        std::vector<entry> merged = m_heap;
+        for (auto& e : merged)
+        {
+            auto found = other.m_index.find(e.value);
+            const entry* theirs = found != other.m_index.end() ? &other.m_heap[found->second] : nullptr;
+            e.count += theirs ? theirs->count : missedThere;
+            e.error += theirs ? theirs->error : missedThere;
+        }
+        for (const auto& e : other.m_heap)
+        {
+            if (m_index.find(e.value) == m_index.end())
+            {
+                merged.push_back(entry{ e.value, e.count + missedHere, e.error + missedHere });
+            }
+        }
+
+        const std::size_t keep = std::min(m_k, merged.size());
+        std::partial_sort(merged.begin(), merged.begin() + keep, merged.end(), [](const entry& a, const entry& b) { return a.count > b.count; });
+        merged.resize(keep);
+        m_heap.swap(merged);
+        std::make_heap(m_heap.begin(), m_heap.end(), [](const entry& a, const entry& b) { return a.count > b.count; });
+        m_index.clear();
+        for (std::size_t i = 0; i < m_heap.size(); ++i)
+        {
+            m_index.emplace(m_heap[i].value, i);
+        }
+    }
+
+    // the monitored values, most frequent first
+    std::vector<entry> top() const
+    {
+        std::vector<entry> result = m_heap;
+        std::sort(result.begin(), result.end(), [](const entry& a, const entry& b) { return a.count > b.count; });
+        return result;
+    }
+
+    std::size_t size() const { return m_heap.size(); }
+
+private:
+    void swapEntries(std::size_t a, std::size_t b)
+    {
+        std::swap(m_heap[a], m_heap[b]);
+        m_index[m_heap[a].value] = a;
+        m_index[m_heap[b].value] = b;
+    }
+
+    void siftUp(std::size_t pos)
+    {
+        while (pos > 0 && m_heap[pos].count < m_heap[(pos - 1) / 2].count)
+        {
+            swapEntries(pos, (pos - 1) / 2);
+            pos = (pos - 1) / 2;
+        }
+    }
+
+    void siftDown(std::size_t pos)
+    {
+        for (;;)
+        {
+            std::size_t smallest = pos;
+            const std::size_t left = 2 * pos + 1;
+            const std::size_t right = left + 1;
+            if (left < m_heap.size() && m_heap[left].count < m_heap[smallest].count)
+            {
+                smallest = left;
+            }
+            if (right < m_heap.size() && m_heap[right].count < m_heap[smallest].count)
+            {
+                smallest = right;
+            }
+            if (smallest == pos)
+            {
+                return;
+            }
+            swapEntries(pos, smallest);
+            pos = smallest;
+        }
+    }
+
+    std::size_t m_k;
+    std::vector<entry> m_heap;
+    std::unordered_map<T, std::size_t, Hash> m_index;
+};
+
+#endif // _SKETCH_HPP_
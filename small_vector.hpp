@@ -0,0 +1,288 @@
+/*
+Copyright (c) 2013 Janick Bernet
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#ifndef _SMALL_VECTOR_HPP_
+#define _SMALL_VECTOR_HPP_
+
+#include <cstddef>
+#include <initializer_list>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <assert.h>
+
+namespace functional
+{
+    // vector keeping up to N elements inline and only moving to the heap beyond that,
+    // so short results (see the _Small<N> result tag) don't allocate at all
+    template<typename T, std::size_t N>
+    class small_vector;
+};
+
+template<typename T, std::size_t N>
+class functional::small_vector
+{
+    static_assert(N > 0, "small_vector needs room for at least one inline element.");
+
+public:
+    typedef T value_type;
+    typedef std::size_t size_type;
+    typedef T& reference;
+    typedef const T& const_reference;
+    typedef T* iterator;
+    typedef const T* const_iterator;
+
+    small_vector()
+        : m_data(inlineData())
+        , m_size(0)
+        , m_capacity(N)
+    {
+    }
+
+    small_vector(std::initializer_list<T> values)
+        : small_vector()
+    {
+        reserve(values.size());
+        for (const auto& value : values)
+        {
+            push_back(value);
+        }
+    }
+
+    template<typename Itr>
+    small_vector(Itr first, Itr last)
+        : small_vector()
+    {
+        for (; first != last; ++first)
+        {
+            push_back(*first);
+        }
+    }
+
+    small_vector(const small_vector& other)
+        : small_vector()
+    {
+        reserve(other.size());
+        for (const auto& value : other)
+        {
+            push_back(value);
+        }
+    }
+
+    // heap storage is taken over, inline elements are moved one by one
+    small_vector(small_vector&& other)
+        : small_vector()
+    {
+        steal(other);
+    }
+
+    ~small_vector()
+    {
+        clear();
+        release();
+    }
+
+    small_vector& operator= (const small_vector& other)
+    {
+        if (this != &other)
+        {
+            clear();
+            reserve(other.size());
+            for (const auto& value : other)
+            {
+                push_back(value);
+            }
+        }
+        return *this;
+    }
+
+    small_vector& operator= (small_vector&& other)
+    {
+        if (this != &other)
+        {
+            clear();
+            release();
+            m_data = inlineData();
+            m_capacity = N;
+            steal(other);
+        }
+        return *this;
+    }
+
+    iterator begin() { return m_data; }
+    iterator end() { return m_data + m_size; }
+    const_iterator begin() const { return m_data; }
+    const_iterator end() const { return m_data + m_size; }
+
+    T* data() { return m_data; }
+    const T* data() const { return m_data; }
+
+    size_type size() const { return m_size; }
+    size_type capacity() const { return m_capacity; }
+    bool empty() const { return m_size == 0; }
+
+    //! true as long as the elements live in the inline buffer
+    bool is_inline() const { return m_data == inlineData(); }
+
+    T& operator[] (size_type pos) { return m_data[pos]; }
+    const T& operator[] (size_type pos) const { return m_data[pos]; }
+
+    T& front() { return m_data[0]; }
+    const T& front() const { return m_data[0]; }
+    T& back() { return m_data[m_size - 1]; }
+    const T& back() const { return m_data[m_size - 1]; }
+
+    void reserve(size_type capacity)
+    {
+        if (capacity <= m_capacity)
+        {
+            return;
+        }
+        relocate(static_cast<T*>(::operator new(capacity * sizeof(T))), capacity);
+    }
+
+    void push_back(const T& value)
+    {
+        emplace_back(value);
+    }
+
+    void push_back(T&& value)
+    {
+        emplace_back(std::move(value));
+    }
+
+    template<typename... Args>
+    void emplace_back(Args&&... args)
+    {
+        if (m_size == m_capacity)
+        {
+            // constructed before the old elements move, the arguments may refer to one of them; if that
+            // throws, the new buffer is freed and the vector is left as it was
+            const size_type capacity = m_capacity * 2;
+            T* data = static_cast<T*>(::operator new(capacity * sizeof(T)));
+            try
+            {
+                new (data + m_size) T(std::forward<Args>(args)...);
+            }
+            catch (...)
+            {
+                ::operator delete(data);
+                throw;
+            }
+            relocate(data, capacity);
+        }
+        else
+        {
+            new (m_data + m_size) T(std::forward<Args>(args)...);
+        }
+        ++m_size;
+    }
+
+    void pop_back()
+    {
+        assert(m_size > 0);
+        m_data[--m_size].~T();
+    }
+
+    void clear()
+    {
+        while (m_size > 0)
+        {
+            m_data[--m_size].~T();
+        }
+    }
+
+    bool operator== (const small_vector& other) const
+    {
+        if (m_size != other.m_size)
+        {
+            return false;
+        }
+        for (size_type i = 0; i < m_size; ++i)
+        {
+            if (!(m_data[i] == other.m_data[i]))
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool operator!= (const small_vector& other) const
+    {
+        return !(*this == other);
+    }
+
+private:
+    T* inlineData() { return reinterpret_cast<T*>(&m_storage); }
+    const T* inlineData() const { return reinterpret_cast<const T*>(&m_storage); }
+
+    void relocate(T* data, size_type capacity)
+    {
+        for (size_type i = 0; i < m_size; ++i)
+        {
+            new (data + i) T(std::move(m_data[i]));
+            m_data[i].~T();
+        }
+        release();
+        m_data = data;
+        m_capacity = capacity;
+    }
+
+    void release()
+    {
+        if (!is_inline())
+        {
+            ::operator delete(m_data);
+        }
+    }
+
+    // expects this to be empty and inline
+    void steal(small_vector& other)
+    {
+        if (other.is_inline())
+        {
+            for (size_type i = 0; i < other.m_size; ++i)
+            {
+                new (m_data + i) T(std::move(other.m_data[i]));
+            }
+            m_size = other.m_size;
+            other.clear();
+        }
+        else
+        {
+            m_data = other.m_data;
+            m_size = other.m_size;
+            m_capacity = other.m_capacity;
+            other.m_data = other.inlineData();
+            other.m_size = 0;
+            other.m_capacity = N;
+        }
+    }
+
+    typename std::aligned_storage<N * sizeof(T), std::alignment_of<T>::value>::type m_storage;
+    T* m_data;
+    size_type m_size;
+    size_type m_capacity;
+};
+
+#endif // _SMALL_VECTOR_HPP_
@@ -0,0 +1,264 @@
+/*
+Copyright (c) 2013 Janick Bernet
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#ifndef _SOA_HPP_
+#define _SOA_HPP_
+
+#include <cstddef>
+#include <initializer_list>
+#include <tuple>
+#include <type_traits>
+#include <vector>
+
+#include "functional.hpp"
+
+namespace functional_impl
+{
+    namespace helpers
+    {
+        template<typename Container>
+        struct unzip_t;
+    }
+};
+
+namespace functional
+{
+    // struct of arrays: every field is stored in its own contiguous std::vector,
+    // so scanning one field only touches that field's memory
+    template<typename... Fields>
+    class soa;
+
+    //! unzip :: [(a, b, ...)] -> ([a], [b], ...)
+    template<typename Container>
+    auto unzip(const Container& rows) -> typename functional_impl::helpers::unzip_t<Container>::type;
+};
+
+namespace functional_impl
+{
+    namespace helpers
+    {
+        // row view over a set of equally sized columns, row i is a tuple of references to the i-th elements
+        template<typename... Columns>
+        class ColumnView
+        {
+        public:
+            typedef std::tuple<decltype(std::declval<Columns&>()[0])...> reference;
+
+            explicit ColumnView(Columns&... columns)
+                : m_columns(&columns...)
+            {
+            }
+
+            // iterators carry the column pointers themselves, so they stay valid when the view is a temporary
+            class Itr
+            {
+            public:
+                bool operator!= (const Itr& other) const
+                {
+                    return m_pos != other.m_pos;
+                }
+
+                reference operator* () const
+                {
+                    return at(m_columns, m_pos, gen_seq<sizeof...(Columns)>());
+                }
+
+                const Itr& operator++ ()
+                {
+                    ++m_pos;
+                    return *this;
+                }
+
+            private:
+                friend class ColumnView<Columns...>;
+
+                Itr(const std::tuple<Columns*...>& columns, std::size_t pos)
+                    : m_columns(columns)
+                    , m_pos(pos)
+                {
+                }
+
+                std::tuple<Columns*...> m_columns;
+                std::size_t m_pos;
+            };
+
+            Itr begin() const { return Itr(m_columns, 0); }
+            Itr end() const { return Itr(m_columns, size()); }
+
+            std::size_t size() const { return std::get<0>(m_columns)->size(); }
+
+            reference operator[] (std::size_t pos) const
+            {
+                return at(m_columns, pos, gen_seq<sizeof...(Columns)>());
+            }
+
+        private:
+            template<unsigned... Is>
+            static reference at(const std::tuple<Columns*...>& columns, std::size_t pos, seq<Is...>)
+            {
+                return reference((*std::get<Is>(columns))[pos]...);
+            }
+
+            std::tuple<Columns*...> m_columns;
+        };
+
+        template<typename... Columns>
+        struct maps_to_vector<ColumnView<Columns...>> : std::true_type {};
+
+        template<typename... Fields>
+        struct maps_to_vector<soa<Fields...>> : std::true_type {};
+
+        // soa type holding the decayed tuple elements of a container of tuples or pairs
+        template<typename Row, typename Seq>
+        struct unzip_fields;
+
+        template<typename Row, unsigned... Is>
+        struct unzip_fields<Row, seq<Is...>>
+        {
+            typedef soa<typename std::decay<typename std::tuple_element<Is, Row>::type>::type...> type;
+        };
+
+        template<typename Container>
+        struct unzip_t
+        {
+            typedef typename std::decay<decltype(*std::declval<const Container&>().begin())>::type row_type;
+            typedef typename unzip_fields<row_type, GenSeq<std::tuple_size<row_type>::value>>::type type;
+        };
+
+        template<typename Soa, typename Row, unsigned... Is>
+        inline void pushRow(Soa& soa, const Row& row, seq<Is...>)
+        {
+            soa.push_back(std::get<Is>(row)...);
+        }
+
+        template<typename Soa, typename Container>
+        inline auto reserveRows(Soa& soa, const Container& rows, int) -> decltype(soa.reserve(rows.size()))
+        {
+            soa.reserve(rows.size());
+        }
+
+        template<typename Soa, typename Container>
+        inline void reserveRows(Soa&, const Container&, long)
+        {
+        }
+    }
+};
+
+template<typename... Fields>
+class functional::soa
+{
+    typedef std::tuple<std::vector<Fields>...> Columns;
+
+public:
+    typedef std::tuple<Fields...> value_type;
+    typedef std::tuple<Fields&...> reference;
+    typedef std::tuple<const Fields&...> const_reference;
+    typedef typename functional_impl::helpers::ColumnView<std::vector<Fields>...>::Itr iterator;
+    typedef typename functional_impl::helpers::ColumnView<const std::vector<Fields>...>::Itr const_iterator;
+
+    template<std::size_t I>
+    using field_type = typename std::tuple_element<I, value_type>::type;
+
+    void push_back(const Fields&... fields)
+    {
+        pushFields(functional_impl::helpers::gen_seq<sizeof...(Fields)>(), fields...);
+    }
+
+    void push_back(const value_type& row)
+    {
+        functional_impl::helpers::pushRow(*this, row, functional_impl::helpers::gen_seq<sizeof...(Fields)>());
+    }
+
+    void reserve(std::size_t n)
+    {
+        reserveColumns(n, functional_impl::helpers::gen_seq<sizeof...(Fields)>());
+    }
+
+    std::size_t size() const { return std::get<0>(m_columns).size(); }
+    bool empty() const { return size() == 0; }
+
+    reference operator[] (std::size_t pos) { return rows(functional_impl::helpers::gen_seq<sizeof...(Fields)>())[pos]; }
+    const_reference operator[] (std::size_t pos) const { return rows(functional_impl::helpers::gen_seq<sizeof...(Fields)>())[pos]; }
+
+    iterator begin() { return rows(functional_impl::helpers::gen_seq<sizeof...(Fields)>()).begin(); }
+    iterator end() { return rows(functional_impl::helpers::gen_seq<sizeof...(Fields)>()).end(); }
+    const_iterator begin() const { return rows(functional_impl::helpers::gen_seq<sizeof...(Fields)>()).begin(); }
+    const_iterator end() const { return rows(functional_impl::helpers::gen_seq<sizeof...(Fields)>()).end(); }
+
+    // single field projection, a plain contiguous vector that map/foldl/zipWith scan with unit stride;
+    // elements may be modified in place but the column must not be resized
+    template<std::size_t I>
+    std::vector<field_type<I>>& column() { return std::get<I>(m_columns); }
+
+    template<std::size_t I>
+    const std::vector<field_type<I>>& column() const { return std::get<I>(m_columns); }
+
+    // projection onto a subset of fields, iterated as tuples of references
+    template<std::size_t... Is>
+    functional_impl::helpers::ColumnView<const std::vector<field_type<Is>>...> columns() const
+    {
+        return functional_impl::helpers::ColumnView<const std::vector<field_type<Is>>...>(std::get<Is>(m_columns)...);
+    }
+
+private:
+    template<unsigned... Is>
+    functional_impl::helpers::ColumnView<std::vector<Fields>...> rows(functional_impl::helpers::seq<Is...>)
+    {
+        return functional_impl::helpers::ColumnView<std::vector<Fields>...>(std::get<Is>(m_columns)...);
+    }
+
+    template<unsigned... Is>
+    functional_impl::helpers::ColumnView<const std::vector<Fields>...> rows(functional_impl::helpers::seq<Is...>) const
+    {
+        return functional_impl::helpers::ColumnView<const std::vector<Fields>...>(std::get<Is>(m_columns)...);
+    }
+
+    template<unsigned... Is>
+    void pushFields(functional_impl::helpers::seq<Is...>, const Fields&... fields)
+    {
+        std::initializer_list<int>{ (std::get<Is>(m_columns).push_back(fields), 0)... };
+    }
+
+    template<unsigned... Is>
+    void reserveColumns(std::size_t n, functional_impl::helpers::seq<Is...>)
+    {
+        std::initializer_list<int>{ (std::get<Is>(m_columns).reserve(n), 0)... };
+    }
+
+    Columns m_columns;
+};
+
+template<typename Container>
+auto functional::unzip(const Container& rows) -> typename functional_impl::helpers::unzip_t<Container>::type
+{
+    typedef typename functional_impl::helpers::unzip_t<Container> Unzip;
+
+    typename Unzip::type result;
+    functional_impl::helpers::reserveRows(result, rows, 0);
+    for (auto&& row : rows)
+    {
+        functional_impl::helpers::pushRow(result, row, functional_impl::helpers::gen_seq<std::tuple_size<typename Unzip::row_type>::value>());
+    }
+    return result;
+}
+
+#endif // _SOA_HPP_
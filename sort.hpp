@@ -0,0 +1,530 @@
+/*
+Copyright (c) 2013 Janick Bernet
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#ifndef _SORT_HPP_
+#define _SORT_HPP_
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "parallel.hpp"
+
+namespace functional
+{
+    // All sorts take their input by value and return it sorted, so passing an rvalue sorts in place without
+    // a copy. sortOn computes every key once and uses an LSD radix sort for arithmetic keys, which carries
+    // small trivially copyable elements along with their keys and sorts other elements through their
+    // positions; the parallel versions sort runs on the executor and merge them in parallel rounds.
+
+    //! sortBy :: (a -> a -> Bool) -> [a] -> [a]
+    template<typename Less, typename Container>
+    Container sortBy(Less less, Container input);
+
+    //! sortOn :: (a -> b) -> [a] -> [a]
+    template<typename Key, typename Container>
+    Container sortOn(Key key, Container input);
+
+    //! unstableSortBy :: (a -> a -> Bool) -> [a] -> [a]
+    template<typename Less, typename Container>
+    Container unstableSortBy(Less less, Container input);
+
+    //! unstableSortOn :: (a -> b) -> [a] -> [a]
+    template<typename Key, typename Container>
+    Container unstableSortOn(Key key, Container input);
+
+    //! sortBy :: Par -> (a -> a -> Bool) -> [a] -> [a]
+    template<typename Less, typename Container>
+    Container sortBy(const parallel_policy& policy, Less less, Container input);
+
+    //! sortOn :: Par -> (a -> b) -> [a] -> [a]
+    template<typename Key, typename Container>
+    Container sortOn(const parallel_policy& policy, Key key, Container input);
+};
+
+namespace functional_impl
+{
+    namespace helpers
+    {
+        // an element's sort key next to its position in the input
+        template<typename Key>
+        struct Decorated
+        {
+            Key key;
+            std::size_t index;
+        };
+
+        // an element's position alone, for sorting by a comparison on the elements
+        struct Position
+        {
+            std::size_t index;
+        };
+
+        // a small trivially copyable element next to its radix key, sorted as a whole so no gather through
+        // positions is needed afterwards
+        template<typename T>
+        struct Keyed
+        {
+            std::uint64_t key;
+            T value;
+        };
+
+        // arithmetic keys as unsigned integers of the same order, for the radix sort
+        template<typename Key>
+        inline typename std::enable_if<std::is_integral<Key>::value && std::is_unsigned<Key>::value, std::uint64_t>::type radixKey(Key key)
+        {
+            return static_cast<std::uint64_t>(key);
+        }
+
+        template<typename Key>
+        inline typename std::enable_if<std::is_integral<Key>::value && std::is_signed<Key>::value, std::uint64_t>::type radixKey(Key key)
+        {
+            return static_cast<std::uint64_t>(static_cast<std::int64_t>(key)) ^ (std::uint64_t(1) << 63);
+        }
+
+        // negative floats reverse their order when read as integers, positive ones only need the sign bit set
+        inline std::uint64_t radixKey(double key)
+        {
+            std::uint64_t bits;
+            std::memcpy(&bits, &key, sizeof(bits));
+            return (bits >> 63) ? ~bits : bits | (std::uint64_t(1) << 63);
+        }
+
+        inline std::uint64_t radixKey(float key)
+        {
+            return radixKey(static_cast<double>(key));
+        }
+
+        // stable LSD radix sort of items with a std::uint64_t key on bytes, in one counting pass over all 8
+        // bytes; bytes that are equal for all items are skipped, so small keys only cost the passes they need.
+        // Returns the sorted range, which is either [first, last) or the buffer
+        template<typename Item>
+        inline Item* radixSort(Item* first, Item* last, Item* buffer)
+        {
+            const std::size_t size = last - first;
+            std::vector<std::size_t> counts(8 * 256, 0);
+            for (auto item = first; item != last; ++item)
+            {
+                for (unsigned byte = 0; byte < 8; ++byte)
+                {
+                    ++counts[byte * 256 + ((item->key >> (byte * 8)) & 0xff)];
+                }
+            }
+
+            Item* source = first;
+            Item* target = buffer;
+            for (unsigned byte = 0; byte < 8 && size > 0; ++byte)
+            {
+                std::size_t* count = &counts[byte * 256];
+                if (count[(source->key >> (byte * 8)) & 0xff] == size)
+                {
+                    continue;
+                }
+                std::size_t offset = 0;
+                for (unsigned digit = 0; digit < 256; ++digit)
+                {
+                    const std::size_t n = count[digit];
+                    count[digit] = offset;
+                    offset += n;
+                }
+                for (std::size_t i = 0; i < size; ++i)
+                {
+                    target[count[(source[i].key >> (byte * 8)) & 0xff]++] = source[i];
+                }
+                std::swap(source, target);
+            }
+            return source;
+        }
+
+        // sorts [first, last) in place as given sorted runs: the runs are sorted on the executor, then merged
+        // pairwise, all pairs of a round at once, until one run is left
+        template<typename T, typename Less, typename SortRun>
+        inline void parallelMergeSort(Executor& executor, T* first, T* last, Less less, SortRun sortRun)
+        {
+            const std::size_t size = last - first;
+            const std::size_t minRun = 1 << 13;
+            const std::size_t runs = std::max<std::size_t>(1, std::min(executor.concurrency() * 2, size / minRun));
+            std::vector<std::size_t> bounds(runs + 1);
+            for (std::size_t i = 0; i <= runs; ++i)
+            {
+                bounds[i] = size * i / runs;
+            }
+            parallelFor(executor, runs, [&](std::size_t i) { sortRun(first + bounds[i], first + bounds[i + 1]); });
+
+            std::vector<T> buffer(runs > 1 ? size : 0);
+            T* source = first;
+            T* target = buffer.data();
+            while (bounds.size() > 2)
+            {
+                FUNCTIONAL_TRACE_SCOPE("merge");
+                const std::size_t pairs = (bounds.size() - 1) / 2;
+                parallelFor(executor, pairs, [&](std::size_t i)
+                {
+                    const std::size_t a = bounds[2 * i];
+                    const std::size_t b = bounds[2 * i + 1];
+                    const std::size_t c = bounds[2 * i + 2];
+                    std::merge(std::make_move_iterator(source + a), std::make_move_iterator(source + b), std::make_move_iterator(source + b), std::make_move_iterator(source + c), target + a, less);
+                });
+                if ((bounds.size() - 1) % 2)
+                {
+                    std::move(source + bounds[bounds.size() - 2], source + size, target + bounds[bounds.size() - 2]);
+                }
+                std::vector<std::size_t> merged;
+                for (std::size_t i = 0; i < bounds.size(); i += 2)
+                {
+                    merged.push_back(bounds[i]);
+                }
+                if (merged.back() != size)
+                {
+                    merged.push_back(size);
+                }
+                bounds.swap(merged);
+                std::swap(source, target);
+            }
+            if (source != first)
+            {
+                std::move(source, source + size, first);
+            }
+        }
+
+        template<typename Container>
+        inline std::vector<typename std::decay<decltype(*std::declval<Container&>().begin())>::type> takeValues(Container& container)
+        {
+            return std::vector<typename std::decay<decltype(*container.begin())>::type>(std::make_move_iterator(container.begin()), std::make_move_iterator(container.end()));
+        }
+
+        // moves the elements of container into the order given by the sorted decorations by following the
+        // cycles of the permutation, so a random access container needs no second copy of its elements;
+        // other containers go through a vector. Marks every decoration as in place on the way
+        template<typename Container, typename Items>
+        inline void permute(Container& container, Items& order, std::random_access_iterator_tag)
+        {
+            auto first = container.begin();
+            for (std::size_t start = 0; start < order.size(); ++start)
+            {
+                if (order[start].index == start)
+                {
+                    continue;
+                }
+                auto value = std::move(first[start]);
+                std::size_t hole = start;
+                for (;;)
+                {
+                    const std::size_t from = order[hole].index;
+                    order[hole].index = hole;
+                    if (from == start)
+                    {
+                        break;
+                    }
+                    first[hole] = std::move(first[from]);
+                    hole = from;
+                }
+                first[hole] = std::move(value);
+            }
+        }
+
+        template<typename Container, typename Items>
+        inline void permute(Container& container, Items& order, std::forward_iterator_tag)
+        {
+            auto values = takeValues(container);
+            auto out = container.begin();
+            for (const auto& item : order)
+            {
+                *out++ = std::move(values[item.index]);
+            }
+        }
+
+        template<typename Container, typename Items>
+        inline void permute(Container& container, Items& order)
+        {
+            permute(container, order, typename std::iterator_traits<decltype(container.begin())>::iterator_category());
+        }
+
+        template<typename Less>
+        struct StableSort
+        {
+            const Less& less;
+
+            template<typename Itr>
+            void operator() (Itr first, Itr last) const { std::stable_sort(first, last, less); }
+        };
+
+        template<typename Less>
+        struct UnstableSort
+        {
+            const Less& less;
+
+            template<typename Itr>
+            void operator() (Itr first, Itr last) const { std::sort(first, last, less); }
+        };
+
+        // comparison sorts work on the container itself when it is random access, on a vector of its elements otherwise
+        template<typename Container, typename Sort>
+        inline void sortElements(Container& container, const Sort& sort, std::random_access_iterator_tag)
+        {
+            sort(container.begin(), container.end());
+        }
+
+        template<typename Container, typename Sort>
+        inline void sortElements(Container& container, const Sort& sort, std::forward_iterator_tag)
+        {
+            auto values = takeValues(container);
+            sort(values.begin(), values.end());
+            std::move(values.begin(), values.end(), container.begin());
+        }
+
+        template<typename Container, typename Sort>
+        inline void sortElements(Container& container, const Sort& sort)
+        {
+            sortElements(container, sort, typename std::iterator_traits<decltype(container.begin())>::iterator_category());
+        }
+
+        template<typename Container, typename KeyFun>
+        struct sort_key_t
+        {
+            typedef typename std::decay<decltype(std::declval<const Applicator<KeyFun>&>()(*std::declval<const Container&>().begin()))>::type type;
+        };
+
+        struct KeyLess
+        {
+            template<typename Item>
+            bool operator() (const Item& a, const Item& b) const
+            {
+                return a.key < b.key;
+            }
+        };
+
+        // how sortOn sorts: by comparing the keys, by radix on keys and positions, or by radix on keys
+        // carrying the elements themselves
+        struct KeyComparison {};
+        struct IndexRadix {};
+        struct PayloadRadix {};
+
+        template<typename Container, typename KeyFun>
+        struct sort_on_t
+        {
+            typedef typename std::decay<decltype(*std::declval<Container&>().begin())>::type element_type;
+            typedef typename std::conditional<!std::is_arithmetic<typename sort_key_t<Container, KeyFun>::type>::value, KeyComparison,
+                typename std::conditional<std::is_trivially_copyable<element_type>::value && std::is_default_constructible<element_type>::value && sizeof(element_type) <= 2 * sizeof(std::uint64_t),
+                    PayloadRadix, IndexRadix>::type>::type type;
+        };
+
+        // the items to sort, made by item(value, index) for every element in input order
+        template<typename Item, typename Container, typename MakeItem>
+        inline std::vector<Item> decorate(const Container& container, const MakeItem& item)
+        {
+            std::vector<Item> items;
+            items.reserve(iteratableSize(container, 0));
+            std::size_t index = 0;
+            for (const auto& value : container)
+            {
+                items.push_back(item(value, index++));
+            }
+            return items;
+        }
+
+        template<typename Container, typename KeyFun>
+        inline std::vector<Decorated<typename sort_key_t<Container, KeyFun>::type>> decorate(const Container& container, KeyFun& keyFun, KeyComparison)
+        {
+            typedef Decorated<typename sort_key_t<Container, KeyFun>::type> Item;
+            const Applicator<KeyFun> key{ keyFun };
+            return decorate<Item>(container, [&](const typename sort_on_t<Container, KeyFun>::element_type& value, std::size_t index) { return Item{ key(value), index }; });
+        }
+
+        template<typename Container, typename KeyFun>
+        inline std::vector<Decorated<std::uint64_t>> decorate(const Container& container, KeyFun& keyFun, IndexRadix)
+        {
+            typedef Decorated<std::uint64_t> Item;
+            const Applicator<KeyFun> key{ keyFun };
+            return decorate<Item>(container, [&](const typename sort_on_t<Container, KeyFun>::element_type& value, std::size_t index) { return Item{ radixKey(key(value)), index }; });
+        }
+
+        template<typename Container, typename KeyFun>
+        inline std::vector<Keyed<typename sort_on_t<Container, KeyFun>::element_type>> decorate(const Container& container, KeyFun& keyFun, PayloadRadix)
+        {
+            typedef Keyed<typename sort_on_t<Container, KeyFun>::element_type> Item;
+            const Applicator<KeyFun> key{ keyFun };
+            return decorate<Item>(container, [&](const typename sort_on_t<Container, KeyFun>::element_type& value, std::size_t) { return Item{ radixKey(key(value)), value }; });
+        }
+
+        // sorts the items by key; radix sort is stable anyway, comparison sorts may use the faster unstable sort
+        template<typename Item>
+        inline void sortItems(std::vector<Item>& items, std::true_type, KeyComparison)
+        {
+            std::stable_sort(items.begin(), items.end(), KeyLess());
+        }
+
+        template<typename Item>
+        inline void sortItems(std::vector<Item>& items, std::false_type, KeyComparison)
+        {
+            std::sort(items.begin(), items.end(), KeyLess());
+        }
+
+        template<typename Item, typename Stable, typename Radix>
+        inline void sortItems(std::vector<Item>& items, Stable, Radix)
+        {
+            std::vector<Item> buffer(items.size());
+            if (radixSort(items.data(), items.data() + items.size(), buffer.data()) != items.data())
+            {
+                items.swap(buffer);
+            }
+        }
+
+        template<typename Item>
+        inline void parallelSortItems(Executor& executor, std::vector<Item>& items, KeyComparison)
+        {
+            parallelMergeSort(executor, items.data(), items.data() + items.size(), KeyLess(), [](Item* first, Item* last) { std::stable_sort(first, last, KeyLess()); });
+        }
+
+        // the runs are radix sorted on the transformed keys, so only the merges compare
+        template<typename Item, typename Radix>
+        inline void parallelSortItems(Executor& executor, std::vector<Item>& items, Radix)
+        {
+            parallelMergeSort(executor, items.data(), items.data() + items.size(), KeyLess(), [](Item* first, Item* last)
+            {
+                std::vector<Item> buffer(last - first);
+                const Item* sorted = radixSort(first, last, buffer.data());
+                if (sorted != first)
+                {
+                    std::copy(sorted, sorted + (last - first), first);
+                }
+            });
+        }
+
+        // the sorted items go back into the container, either as the elements they carry or through their positions
+        template<typename Container, typename T>
+        inline void undecorate(Container& container, const std::vector<Keyed<T>>& items)
+        {
+            auto out = container.begin();
+            for (const auto& item : items)
+            {
+                *out++ = item.value;
+            }
+        }
+
+        template<typename Container, typename Key>
+        inline void undecorate(Container& container, std::vector<Decorated<Key>>& items)
+        {
+            permute(container, items);
+        }
+
+        template<typename Container, typename KeyFun, typename Stable>
+        inline void sortOn(Container& container, KeyFun& keyFun, Stable stable)
+        {
+            typedef typename sort_on_t<Container, KeyFun>::type Strategy;
+
+            auto items = decorate(container, keyFun, Strategy());
+            sortItems(items, stable, Strategy());
+            undecorate(container, items);
+        }
+
+        template<typename Container, typename KeyFun>
+        inline void parallelSortOn(Executor& executor, Container& container, KeyFun& keyFun)
+        {
+            typedef typename sort_on_t<Container, KeyFun>::type Strategy;
+
+            auto items = decorate(container, keyFun, Strategy());
+            parallelSortItems(executor, items, Strategy());
+            undecorate(container, items);
+        }
+    }
+};
+
+template<typename Less, typename Container>
+Container functional::sortBy(Less less, Container input)
+{
+    FUNCTIONAL_PROBE("sortBy", Less);
+    FUNCTIONAL_PROBE_ELEMENTS(functional_impl::instrumentation::elementCount(input, 0));
+    const functional_impl::helpers::Applicator<Less> f{ less };
+    functional_impl::helpers::sortElements(input, functional_impl::helpers::StableSort<functional_impl::helpers::Applicator<Less>>{ f });
+    return input;
+}
+
+template<typename Key, typename Container>
+Container functional::sortOn(Key key, Container input)
+{
+    FUNCTIONAL_PROBE("sortOn", Key);
+    FUNCTIONAL_PROBE_ELEMENTS(functional_impl::instrumentation::elementCount(input, 0));
+    functional_impl::helpers::sortOn(input, key, std::true_type());
+    return input;
+}
+
+template<typename Less, typename Container>
+Container functional::unstableSortBy(Less less, Container input)
+{
+    FUNCTIONAL_PROBE("unstableSortBy", Less);
+    FUNCTIONAL_PROBE_ELEMENTS(functional_impl::instrumentation::elementCount(input, 0));
+    const functional_impl::helpers::Applicator<Less> f{ less };
+    functional_impl::helpers::sortElements(input, functional_impl::helpers::UnstableSort<functional_impl::helpers::Applicator<Less>>{ f });
+    return input;
+}
+
+template<typename Key, typename Container>
+Container functional::unstableSortOn(Key key, Container input)
+{
+    FUNCTIONAL_PROBE("unstableSortOn", Key);
+    FUNCTIONAL_PROBE_ELEMENTS(functional_impl::instrumentation::elementCount(input, 0));
+    functional_impl::helpers::sortOn(input, key, std::false_type());
+    return input;
+}
+
+template<typename Less, typename Container>
+Container functional::sortBy(const parallel_policy& policy, Less less, Container input)
+{
+    FUNCTIONAL_PROBE("sortBy", Less);
+    FUNCTIONAL_PROBE_ELEMENTS(functional_impl::instrumentation::elementCount(input, 0));
+    auto values = functional_impl::helpers::takeValues(input);
+    const functional_impl::helpers::Applicator<Less> f{ less };
+
+    // sorting positions keeps the merge buffer trivial whatever the elements are; ties keep input order.
+    // The comparisons read the moved out elements, which go back in sorted order at the end
+    std::vector<functional_impl::helpers::Position> order(values.size());
+    for (std::size_t i = 0; i < order.size(); ++i)
+    {
+        order[i].index = i;
+    }
+    auto byValue = [&](const functional_impl::helpers::Position& a, const functional_impl::helpers::Position& b) { return f(values[a.index], values[b.index]); };
+    functional_impl::helpers::parallelMergeSort(policy.executor(), order.data(), order.data() + order.size(), byValue,
+        [&](functional_impl::helpers::Position* first, functional_impl::helpers::Position* last) { std::stable_sort(first, last, byValue); });
+    auto out = input.begin();
+    for (const auto& position : order)
+    {
+        *out++ = std::move(values[position.index]);
+    }
+    return input;
+}
+
+template<typename Key, typename Container>
+Container functional::sortOn(const parallel_policy& policy, Key key, Container input)
+{
+    FUNCTIONAL_PROBE("sortOn", Key);
+    FUNCTIONAL_PROBE_ELEMENTS(functional_impl::instrumentation::elementCount(input, 0));
+    functional_impl::helpers::parallelSortOn(policy.executor(), input, key);
+    return input;
+}
+
+#endif // _SORT_HPP_
@@ -0,0 +1,261 @@
+/*
+Copyright (c) 2013 Janick Bernet
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#ifndef _STRINGS_HPP_
+#define _STRINGS_HPP_
+
+// Tokenizing views over a character buffer that yield string_refs pointing into it, so splitting text does
+// not allocate per token. Delimiters are searched with memchr, which the C libraries vectorize. The views
+// and the refs they yield do not own the characters, the buffer has to outlive them.
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <ostream>
+#include <string>
+
+#include "functional.hpp"
+
+namespace functional_impl
+{
+    namespace helpers
+    {
+        class Tokens;
+    }
+};
+
+namespace functional
+{
+    // non-owning view of a range of characters, the C++11 stand-in for std::string_view
+    class string_ref;
+
+    //! split :: String -> Char -> [String]
+    functional_impl::helpers::Tokens split(string_ref text, char delimiter);
+
+    // the lines without their line break ("\n" or "\r\n"), a trailing line break doesn't start another line
+    //! lines :: String -> [String]
+    functional_impl::helpers::Tokens lines(string_ref text);
+
+    // like split, but runs of separators count as one and leading or trailing ones are dropped, so no field is empty
+    //! fields :: String -> Char -> [String]
+    functional_impl::helpers::Tokens fields(string_ref text, char separator);
+};
+
+// iterable like a container of chars, and stored by value by the views and zip
+class functional::string_ref : public _Sequence
+{
+public:
+    typedef char value_type;
+    typedef const char* iterator;
+    typedef const char* const_iterator;
+
+    static const std::size_t npos = std::size_t(-1);
+
+    string_ref()
+        : m_data(""), m_size(0)
+    {
+    }
+
+    string_ref(const char* data, std::size_t size)
+        : m_data(data), m_size(size)
+    {
+    }
+
+    string_ref(const char* str)
+        : m_data(str), m_size(std::strlen(str))
+    {
+    }
+
+    string_ref(const std::string& str)
+        : m_data(str.data()), m_size(str.size())
+    {
+    }
+
+    const char* data() const { return m_data; }
+    std::size_t size() const { return m_size; }
+    bool empty() const { return m_size == 0; }
+
+    const char* begin() const { return m_data; }
+    const char* end() const { return m_data + m_size; }
+    char operator[] (std::size_t pos) const { return m_data[pos]; }
+
+    string_ref substr(std::size_t pos, std::size_t count = npos) const
+    {
+        pos = pos < m_size ? pos : m_size;
+        return string_ref(m_data + pos, count < m_size - pos ? count : m_size - pos);
+    }
+
+    std::string str() const { return std::string(m_data, m_size); }
+
+    int compare(const string_ref& other) const
+    {
+        const int result = std::memcmp(m_data, other.m_data, m_size < other.m_size ? m_size : other.m_size);
+        return result != 0 ? result : m_size < other.m_size ? -1 : m_size > other.m_size ? 1 : 0;
+    }
+
+    bool operator== (const string_ref& other) const { return m_size == other.m_size && std::memcmp(m_data, other.m_data, m_size) == 0; }
+    bool operator!= (const string_ref& other) const { return !(*this == other); }
+    bool operator< (const string_ref& other) const { return compare(other) < 0; }
+
+private:
+    const char* m_data;
+    std::size_t m_size;
+};
+
+inline std::ostream& operator<< (std::ostream& out, const functional::string_ref& ref)
+{
+    return out.write(ref.data(), ref.size());
+}
+
+namespace std
+{
+    // FNV-1a, so tokens can key hash tables, memoize and hashJoin without being copied into strings
+    template<>
+    struct hash<functional::string_ref>
+    {
+        std::size_t operator() (const functional::string_ref& ref) const
+        {
+            std::uint64_t hash = 0xcbf29ce484222325ull;
+            for (char c : ref)
+            {
+                hash = (hash ^ static_cast<unsigned char>(c)) * 0x100000001b3ull;
+            }
+            return static_cast<std::size_t>(hash);
+        }
+    };
+}
+
+namespace functional_impl
+{
+    namespace helpers
+    {
+        enum TokenMode { SplitTokens, LineTokens, FieldTokens };
+
+        // lazy view of the tokens of a text between occurrences of a delimiter
+        class Tokens : public _Sequence
+        {
+        public:
+            typedef functional::string_ref value_type;
+            typedef functional::string_ref reference;
+
+            Tokens(functional::string_ref text, char delimiter, TokenMode mode)
+                : m_text(text)
+                , m_delimiter(delimiter)
+                , m_mode(mode)
+            {
+            }
+
+            class Itr
+            {
+            public:
+                bool operator!= (const Itr& other) const
+                {
+                    return m_begin != other.m_begin;
+                }
+
+                functional::string_ref operator* () const
+                {
+                    return functional::string_ref(m_begin, m_end - m_begin);
+                }
+
+                const Itr& operator++ ()
+                {
+                    find(m_next);
+                    return *this;
+                }
+
+            private:
+                friend class Tokens;
+
+                Itr(const char* from, const char* last, char delimiter, TokenMode mode)
+                    : m_begin(nullptr)
+                    , m_end(nullptr)
+                    , m_next(nullptr)
+                    , m_last(last)
+                    , m_delimiter(delimiter)
+                    , m_mode(mode)
+                {
+                    find(from);
+                }
+
+                // the token starting at from (or the next non-empty one for fields), from being null past the last token
+                void find(const char* from)
+                {
+                    for (;;)
+                    {
+                        if (!from || (from == m_last && m_mode != SplitTokens))
+                        {
+                            m_begin = nullptr;
+                            return;
+                        }
+                        const char* found = static_cast<const char*>(from == m_last ? nullptr : std::memchr(from, m_delimiter, m_last - from));
+                        m_end = found ? found : m_last;
+                        m_next = found ? found + 1 : nullptr;
+                        if (m_mode != FieldTokens || m_end != from)
+                        {
+                            break;
+                        }
+                        from = m_next;
+                    }
+                    m_begin = from;
+                    if (m_mode == LineTokens && m_end != m_begin && m_end[-1] == '\r')
+                    {
+                        --m_end;
+                    }
+                }
+
+                const char* m_begin;
+                const char* m_end;
+                const char* m_next;
+                const char* m_last;
+                char m_delimiter;
+                TokenMode m_mode;
+            };
+
+            Itr begin() const { return Itr(m_text.begin(), m_text.end(), m_delimiter, m_mode); }
+            Itr end() const { return Itr(nullptr, m_text.end(), m_delimiter, m_mode); }
+
+        private:
+            functional::string_ref m_text;
+            char m_delimiter;
+            TokenMode m_mode;
+        };
+    }
+};
+
+inline functional_impl::helpers::Tokens functional::split(string_ref text, char delimiter)
+{
+    return functional_impl::helpers::Tokens(text, delimiter, functional_impl::helpers::SplitTokens);
+}
+
+inline functional_impl::helpers::Tokens functional::lines(string_ref text)
+{
+    return functional_impl::helpers::Tokens(text, '\n', functional_impl::helpers::LineTokens);
+}
+
+inline functional_impl::helpers::Tokens functional::fields(string_ref text, char separator)
+{
+    return functional_impl::helpers::Tokens(text, separator, functional_impl::helpers::FieldTokens);
+}
+
+#endif // _STRINGS_HPP_
@@ -0,0 +1,186 @@
+/*
+Copyright (c) 2013 Janick Bernet
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#ifndef _TRACE_HPP_
+#define _TRACE_HPP_
+
+// Timeline tracing of the executor and the combinators running on it, enabled by defining
+// FUNCTIONAL_TRACE before including functional.hpp. Every thread appends begin/end/instant
+// events to its own fixed size ring buffer (FUNCTIONAL_TRACE_CAPACITY events, oldest are
+// overwritten) without taking locks; writeChromeTrace() renders all buffers in the Chrome
+// trace event format understood by chrome://tracing and Perfetto. Without the define all
+// trace points expand to nothing.
+
+#include <ostream>
+
+#if defined(FUNCTIONAL_TRACE)
+    #include <atomic>
+    #include <chrono>
+    #include <cstdint>
+    #include <memory>
+    #include <mutex>
+    #include <vector>
+
+    #if !defined(FUNCTIONAL_TRACE_CAPACITY)
+        #define FUNCTIONAL_TRACE_CAPACITY (1 << 16)
+    #endif
+#endif
+
+namespace functional
+{
+    namespace trace
+    {
+        //! writes the events recorded so far as Chrome trace JSON, best called while no pipeline is running
+        void writeChromeTrace(std::ostream& out);
+
+        //! drops all recorded events
+        void clear();
+    }
+};
+
+namespace functional_impl
+{
+    namespace trace
+    {
+#if defined(FUNCTIONAL_TRACE)
+        // names are expected to be string literals, only the pointer is stored
+        struct Event
+        {
+            const char* name;
+            std::uint64_t nanoseconds;
+            char phase;
+        };
+
+        // single writer (the owning thread), the head is published with release semantics for the reader
+        struct ThreadBuffer
+        {
+            explicit ThreadBuffer(std::uint32_t tid)
+                : tid(tid)
+                , head(0)
+                , events(FUNCTIONAL_TRACE_CAPACITY)
+            {
+            }
+
+            const std::uint32_t tid;
+            std::atomic<std::uint64_t> head;
+            std::vector<Event> events;
+        };
+
+        // owns the buffers of all threads that ever traced, so they survive their threads until written
+        struct Registry
+        {
+            std::mutex mutex;
+            std::vector<std::shared_ptr<ThreadBuffer>> buffers;
+            const std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+
+            static Registry& instance()
+            {
+                static Registry registry;
+                return registry;
+            }
+
+            ThreadBuffer* add()
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                buffers.push_back(std::make_shared<ThreadBuffer>(static_cast<std::uint32_t>(buffers.size() + 1)));
+                return buffers.back().get();
+            }
+        };
+
+        inline ThreadBuffer& local()
+        {
+            static thread_local ThreadBuffer* buffer = Registry::instance().add();
+            return *buffer;
+        }
+
+        inline void record(const char* name, char phase)
+        {
+            auto& registry = Registry::instance();
+            auto& buffer = local();
+            std::uint64_t head = buffer.head.load(std::memory_order_relaxed);
+            Event& event = buffer.events[head % buffer.events.size()];
+            event.name = name;
+            event.phase = phase;
+            event.nanoseconds = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - registry.epoch).count();
+            buffer.head.store(head + 1, std::memory_order_release);
+        }
+
+        struct Scope
+        {
+            explicit Scope(const char* name) : name(name) { record(name, 'B'); }
+            ~Scope() { record(name, 'E'); }
+            const char* name;
+        };
+
+        #define FUNCTIONAL_TRACE_CONCAT_(a, b) a##b
+        #define FUNCTIONAL_TRACE_CONCAT(a, b) FUNCTIONAL_TRACE_CONCAT_(a, b)
+        #define FUNCTIONAL_TRACE_BEGIN(name) functional_impl::trace::record(name, 'B')
+        #define FUNCTIONAL_TRACE_END(name) functional_impl::trace::record(name, 'E')
+        #define FUNCTIONAL_TRACE_INSTANT(name) functional_impl::trace::record(name, 'i')
+        #define FUNCTIONAL_TRACE_SCOPE(name) functional_impl::trace::Scope FUNCTIONAL_TRACE_CONCAT(_traceScope, __LINE__)(name)
+#else
+        #define FUNCTIONAL_TRACE_BEGIN(name)
+        #define FUNCTIONAL_TRACE_END(name)
+        #define FUNCTIONAL_TRACE_INSTANT(name)
+        #define FUNCTIONAL_TRACE_SCOPE(name)
+#endif
+    }
+};
+
+inline void functional::trace::writeChromeTrace(std::ostream& out)
+{
+    out << "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [";
+#if defined(FUNCTIONAL_TRACE)
+    auto& registry = functional_impl::trace::Registry::instance();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    bool first = true;
+    for (auto& buffer : registry.buffers)
+    {
+        std::uint64_t head = buffer->head.load(std::memory_order_acquire);
+        std::uint64_t size = buffer->events.size();
+        std::uint64_t begin = head > size ? head - size : 0;
+        for (std::uint64_t i = begin; i < head; ++i)
+        {
+            const auto& event = buffer->events[i % size];
+            out << (first ? "\n" : ",\n");
+            out << "  {\"name\": \"" << event.name << "\", \"ph\": \"" << event.phase << "\", \"ts\": " << event.nanoseconds / 1000 << "." << (event.nanoseconds % 1000) / 100 << (event.nanoseconds % 100) / 10 << event.nanoseconds % 10
+                << ", \"pid\": 1, \"tid\": " << buffer->tid << (event.phase == 'i' ? ", \"s\": \"t\"}" : "}");
+            first = false;
+        }
+    }
+#endif
+    out << "\n]}\n";
+}
+
+inline void functional::trace::clear()
+{
+#if defined(FUNCTIONAL_TRACE)
+    auto& registry = functional_impl::trace::Registry::instance();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    for (auto& buffer : registry.buffers)
+    {
+        buffer->head.store(0, std::memory_order_release);
+    }
+#endif
+}
+
+#endif // _TRACE_HPP_
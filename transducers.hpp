@@ -0,0 +1,260 @@
+/*
+Copyright (c) 2013 Janick Bernet
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#ifndef _TRANSDUCERS_HPP_
+#define _TRANSDUCERS_HPP_
+
+#include <cstddef>
+#include <utility>
+
+#include "functional.hpp"
+
+// A transducer turns a reducing step into another one, e.g. map(f) turns a step consuming f(x) into
+// one consuming x. Steps update the accumulator in place and return false to end the reduction early.
+// Composed transducers fuse into a single step, so transduce runs one loop without intermediate containers.
+
+namespace functional
+{
+    namespace xform
+    {
+        template<typename Fun>
+        struct Map;
+
+        template<typename Fun>
+        struct Filter;
+
+        struct Take;
+
+        template<typename... Xforms>
+        struct Composed;
+
+        //! map :: (a -> b) -> Transducer a b
+        template<typename Fun>
+        Map<Fun> map(Fun fun);
+
+        //! filter :: (a -> Bool) -> Transducer a a
+        template<typename Fun>
+        Filter<Fun> filter(Fun predicate);
+
+        //! take :: Int -> Transducer a a
+        Take take(std::size_t n);
+
+        //! compose :: Transducer a b -> Transducer b c -> ... -> Transducer a z
+        template<typename... Xforms>
+        Composed<Xforms...> compose(Xforms... xforms);
+
+        // reducing function appending to a container, to transduce into e.g. a std::vector
+        struct PushBack
+        {
+            template<typename Container, typename T>
+            Container operator() (Container container, T&& value) const
+            {
+                container.push_back(std::forward<T>(value));
+                return container;
+            }
+        };
+    }
+
+    //! transduce :: Transducer a b -> (c -> b -> c) -> c -> [a] -> c
+    template<typename Xform, typename Fun, typename ResultType, typename Iteratable>
+    ResultType transduce(Xform xform, Fun reducer, ResultType init, const Iteratable& iteratable);
+};
+
+namespace functional_impl
+{
+    namespace xform
+    {
+        // the innermost step, folding values into the accumulator with the user's reducing function
+        template<typename Fun>
+        struct Reduce
+        {
+            helpers::Applicator<Fun> f;
+
+            template<typename Acc, typename T>
+            bool operator() (Acc& acc, T&& value)
+            {
+                acc = helpers::foldStep(f, acc, std::forward<T>(value), 0);
+                return true;
+            }
+        };
+
+        template<typename Fun, typename Next>
+        struct MapStep
+        {
+            helpers::Applicator<Fun> f;
+            Next next;
+
+            template<typename Acc, typename T>
+            bool operator() (Acc& acc, T&& value)
+            {
+                return next(acc, f(std::forward<T>(value)));
+            }
+        };
+
+        template<typename Fun, typename Next>
+        struct FilterStep
+        {
+            helpers::Applicator<Fun> predicate;
+            Next next;
+
+            template<typename Acc, typename T>
+            bool operator() (Acc& acc, T&& value)
+            {
+                return predicate(value) ? next(acc, std::forward<T>(value)) : true;
+            }
+        };
+
+        // stateful: every transduce gets its own step and thereby its own count
+        template<typename Next>
+        struct TakeStep
+        {
+            std::size_t left;
+            Next next;
+
+            template<typename Acc, typename T>
+            bool operator() (Acc& acc, T&& value)
+            {
+                if (left == 0)
+                {
+                    return false;
+                }
+                --left;
+                return next(acc, std::forward<T>(value)) && left > 0;
+            }
+        };
+    }
+};
+
+template<typename Fun>
+struct functional::xform::Map
+{
+    Fun fun;
+
+    template<typename Next>
+    functional_impl::xform::MapStep<Fun, Next> operator() (Next next) const
+    {
+        return { { fun }, std::move(next) };
+    }
+};
+
+template<typename Fun>
+struct functional::xform::Filter
+{
+    Fun predicate;
+
+    template<typename Next>
+    functional_impl::xform::FilterStep<Fun, Next> operator() (Next next) const
+    {
+        return { { predicate }, std::move(next) };
+    }
+};
+
+struct functional::xform::Take
+{
+    std::size_t n;
+
+    template<typename Next>
+    functional_impl::xform::TakeStep<Next> operator() (Next next) const
+    {
+        return { n, std::move(next) };
+    }
+};
+
+// values flow through the transducers from left to right, i.e. the first one is the outermost step
+template<typename Xform>
+struct functional::xform::Composed<Xform>
+{
+    explicit Composed(Xform xform)
+        : first(std::move(xform))
+    {
+    }
+
+    template<typename Next>
+    auto operator() (Next next) const -> decltype(std::declval<const Xform&>()(std::move(next)))
+    {
+        return first(std::move(next));
+    }
+
+    Xform first;
+};
+
+template<typename Xform, typename... More>
+struct functional::xform::Composed<Xform, More...>
+{
+    Composed(Xform xform, More... more)
+        : first(std::move(xform))
+        , rest(std::move(more)...)
+    {
+    }
+
+    template<typename Next>
+    auto operator() (Next next) const -> decltype(std::declval<const Xform&>()(std::declval<const Composed<More...>&>()(std::move(next))))
+    {
+        return first(rest(std::move(next)));
+    }
+
+    Xform first;
+    Composed<More...> rest;
+};
+
+template<typename Fun>
+functional::xform::Map<Fun> functional::xform::map(Fun fun)
+{
+    return { std::move(fun) };
+}
+
+template<typename Fun>
+functional::xform::Filter<Fun> functional::xform::filter(Fun predicate)
+{
+    return { std::move(predicate) };
+}
+
+inline functional::xform::Take functional::xform::take(std::size_t n)
+{
+    return { n };
+}
+
+template<typename... Xforms>
+functional::xform::Composed<Xforms...> functional::xform::compose(Xforms... xforms)
+{
+    return Composed<Xforms...>(std::move(xforms)...);
+}
+
+// like foldl, but the loop stops as soon as a step asks for it (e.g. take), so infinite sequences can be transduced
+template<typename Xform, typename Fun, typename ResultType, typename Iteratable>
+ResultType functional::transduce(Xform xform, Fun reducer, ResultType init, const Iteratable& iteratable)
+{
+    FUNCTIONAL_PROBE("transduce", Fun);
+    auto step = xform(functional_impl::xform::Reduce<Fun>{ { std::move(reducer) } });
+    ResultType res = std::move(init);
+    for (auto&& value : iteratable)
+    {
+        FUNCTIONAL_PROBE_ELEMENT();
+        if (!step(res, value))
+        {
+            break;
+        }
+    }
+    return res;
+}
+
+#endif // _TRANSDUCERS_HPP_
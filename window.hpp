@@ -0,0 +1,293 @@
+/*
+Copyright (c) 2013 Janick Bernet
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#ifndef _WINDOW_HPP_
+#define _WINDOW_HPP_
+
+#include <cstddef>
+#include <limits>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include <assert.h>
+
+#include "functional.hpp"
+
+namespace functional_impl
+{
+    namespace helpers
+    {
+        template<typename Container>
+        class SlidingWindow;
+    }
+};
+
+namespace functional
+{
+    // monoids for window_fold: an associative combine with empty() as its neutral element
+    namespace monoid
+    {
+        template<typename T>
+        struct Sum
+        {
+            typedef T value_type;
+            T empty() const { return T(); }
+            T combine(const T& lhs, const T& rhs) const { return lhs + rhs; }
+        };
+
+        template<typename T>
+        struct Min
+        {
+            typedef T value_type;
+            T empty() const { return std::numeric_limits<T>::max(); }
+            T combine(const T& lhs, const T& rhs) const { return rhs < lhs ? rhs : lhs; }
+        };
+
+        template<typename T>
+        struct Max
+        {
+            typedef T value_type;
+            T empty() const { return std::numeric_limits<T>::lowest(); }
+            T combine(const T& lhs, const T& rhs) const { return lhs < rhs ? rhs : lhs; }
+        };
+    }
+
+    // fold over a window of the most recent values with amortized O(1) push, pop and fold
+    template<typename Monoid>
+    class window_fold;
+
+    //! slidingWindow :: Int -> Int -> [a] -> [[a]]
+    template<typename Container>
+    functional_impl::helpers::SlidingWindow<Container> slidingWindow(std::size_t n, std::size_t step, const Container& container);
+};
+
+namespace functional_impl
+{
+    namespace helpers
+    {
+        template<typename Container>
+        using chunk_itr_t = typename chunk_t<Container>::type::iterator;
+
+        template<typename Container>
+        inline chunk_itr_t<Container> chunkBegin(Container& container, std::true_type)
+        {
+            return container.size() == 0 ? nullptr : &*container.begin();
+        }
+
+        template<typename Container>
+        inline chunk_itr_t<Container> chunkBegin(Container& container, std::false_type)
+        {
+            return container.begin();
+        }
+
+        template<typename Container>
+        inline chunk_itr_t<Container> chunkEnd(Container& container, std::true_type)
+        {
+            return chunkBegin(container, std::true_type()) + container.size();
+        }
+
+        template<typename Container>
+        inline chunk_itr_t<Container> chunkEnd(Container& container, std::false_type)
+        {
+            return container.end();
+        }
+
+        // view of the full windows of n consecutive elements, starting every step elements; the windows
+        // are the same Chunks the batched combinators hand out, so pointer ranges for contiguous containers
+        template<typename Container>
+        class SlidingWindow : public _Sequence
+        {
+            typedef typename chunk_t<const Container>::type ChunkType;
+            typedef typename ChunkType::iterator ChunkItr;
+            typedef is_contiguous<Container> Contiguous;
+
+        public:
+            typedef ChunkType value_type;
+
+            SlidingWindow(const Container& container, std::size_t n, std::size_t step)
+                : m_container(container)
+                , m_n(n)
+                , m_step(step)
+            {
+                assert(n > 0 && step > 0);
+            }
+
+            class Itr
+            {
+            public:
+                bool operator!= (const Itr& other) const
+                {
+                    return m_done != other.m_done;
+                }
+
+                ChunkType operator* () const
+                {
+                    return ChunkType(m_first, m_last, m_n);
+                }
+
+                const Itr& operator++ ()
+                {
+                    for (std::size_t i = 0; i < m_step && !m_done; ++i)
+                    {
+                        m_done = !(m_last != m_end);
+                        if (!m_done)
+                        {
+                            ++m_first;
+                            ++m_last;
+                        }
+                    }
+                    return *this;
+                }
+
+            private:
+                friend class SlidingWindow<Container>;
+
+                Itr(ChunkItr begin, ChunkItr end, std::size_t n, std::size_t step, bool done)
+                    : m_first(begin)
+                    , m_last(begin)
+                    , m_end(end)
+                    , m_n(n)
+                    , m_step(step)
+                    , m_done(done)
+                {
+                    for (std::size_t i = 0; i < m_n && !m_done; ++i)
+                    {
+                        m_done = !(m_last != m_end);
+                        if (!m_done)
+                        {
+                            ++m_last;
+                        }
+                    }
+                }
+
+                ChunkItr m_first;
+                ChunkItr m_last;
+                ChunkItr m_end;
+                std::size_t m_n;
+                std::size_t m_step;
+                bool m_done;
+            };
+
+            Itr begin() const { return Itr(chunkBegin(m_container, Contiguous()), chunkEnd(m_container, Contiguous()), m_n, m_step, false); }
+            Itr end() const { return Itr(chunkEnd(m_container, Contiguous()), chunkEnd(m_container, Contiguous()), m_n, m_step, true); }
+
+            // only available if the container knows its size
+            template<typename C = Container>
+            auto size() const -> decltype(static_cast<std::size_t>(std::declval<const C&>().size()))
+            {
+                const std::size_t size = static_cast<std::size_t>(m_container.size());
+                return size < m_n ? 0 : (size - m_n) / m_step + 1;
+            }
+
+        private:
+            stored_t<Container> m_container;
+            const std::size_t m_n;
+            const std::size_t m_step;
+        };
+    }
+};
+
+// two stacks: pushed values go onto the back stack, which also keeps the fold of all its values;
+// the front stack holds for each of its (older) values the fold from that value up to the newest
+// front value and is refilled by flipping the back stack when it runs empty, so every value is
+// combined a constant number of times and combine needs no inverse
+template<typename Monoid>
+class functional::window_fold
+{
+public:
+    typedef typename Monoid::value_type value_type;
+
+    // with a capacity, pushing onto a full window drops its oldest value; 0 keeps values until popped
+    explicit window_fold(std::size_t capacity = 0, Monoid monoid = Monoid())
+        : m_monoid(std::move(monoid))
+        , m_capacity(capacity)
+        , m_backFold(m_monoid.empty())
+    {
+        m_back.reserve(capacity);
+        m_front.reserve(capacity);
+    }
+
+    void push(value_type value)
+    {
+        if (m_capacity != 0 && size() == m_capacity)
+        {
+            pop();
+        }
+        m_backFold = m_monoid.combine(m_backFold, value);
+        m_back.push_back(std::move(value));
+    }
+
+    //! drops the oldest value
+    void pop()
+    {
+        assert(!empty());
+        if (m_front.empty())
+        {
+            flip();
+        }
+        m_front.pop_back();
+    }
+
+    //! the fold of all values in the window, oldest to newest
+    value_type fold() const
+    {
+        return m_front.empty() ? m_backFold : m_monoid.combine(m_front.back(), m_backFold);
+    }
+
+    std::size_t size() const { return m_front.size() + m_back.size(); }
+    bool empty() const { return size() == 0; }
+    std::size_t capacity() const { return m_capacity; }
+
+    void clear()
+    {
+        m_front.clear();
+        m_back.clear();
+        m_backFold = m_monoid.empty();
+    }
+
+private:
+    void flip()
+    {
+        value_type suffix = m_monoid.empty();
+        for (auto pos = m_back.rbegin(); pos != m_back.rend(); ++pos)
+        {
+            suffix = m_monoid.combine(*pos, suffix);
+            m_front.push_back(suffix);
+        }
+        m_back.clear();
+        m_backFold = m_monoid.empty();
+    }
+
+    Monoid m_monoid;
+    const std::size_t m_capacity;
+    std::vector<value_type> m_back;
+    std::vector<value_type> m_front;
+    value_type m_backFold;
+};
+
+template<typename Container>
+functional_impl::helpers::SlidingWindow<Container> functional::slidingWindow(std::size_t n, std::size_t step, const Container& container)
+{
+    return functional_impl::helpers::SlidingWindow<Container>(container, n, step);
+}
+
+#endif // _WINDOW_HPP_